@@ -34,12 +34,91 @@ static unsigned long num_allocs = 0;
 static unsigned long num_frees = 0;
 
 
+/*
+  Header for a chunk made by reserve_memory(). The pieces handed out
+  follow directly after the header.
+ */
+
+typedef struct MemChunk {
+    struct MemChunk *next;
+
+    size_t size;  /* Number of bytes after the header */
+    size_t used;  /* Number of bytes handed out so far */
+    size_t live;  /* Number of pieces not yet freed */
+} MemChunk;
+
+/* Chunks with live pieces, the head is the one we allocate from */
+static MemChunk *chunks = NULL;
+
+/* Everything handed out of a chunk is aligned to this */
+#define CHUNK_ALIGN (sizeof(void *))
+
+
+/* Find the chunk that owns ptr, setting *previous to its predecessor */
+static MemChunk * find_chunk(void *ptr, MemChunk **previous)
+{
+    MemChunk *chunk = chunks;
+    *previous = NULL;
+
+    while (NULL != chunk) {
+	char *start = (char *) (chunk + 1);
+
+	if ((char *) ptr >= start && (char *) ptr < start + chunk->size) {
+	    return chunk;
+	}
+
+	*previous = chunk;
+	chunk = chunk->next;
+    }
+
+    return NULL;
+}
+
+
+size_t reserved_size(size_t size)
+{
+    return (size + CHUNK_ALIGN - 1) & ~(CHUNK_ALIGN - 1);
+}
+
+
+int reserve_memory(size_t size)
+{
+    MemChunk *chunk = (MemChunk *) malloc(sizeof(MemChunk) + size);
+
+    if (NULL == chunk) {
+	return 1;
+    }
+
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->live = 0;
+
+    chunk->next = chunks;
+    chunks = chunk;
+
+    return 0;
+}
+
+
 void * allocate_memory(size_t size)
 {
     if (count_allocs) {
 	++num_allocs;
     }
 
+    if (NULL != chunks) {
+	size_t rounded = reserved_size(size);
+
+	if (chunks->size - chunks->used >= rounded) {
+	    void *ptr = (char *) (chunks + 1) + chunks->used;
+
+	    chunks->used += rounded;
+	    ++chunks->live;
+
+	    return ptr;
+	}
+    }
+
     return malloc(size);
 }
 
@@ -50,6 +129,27 @@ void free_memory(void *ptr)
 	++num_frees;
     }
 
+    if (NULL != chunks) {
+	MemChunk *previous = NULL;
+	MemChunk *chunk = find_chunk(ptr, &previous);
+
+	if (NULL != chunk) {
+	    if (0 == --chunk->live) {
+		/* Last piece is gone, release the whole chunk */
+		if (NULL != previous) {
+		    previous->next = chunk->next;
+		}
+		else {
+		    chunks = chunk->next;
+		}
+
+		free(chunk);
+	    }
+
+	    return;
+	}
+    }
+
     free(ptr);
 }
 
@@ -50,6 +50,39 @@ void * allocate_memory(size_t size);
 void free_memory(void *ptr);
 
 
+/*
+  Arguments:
+      size: Total number of bytes we expect to allocate shortly.
+
+  Reserves one chunk of memory that subsequent allocate_memory() calls
+  carve pieces out of, instead of calling malloc() for each one. This
+  is useful when building a lot of nodes at once since it replaces
+  many small allocations with a single one. Once the chunk is used up
+  allocate_memory() goes back to calling malloc().
+
+  Pieces of the chunk are released with free_memory() as usual, and
+  the chunk itself is freed once every piece of it has been
+  released. Returns 0 on success and non-zero if the chunk could not
+  be allocated.
+
+ */
+
+int reserve_memory(size_t size);
+
+
+/*
+  Arguments:
+      size: Size of an allocation.
+
+  Returns the number of bytes that an allocation of this size takes
+  up in a chunk from reserve_memory(), including padding. Summing this
+  over everything we plan to allocate gives the size to reserve.
+
+ */
+
+size_t reserved_size(size_t size);
+
+
 /*
   Functions for retrieving memory usage statistics. These are only
   useful if the count_allocs boolean in mem_alloc.cpp is set to true,
@@ -0,0 +1,442 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_analog.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_config.h"
+
+#include "mux_platform.h"
+
+#if defined(ARDUINO) && defined(__AVR__) && MUX_ANALOG_ISR
+#include <avr/interrupt.h>
+#define INTERRUPT_ADC 1
+#else
+#define INTERRUPT_ADC 0
+#endif
+
+
+/* List of analog outputs, separate from the digital ones */
+static MuxOutputList analog_outs = {NULL, NULL};
+
+/*
+  The analog inputs that the ADC cycles through, with the latest value
+  and the number of conversions for each. The values and counts are
+  written by the ADC interrupt.
+ */
+static int analog_pins[MUX_MAX_ANALOG_INPUTS];
+static volatile unsigned int analog_values[MUX_MAX_ANALOG_INPUTS];
+static volatile unsigned long analog_counts[MUX_MAX_ANALOG_INPUTS];
+static volatile unsigned char num_analog_inputs = 0;
+
+/* Number of analog pipes registered */
+static int num_analog_pipes = 0;
+
+/* Index of the input that the ADC is converting */
+static volatile unsigned char converting = 0;
+
+/* When we started counting conversions, in milliseconds */
+static unsigned long stats_start = 0;
+
+
+/* Index of the pin in analog_pins, or -1 if it is not there */
+static int find_analog_input(int pin)
+{
+    for (int i = 0; i < num_analog_inputs; ++i) {
+	if (pin == analog_pins[i]) {
+	    return i;
+	}
+    }
+
+    return -1;
+}
+
+
+#if INTERRUPT_ADC
+
+/* True while a conversion is in progress */
+static volatile bool adc_running = false;
+
+/* True if the conversion in progress was for an input that went away */
+static volatile bool discard_result = false;
+
+
+static void start_conversion(int pin)
+{
+    unsigned char channel = (pin >= A0) ? pin - A0 : pin;
+
+#if defined(ADCSRB) && defined(MUX5)
+    ADCSRB = (ADCSRB & ~(1 << MUX5)) | (((channel >> 3) & 0x01) << MUX5);
+#endif
+
+    ADMUX = (DEFAULT << 6) | (channel & 0x07);
+    ADCSRA |= (1 << ADIE) | (1 << ADSC);
+
+    adc_running = true;
+}
+
+
+ISR(ADC_vect)
+{
+    unsigned int value = ADC;
+    unsigned char finished = converting;
+
+    if (0 == num_analog_inputs) {
+	adc_running = false;
+	return;
+    }
+
+    if (discard_result) {
+	/* converting was already reset for the new inputs */
+	discard_result = false;
+	start_conversion(analog_pins[converting]);
+	return;
+    }
+
+    /* Get the next conversion going before dealing with this one */
+    if (++converting >= num_analog_inputs) {
+	converting = 0;
+    }
+
+    start_conversion(analog_pins[converting]);
+
+    analog_values[finished] = value;
+    ++analog_counts[finished];
+}
+
+#else
+
+/* Without the interrupt we do a single conversion per update */
+static void poll_conversion()
+{
+    if (0 == num_analog_inputs) {
+	return;
+    }
+
+    if (converting >= num_analog_inputs) {
+	converting = 0;
+    }
+
+    analog_values[converting] = analogRead(analog_pins[converting]);
+    ++analog_counts[converting];
+
+    if (++converting >= num_analog_inputs) {
+	converting = 0;
+    }
+}
+
+#endif
+
+
+/*
+  Works out the set of analog inputs from the analog outputs. Inputs
+  which were already there keep their values and counts. Returns the
+  number of inputs that there would be with extra_pin added, without
+  changing anything if that is more than MUX_MAX_ANALOG_INPUTS. Pass
+  -1 as extra_pin to just rebuild the inputs.
+ */
+static int rebuild_inputs(int extra_pin)
+{
+    int pins[MUX_MAX_ANALOG_INPUTS];
+    unsigned int values[MUX_MAX_ANALOG_INPUTS];
+    unsigned long counts[MUX_MAX_ANALOG_INPUTS];
+    int num_pins = 0;
+    int num_pipes = 0;
+
+    MuxOutputNode *out_node = analog_outs.head;
+    while (out_node) {
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		int pin = in_node->in_pin;
+		bool seen = false;
+
+		++num_pipes;
+
+		for (int i = 0; i < num_pins && !seen; ++i) {
+		    seen = (pin == pins[i]);
+		}
+
+		if (!seen) {
+		    if (num_pins == MUX_MAX_ANALOG_INPUTS) {
+			return num_pins + 1;
+		    }
+
+		    int old = find_analog_input(pin);
+
+		    pins[num_pins] = pin;
+		    values[num_pins] = 0;
+		    counts[num_pins] = 0;
+
+		    if (old >= 0) {
+			/* More than a byte each, so the ADC interrupt could tear them */
+			noInterrupts();
+			values[num_pins] = analog_values[old];
+			counts[num_pins] = analog_counts[old];
+			interrupts();
+		    }
+
+		    ++num_pins;
+		}
+
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+
+    if (extra_pin >= 0) {
+	bool seen = false;
+
+	for (int i = 0; i < num_pins && !seen; ++i) {
+	    seen = (extra_pin == pins[i]);
+	}
+
+	return seen ? num_pins : num_pins + 1;
+    }
+
+    noInterrupts();
+
+    for (int i = 0; i < num_pins; ++i) {
+	analog_pins[i] = pins[i];
+	analog_values[i] = values[i];
+	analog_counts[i] = counts[i];
+    }
+
+    num_analog_inputs = num_pins;
+    converting = 0;
+    num_analog_pipes = num_pipes;
+
+#if INTERRUPT_ADC
+    if (adc_running) {
+	discard_result = true;
+    }
+    else if (0 != num_pins) {
+	start_conversion(analog_pins[0]);
+    }
+#endif
+
+    interrupts();
+
+    return num_pins;
+}
+
+
+int register_analog_pipe(MuxPipe pipe)
+{
+    if (pipe.in_pin == pipe.out_pin) {
+	return 1;
+    }
+
+    if (rebuild_inputs(pipe.in_pin) > MUX_MAX_ANALOG_INPUTS) {
+	return 4;
+    }
+
+    mux_output_list_add(&analog_outs, pipe);
+    rebuild_inputs(-1);
+
+    pinMode(pipe.out_pin, OUTPUT);
+
+    return 0;
+}
+
+
+void unregister_analog_pipe(MuxPipe pipe)
+{
+    mux_output_list_remove(&analog_outs, pipe);
+    rebuild_inputs(-1);
+}
+
+
+void set_analog_output_channel(int out_pin, int new_channel)
+{
+    MuxOutputNode *node = find_output_node(&analog_outs, out_pin);
+
+    if (NULL == node) {
+	return;
+    }
+
+    node->channel_num = new_channel;
+    node->current_channel = find_channel_node(&node->channels, new_channel);
+}
+
+
+int set_analog_channel_combine(int out_pin, int channel, MuxAnalogCombine combine)
+{
+    MuxOutputNode *out_node = find_output_node(&analog_outs, out_pin);
+
+    if (NULL == out_node) {
+	return 1;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, channel);
+
+    if (NULL == channel_node) {
+	return 1;
+    }
+
+    channel_node->combine = combine;
+    return 0;
+}
+
+
+void mux_analog_clear()
+{
+    mux_output_list_clear(&analog_outs);
+    rebuild_inputs(-1);
+}
+
+
+int mux_analog_num_pipes()
+{
+    return num_analog_pipes;
+}
+
+
+/* Latest value of the input, 0 if it has not been converted yet */
+static unsigned int input_value(int in_pin)
+{
+    int index = find_analog_input(in_pin);
+
+    if (index < 0) {
+	return 0;
+    }
+
+    /* Two bytes on AVR, so the ADC interrupt could land between them */
+    noInterrupts();
+    unsigned int value = analog_values[index];
+    interrupts();
+
+    return value;
+}
+
+
+static unsigned int combine_inputs(MuxChannelNode *channel_node)
+{
+    MuxInputNode *in_node = channel_node->inputs.head;
+    unsigned int result = 0;
+
+    while (in_node) {
+	unsigned int value = input_value(in_node->in_pin);
+
+	switch (channel_node->combine) {
+	case MUX_ANALOG_MAX:
+	    if (value > result) {
+		result = value;
+	    }
+	    break;
+
+	case MUX_ANALOG_SUM:
+	    result += value;
+
+	    if (result >= MUX_ANALOG_MAX_VALUE) {
+		return MUX_ANALOG_MAX_VALUE;
+	    }
+	    break;
+
+	case MUX_ANALOG_FIRST_NONZERO:
+	    if (0 != value) {
+		return value;
+	    }
+	    break;
+	}
+
+	in_node = in_node->next;
+    }
+
+    return result;
+}
+
+
+void mux_analog_update()
+{
+#if !INTERRUPT_ADC
+    poll_conversion();
+#endif
+
+    MuxOutputNode *out_node = analog_outs.head;
+    while (out_node) {
+	if (out_node->current_channel) {
+	    /* ADC values are 10 bit, PWM is 8 bit */
+	    int level = combine_inputs(out_node->current_channel) >> 2;
+
+	    if (level != out_node->level) {
+		analogWrite(out_node->out_pin, level);
+		out_node->level = level;
+	    }
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+unsigned long mux_analog_sample_rate(int in_pin)
+{
+    int index = find_analog_input(in_pin);
+    unsigned long elapsed = millis() - stats_start;
+
+    if (index < 0 || 0 == elapsed) {
+	return 0;
+    }
+
+    noInterrupts();
+    unsigned long count = analog_counts[index];
+    interrupts();
+
+    /*
+      Kept to 32 bits, since 64 bit division pulls a big routine into
+      AVR builds. Whatever is left over after whole samples per
+      millisecond is scaled down until multiplying it by 1000 fits.
+     */
+    unsigned long whole = count / elapsed;
+    unsigned long rest = count % elapsed;
+
+    while (rest > 0xFFFFFFFFUL / 1000) {
+	rest >>= 1;
+	elapsed >>= 1;
+    }
+
+    return whole * 1000 + rest * 1000 / elapsed;
+}
+
+
+void mux_analog_reset_stats()
+{
+    noInterrupts();
+
+    for (int i = 0; i < num_analog_inputs; ++i) {
+	analog_counts[i] = 0;
+    }
+
+    interrupts();
+
+    stats_start = millis();
+}
@@ -0,0 +1,179 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_ANALOG_H
+#define MUX_ANALOG_H
+
+/*
+  Analog pipes. These work just like the regular digital pipes, except
+  that the input pins are read with the ADC and the outputs are
+  written with analogWrite(), so the output pins need to be PWM
+  capable. Analog pipes have their own set of outputs and channels,
+  separate from the digital ones.
+
+  Instead of always OR'ing the inputs together, each channel of an
+  analog output has a combine function which is applied to the
+  values of its inputs (see MuxAnalogCombine).
+
+  With MUX_ANALOG_ISR set to 1 in mux_config.h, the ADC on AVR boards
+  runs on its own, interrupt driven. Whenever a conversion finishes
+  the interrupt grabs the result and immediately starts converting
+  the next analog input, so the ADC is always busy and
+  mux_analog_update() only ever looks at the latest results. It never
+  waits on the ADC. Otherwise (and always on the host build) one
+  conversion is done per call to mux_analog_update().
+ */
+
+#include "mux_pipe.h"
+
+/* Most distinct analog input pins */
+#define MUX_MAX_ANALOG_INPUTS 16
+
+/* Largest value that comes out of the ADC */
+#define MUX_ANALOG_MAX_VALUE 1023
+
+
+/*
+  Ways of combining the inputs on an analog channel.
+
+      MUX_ANALOG_MAX: The largest input value.
+
+      MUX_ANALOG_SUM: The sum of the input values, limited to
+		      MUX_ANALOG_MAX_VALUE.
+
+      MUX_ANALOG_FIRST_NONZERO: The value of the first input, in the
+				order they were registered, which is
+				not 0.
+ */
+
+typedef enum MuxAnalogCombine {
+    MUX_ANALOG_MAX = 0,
+    MUX_ANALOG_SUM = 1,
+    MUX_ANALOG_FIRST_NONZERO = 2
+} MuxAnalogCombine;
+
+
+/*
+  Arguments:
+      pipe: The analog pipe we want to register. The in_pin is an
+	    analog pin (A0, A1...), and the out_pin must be capable of
+	    PWM.
+
+  Registers an analog pipe. New channels use MUX_ANALOG_MAX. Returns 0
+  on success, 1 if the input and output are the same, or 4 if there
+  are already MUX_MAX_ANALOG_INPUTS different analog inputs.
+
+ */
+
+int register_analog_pipe(MuxPipe pipe);
+
+
+/*
+  Arguments:
+      pipe: The analog pipe we want to remove.
+
+  Removes an analog pipe (does nothing if the pipe does not exist).
+
+ */
+
+void unregister_analog_pipe(MuxPipe pipe);
+
+
+/*
+  Arguments:
+      out_pin: The analog output that we want to change the channel of.
+
+      new_channel: The new channel that we want to set.
+
+  Same as set_output_channel(), but for analog outputs.
+
+ */
+
+void set_analog_output_channel(int out_pin, int new_channel);
+
+
+/*
+  Arguments:
+      out_pin: The analog output.
+
+      channel: The channel on the output.
+
+      combine: The combine function for the channel.
+
+  Sets the combine function for a channel of an analog output. Returns
+  0 on success, or 1 if the output does not have that channel.
+
+ */
+
+int set_analog_channel_combine(int out_pin, int channel, MuxAnalogCombine combine);
+
+
+/*
+  Removes every analog pipe. This is also done by mux_clear().
+
+ */
+
+void mux_analog_clear();
+
+
+/*
+  Returns the number of analog pipes registered.
+
+ */
+
+int mux_analog_num_pipes();
+
+
+/*
+  Works out the value of every analog output from the latest ADC
+  results, and writes any output whose value changed. This is called
+  by mux_update(), so it normally does not need to be called directly.
+
+ */
+
+void mux_analog_update();
+
+
+/*
+  Arguments:
+      in_pin: The analog input pin.
+
+  Returns the number of conversions per second done on the input
+  since the last call to mux_analog_reset_stats(), or 0 if the pin is
+  not an analog input of any pipe.
+
+ */
+
+unsigned long mux_analog_sample_rate(int in_pin);
+
+
+/*
+  Starts counting conversions for mux_analog_sample_rate() from zero.
+
+ */
+
+void mux_analog_reset_stats();
+
+#endif
@@ -0,0 +1,204 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+#include "mux_apply.h"
+#include "muxduino.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_sample.h"
+#include "mux_cascade.h"
+#include "mux_pins.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+
+#include "mux_platform.h"
+
+
+/* True if one of the pipes has the pin as its output */
+static bool is_output(const MuxPipe *pipes, int num_pipes, int pin)
+{
+    for (int i = 0; i < num_pipes; ++i) {
+	if (pin == pipes[i].out_pin) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+
+/* Number of different input pins in the pipes */
+static int count_inputs(const MuxPipe *pipes, int num_pipes)
+{
+    int count = 0;
+
+    for (int i = 0; i < num_pipes; ++i) {
+	int j = 0;
+
+	while (j < i && pipes[j].in_pin != pipes[i].in_pin) {
+	    ++j;
+	}
+
+	if (j == i) {
+	    ++count;
+	}
+    }
+
+    return count;
+}
+
+
+/*
+  Works out how many outputs deep each pipe's input is, going around
+  again until nothing changes. Without a loop no pipe can be more than
+  num_pipes deep, so a depth past that means there is one. Returns 0
+  if there is no loop, 5 if there is, and 6 if out of memory.
+ */
+static int check_loops(const MuxPipe *pipes, int num_pipes)
+{
+    int *depths = (int *) allocate_memory(num_pipes * sizeof(int));
+
+    if (NULL == depths) {
+	return 6;
+    }
+
+    for (int i = 0; i < num_pipes; ++i) {
+	depths[i] = 0;
+    }
+
+    int result = 0;
+    bool changed = true;
+
+    while (changed && 0 == result) {
+	changed = false;
+
+	for (int i = 0; i < num_pipes && 0 == result; ++i) {
+	    for (int j = 0; j < num_pipes; ++j) {
+		if (pipes[j].out_pin == pipes[i].in_pin && depths[j] >= depths[i]) {
+		    depths[i] = depths[j] + 1;
+		    changed = true;
+
+		    if (depths[i] > num_pipes) {
+			result = 5;
+			break;
+		    }
+		}
+	    }
+	}
+    }
+
+    free_memory(depths);
+    return result;
+}
+
+
+static int check_pipes(const MuxPipe *pipes, int num_pipes)
+{
+    for (int i = 0; i < num_pipes; ++i) {
+	if (pipes[i].in_pin == pipes[i].out_pin) {
+	    return 1;
+	}
+
+	if (!mux_cascade_enabled() && is_output(pipes, num_pipes, pipes[i].in_pin)) {
+	    return 2;
+	}
+    }
+
+    if (count_inputs(pipes, num_pipes) > MUX_MAX_INPUTS) {
+	return 4;
+    }
+
+    return (mux_cascade_enabled() && num_pipes > 0) ? check_loops(pipes, num_pipes) : 0;
+}
+
+
+/* Find the input node of a registered pipe, NULL if it isn't registered */
+static MuxInputNode * find_pipe(MuxPipe pipe)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, pipe.out_pin);
+
+    if (NULL == out_node) {
+	return NULL;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, pipe.channel);
+
+    if (NULL == channel_node) {
+	return NULL;
+    }
+
+    return find_input_node(&channel_node->inputs, pipe.in_pin);
+}
+
+
+int mux_apply_topology(const MuxPipe *pipes, int num_pipes,
+		       const MuxChannelSelect *channel_map, int map_length)
+{
+    int result = check_pipes(pipes, num_pipes);
+
+    if (0 != result) {
+	return result;
+    }
+
+    /* Mark the pipes to keep, and sweep away the rest */
+    for (int i = 0; i < num_pipes; ++i) {
+	MuxInputNode *in_node = find_pipe(pipes[i]);
+
+	if (in_node) {
+	    in_node->marked = true;
+
+	    /* A cascaded input whose output is going away is a plain pin again */
+	    if (find_output_node(&mux_outs, pipes[i].in_pin)
+		&& !is_output(pipes, num_pipes, pipes[i].in_pin)) {
+		mux_pin_mode(pipes[i].in_pin, INPUT);
+	    }
+	}
+    }
+
+    mux_output_list_sweep(&mux_outs);
+
+    /* Anything still missing is new */
+    for (int i = 0; i < num_pipes; ++i) {
+	if (find_pipe(pipes[i])) {
+	    continue;
+	}
+
+	mux_output_list_add(&mux_outs, pipes[i]);
+
+	if (!is_output(pipes, num_pipes, pipes[i].in_pin)) {
+	    mux_pin_mode(pipes[i].in_pin, INPUT);
+	}
+
+	mux_pin_mode(pipes[i].out_pin, OUTPUT);
+    }
+
+    for (int i = 0; i < map_length; ++i) {
+	set_output_channel(channel_map[i].out_pin, channel_map[i].channel);
+    }
+
+    mux_topology_changed();
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_APPLY_H
+#define MUX_APPLY_H
+
+#include "mux_pipe.h"
+
+/*
+  Switching the whole topology over to a new set of pipes. Rather
+  than unregistering everything and registering the new pipes one at
+  a time, mux_apply_topology() works out which pipes have to be added
+  and removed and which channels have to change, and only does that.
+  Pipes which are in both the old and the new set are never touched,
+  so they keep passing their signal the whole time, along with their
+  transforms, filters and counters.
+ */
+
+
+/*
+  Which channel an output should be switched to.
+ */
+
+typedef struct MuxChannelSelect {
+    int out_pin;
+    int channel;
+} MuxChannelSelect;
+
+
+/*
+  Arguments:
+      pipes: Every pipe that should be registered afterwards.
+
+      num_pipes: Number of pipes.
+
+      channel_map: Channels to select, or NULL to leave every output's
+		   channel alone. Outputs which aren't in the new set
+		   are skipped.
+
+      map_length: Number of entries in channel_map.
+
+  Makes the registered pipes exactly the given ones, in a single
+  batch. A new output starts on the channel of its first pipe unless
+  the channel map says otherwise. Analog pipes aren't affected.
+
+  The new set is checked before anything is changed, so on failure
+  the topology is left as it was. Returns 0 on success, 1 if a pipe's
+  input and output are the same pin, 2 if a pin is used as both an
+  input and an output while cascading is off, 4 if there are more
+  than MUX_MAX_INPUTS different input pins, 5 if cascading is on and
+  the pipes make a loop, and 6 if there isn't enough memory to check
+  for loops. These match the errors from register_pipe().
+
+ */
+
+int mux_apply_topology(const MuxPipe *pipes, int num_pipes,
+		       const MuxChannelSelect *channel_map, int map_length);
+
+#endif
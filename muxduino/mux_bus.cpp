@@ -0,0 +1,275 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+#include "mux_bus.h"
+
+#ifndef ARDUINO
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+  The sequence counters are a seqlock. A writer makes its counter odd,
+  writes, then makes it even again. A reader copies the words between
+  two reads of the counter, and the copy is good if the counter was
+  even and didn't move. Every access to shared words is atomic, so
+  the compiler can't tear or reorder them.
+ */
+
+
+static void write_begin(uint32_t *seq)
+{
+    uint32_t count = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(seq, count + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void write_end(uint32_t *seq)
+{
+    uint32_t count = __atomic_load_n(seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(seq, count + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+  Copies MUX_BUS_WORDS words guarded by seq, and the extra word if
+  there is one. Gives up after tries attempts, or never if tries is 0.
+ */
+static bool read_words(const uint32_t *seq, const uint32_t *from, uint32_t *to,
+		       const uint32_t *extra_from, uint32_t *extra_to, int tries)
+{
+    uint32_t copy[MUX_BUS_WORDS];
+    uint32_t extra = 0;
+
+    for (int attempt = 0; 0 == tries || attempt < tries; ++attempt) {
+	uint32_t before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+
+	if (before & 1) {
+	    continue;
+	}
+
+	for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	    copy[w] = __atomic_load_n(&from[w], __ATOMIC_RELAXED);
+	}
+
+	if (extra_from) {
+	    extra = __atomic_load_n(extra_from, __ATOMIC_RELAXED);
+	}
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if (__atomic_load_n(seq, __ATOMIC_RELAXED) == before) {
+	    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+		to[w] = copy[w];
+	    }
+
+	    if (extra_to) {
+		*extra_to = extra;
+	    }
+
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+
+/* Maps the region behind an open shared memory object */
+static MuxBus * map_bus(int fd)
+{
+    void *region = mmap(NULL, sizeof(MuxBus), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+    return (MAP_FAILED == region) ? NULL : (MuxBus *) region;
+}
+
+
+MuxBus * mux_bus_create(const char *name, const uint32_t *levels)
+{
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+
+    if (fd < 0) {
+	return NULL;
+    }
+
+    if (0 != ftruncate(fd, sizeof(MuxBus))) {
+	close(fd);
+	return NULL;
+    }
+
+    MuxBus *bus = map_bus(fd);
+
+    if (NULL == bus) {
+	return NULL;
+    }
+
+    /* Clients check the magic number last, so it goes in last */
+    __atomic_store_n(&bus->magic, 0, __ATOMIC_RELAXED);
+
+    bus->version = MUX_BUS_VERSION;
+    bus->pins = MUX_BUS_PINS;
+    bus->input_seq = 0;
+    bus->level_seq = 0;
+    bus->updates = 0;
+
+    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	bus->inputs[w] = levels[w];
+	bus->levels[w] = levels[w];
+    }
+
+    __atomic_store_n(&bus->magic, MUX_BUS_MAGIC, __ATOMIC_RELEASE);
+    return bus;
+}
+
+
+MuxBus * mux_bus_open(const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+
+    if (fd < 0) {
+	return NULL;
+    }
+
+    struct stat info;
+
+    if (0 != fstat(fd, &info) || info.st_size < (off_t) sizeof(MuxBus)) {
+	close(fd);
+	return NULL;
+    }
+
+    MuxBus *bus = map_bus(fd);
+
+    if (NULL == bus) {
+	return NULL;
+    }
+
+    if (MUX_BUS_MAGIC != __atomic_load_n(&bus->magic, __ATOMIC_ACQUIRE)
+	|| MUX_BUS_VERSION != bus->version || MUX_BUS_PINS != bus->pins) {
+	mux_bus_close(bus);
+	return NULL;
+    }
+
+    return bus;
+}
+
+
+void mux_bus_close(MuxBus *bus)
+{
+    munmap(bus, sizeof(MuxBus));
+}
+
+
+void mux_bus_remove(const char *name)
+{
+    shm_unlink(name);
+}
+
+
+void mux_bus_begin_inputs(MuxBus *bus)
+{
+    write_begin(&bus->input_seq);
+}
+
+
+void mux_bus_put_input(MuxBus *bus, int pin, int level)
+{
+    if (pin < 0 || pin >= MUX_BUS_PINS) {
+	return;
+    }
+
+    uint32_t *word = &bus->inputs[pin / 32];
+    uint32_t bit = (uint32_t) 1 << (pin % 32);
+    uint32_t value = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    __atomic_store_n(word, level ? (value | bit) : (value & ~bit), __ATOMIC_RELAXED);
+}
+
+
+void mux_bus_end_inputs(MuxBus *bus)
+{
+    write_end(&bus->input_seq);
+}
+
+
+void mux_bus_set_input(MuxBus *bus, int pin, int level)
+{
+    mux_bus_begin_inputs(bus);
+    mux_bus_put_input(bus, pin, level);
+    mux_bus_end_inputs(bus);
+}
+
+
+int mux_bus_get_level(MuxBus *bus, int pin)
+{
+    if (pin < 0 || pin >= MUX_BUS_PINS) {
+	return 0;
+    }
+
+    /* A single word can't be torn, so there's no need for the counter */
+    return (__atomic_load_n(&bus->levels[pin / 32], __ATOMIC_ACQUIRE) >> (pin % 32)) & 1;
+}
+
+
+uint32_t mux_bus_snapshot(MuxBus *bus, uint32_t *levels)
+{
+    uint32_t updates = 0;
+
+    read_words(&bus->level_seq, bus->levels, levels, &bus->updates, &updates, 0);
+    return updates;
+}
+
+
+uint32_t mux_bus_updates(MuxBus *bus)
+{
+    return __atomic_load_n(&bus->updates, __ATOMIC_ACQUIRE);
+}
+
+
+bool mux_bus_read_inputs(MuxBus *bus, uint32_t *inputs, int tries)
+{
+    return read_words(&bus->input_seq, bus->inputs, inputs, NULL, NULL, tries);
+}
+
+
+void mux_bus_publish(MuxBus *bus, const uint32_t *levels)
+{
+    write_begin(&bus->level_seq);
+
+    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	__atomic_store_n(&bus->levels[w], levels[w], __ATOMIC_RELAXED);
+    }
+
+    uint32_t updates = __atomic_load_n(&bus->updates, __ATOMIC_RELAXED);
+    __atomic_store_n(&bus->updates, updates + 1, __ATOMIC_RELAXED);
+
+    write_end(&bus->level_seq);
+}
+
+#endif
@@ -0,0 +1,279 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_BUS_H
+#define MUX_BUS_H
+
+/*
+  Shared memory pin bus for the host build. The host backend can put
+  its pins in a POSIX shared memory region (see mux_host_attach_bus()
+  in mux_host.h), so that other processes such as test rigs can drive
+  the inputs and watch the outputs by reading and writing memory,
+  without a system call or a copy for every cycle.
+
+  The region holds two bit-packed arrays of pin levels, with pin n in
+  bit n % 32 of word n / 32:
+
+      inputs: Written by one client, read by the router at the start
+	      of every update. Only pins in INPUT or INPUT_PULLUP mode
+	      take their level from here.
+
+      levels: Every pin's level, written by the router at the end of
+	      every update.
+
+  Each array has a sequence counter which is odd while it is being
+  written, so a reader can tell whether its copy is consistent and try
+  again if it isn't. The router never waits on a client: if the
+  inputs are still being written after a few tries it keeps the
+  inputs from the last update.
+
+  This file only depends on POSIX, so a client can be built from
+  mux_bus.h and mux_bus.cpp alone. Nothing here is built on an
+  Arduino.
+ */
+
+#ifndef ARDUINO
+
+#include <stdint.h>
+
+/* "MXBS" */
+#define MUX_BUS_MAGIC 0x5342584DUL
+#define MUX_BUS_VERSION 1
+
+/* Pins on the bus, the same as MUX_HOST_PINS */
+#define MUX_BUS_PINS 256
+#define MUX_BUS_WORDS (MUX_BUS_PINS / 32)
+
+/* Keeps the parts written by different processes on separate cache lines */
+#define MUX_BUS_LINE __attribute__((aligned(64)))
+
+
+/*
+  Layout of the shared region. The sequence counters and arrays
+  should only be touched through the functions below.
+
+  Fields:
+      magic, version: MUX_BUS_MAGIC and MUX_BUS_VERSION, checked by
+		      mux_bus_open().
+
+      pins: Number of pins on the bus.
+
+      input_seq, inputs: Input levels from the client.
+
+      level_seq, levels, updates: Pin levels from the router, and the
+				  number of updates that have published
+				  them.
+ */
+
+typedef struct MuxBus {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pins;
+
+    MUX_BUS_LINE uint32_t input_seq;
+    uint32_t inputs[MUX_BUS_WORDS];
+
+    MUX_BUS_LINE uint32_t level_seq;
+    uint32_t levels[MUX_BUS_WORDS];
+    uint32_t updates;
+} MuxBus;
+
+
+/*
+  Arguments:
+      name: Name of the shared memory object, starting with a '/'.
+
+      levels: Levels to start every pin at, in the bus layout.
+
+  Creates (or takes over) the region and sets it up. Used by the
+  router. Returns NULL if it can't be created.
+
+ */
+
+MuxBus * mux_bus_create(const char *name, const uint32_t *levels);
+
+
+/*
+  Arguments:
+      name: Name given to mux_bus_create().
+
+  Maps a region made by the router. Returns NULL if there is no such
+  region, or if it isn't a bus of this version.
+
+ */
+
+MuxBus * mux_bus_open(const char *name);
+
+
+/*
+  Arguments:
+      bus: Bus from mux_bus_create() or mux_bus_open().
+
+  Unmaps the region. The region itself stays around until
+  mux_bus_remove() is called.
+
+ */
+
+void mux_bus_close(MuxBus *bus);
+
+
+/*
+  Arguments:
+      name: Name given to mux_bus_create().
+
+  Removes the region's name, so that no new client can open it.
+
+ */
+
+void mux_bus_remove(const char *name);
+
+
+/*
+  Arguments:
+      bus: The bus to write to.
+
+  Starts a batch of mux_bus_put_input() calls. The router sees either
+  none of the batch or all of it. Only one process should write the
+  inputs of a bus.
+
+ */
+
+void mux_bus_begin_inputs(MuxBus *bus);
+
+
+/*
+  Arguments:
+      bus: The bus to write to.
+
+      pin: The pin to drive.
+
+      level: 0 for LOW, anything else for HIGH.
+
+  Sets an input inside of a batch.
+
+ */
+
+void mux_bus_put_input(MuxBus *bus, int pin, int level);
+
+
+/*
+  Arguments:
+      bus: The bus to write to.
+
+  Ends a batch, letting the router see it.
+
+ */
+
+void mux_bus_end_inputs(MuxBus *bus);
+
+
+/*
+  Arguments:
+      bus: The bus to write to.
+
+      pin: The pin to drive.
+
+      level: 0 for LOW, anything else for HIGH.
+
+  Sets a single input, as a batch of its own.
+
+ */
+
+void mux_bus_set_input(MuxBus *bus, int pin, int level);
+
+
+/*
+  Arguments:
+      bus: The bus to read from.
+
+      pin: The pin to look at.
+
+  Returns the level of the pin after the last update, 1 for HIGH and
+  0 for LOW.
+
+ */
+
+int mux_bus_get_level(MuxBus *bus, int pin);
+
+
+/*
+  Arguments:
+      bus: The bus to read from.
+
+      levels: Where to copy the MUX_BUS_WORDS words of levels.
+
+  Copies every pin's level from a single update. Returns the number
+  of that update, which can be compared with an earlier one to see
+  whether the router has run since.
+
+ */
+
+uint32_t mux_bus_snapshot(MuxBus *bus, uint32_t *levels);
+
+
+/*
+  Arguments:
+      bus: The bus to read from.
+
+  Returns the number of updates that have published their levels.
+
+ */
+
+uint32_t mux_bus_updates(MuxBus *bus);
+
+
+/*
+  Arguments:
+      bus: The bus to read from.
+
+      inputs: Where to copy the MUX_BUS_WORDS words of inputs.
+
+      tries: Most times to try for a consistent copy.
+
+  Used by the router at the start of an update. Returns false,
+  leaving inputs as they were, if the client was in the middle of a
+  batch every time.
+
+ */
+
+bool mux_bus_read_inputs(MuxBus *bus, uint32_t *inputs, int tries);
+
+
+/*
+  Arguments:
+      bus: The bus to write to.
+
+      levels: Every pin's level after an update.
+
+  Used by the router at the end of an update.
+
+ */
+
+void mux_bus_publish(MuxBus *bus, const uint32_t *levels);
+
+#endif
+
+#endif
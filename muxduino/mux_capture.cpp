@@ -0,0 +1,432 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_capture.h"
+#include "mux_output.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+
+#include "mux_platform.h"
+
+#ifndef ARDUINO
+#include <stdio.h>
+#endif
+
+
+/* Write a mark at least this often, so deltas always fit in a long */
+#define IDLE_LIMIT 0x40000000UL
+
+
+static MuxCaptureState state = MUX_CAPTURE_OFF;
+static MuxCaptureTrigger trigger;
+
+/*
+  The records live in a ring. The tail is the start of the oldest
+  record, and the head is where the next one goes.
+ */
+static unsigned char *ring = NULL;
+static unsigned int ring_size = 0;
+static unsigned int head = 0;
+static unsigned int tail = 0;
+static unsigned int used = 0;
+
+/* Time that the oldest record's delta counts from */
+static unsigned long base_time = 0;
+
+/* Time of the newest record */
+static unsigned long last_time = 0;
+
+/* Time of whatever is being recorded now */
+static unsigned long now = 0;
+
+static unsigned long trigger_time = 0;
+
+/* Input levels as of the last update, to find the ones that changed */
+static MuxWord last_levels[MUX_SAMPLE_WORDS];
+
+
+static unsigned int put_varint(unsigned char *record, unsigned int len, unsigned long value)
+{
+    while (value >= 0x80) {
+	record[len++] = (value & 0x7F) | 0x80;
+	value >>= 7;
+    }
+
+    record[len++] = value;
+    return len;
+}
+
+
+/* Read a varint out of the ring, moving the position past it */
+static unsigned long ring_varint(unsigned int *position)
+{
+    unsigned long value = 0;
+    unsigned char shift = 0;
+    unsigned char byte;
+
+    do {
+	byte = ring[*position];
+	*position = (*position + 1 == ring_size) ? 0 : *position + 1;
+
+	value |= (unsigned long) (byte & 0x7F) << shift;
+	shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+
+/* Delta of the oldest record */
+static unsigned long tail_delta()
+{
+    unsigned int position = (tail + 1 == ring_size) ? 0 : tail + 1;
+
+    return ring_varint(&position);
+}
+
+
+/* Throw away the oldest record */
+static void drop_oldest()
+{
+    unsigned char kind = ring[tail] >> 1;
+    unsigned int position = (tail + 1 == ring_size) ? 0 : tail + 1;
+
+    base_time += ring_varint(&position);
+
+    if (MUX_CAPTURE_MARK != kind) {
+	ring_varint(&position);
+    }
+
+    if (MUX_CAPTURE_CHANNEL == kind) {
+	ring_varint(&position);
+    }
+
+    used -= (position + ring_size - tail) % ring_size;
+    tail = position;
+}
+
+
+static void add_record(unsigned char kind, int level, int pin, int channel);
+
+
+/* Record everything's current level, so the capture starts from a known state */
+static void record_levels()
+{
+    MuxWord external[MUX_SAMPLE_WORDS];
+    mux_sample_external(external);
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord slots = external[w];
+
+	while (slots) {
+	    int bit = __builtin_ctzl(slots);
+	    int slot = w * MUX_WORD_BITS + bit;
+
+	    add_record(MUX_CAPTURE_INPUT, MUX_BIT(mux_levels, slot) ? HIGH : LOW,
+		       mux_sample_pin(slot), 0);
+
+	    slots &= slots - 1;
+	}
+    }
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	add_record(MUX_CAPTURE_CHANNEL, LOW, out_node->out_pin, out_node->channel_num);
+
+	if (out_node->level >= 0) {
+	    add_record(MUX_CAPTURE_OUTPUT, out_node->level, out_node->out_pin, 0);
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+static void fire_trigger()
+{
+    state = MUX_CAPTURE_TRIGGERED;
+    trigger_time = now;
+
+    /* Only keep the pre-trigger window, and leave at least half the buffer for after */
+    while (used && (now - (base_time + tail_delta()) > trigger.pre || used > ring_size / 2)) {
+	drop_oldest();
+    }
+
+    add_record(MUX_CAPTURE_MARK, HIGH, 0, 0);
+    record_levels();
+}
+
+
+static bool triggers(unsigned char kind, int level, int pin)
+{
+    switch (trigger.type) {
+    case MUX_TRIGGER_RISING:
+	return MUX_CAPTURE_CHANNEL > kind && pin == trigger.pin && HIGH == level;
+
+    case MUX_TRIGGER_FALLING:
+	return MUX_CAPTURE_CHANNEL > kind && pin == trigger.pin && LOW == level;
+
+    case MUX_TRIGGER_EDGE:
+	return MUX_CAPTURE_CHANNEL > kind && pin == trigger.pin;
+
+    case MUX_TRIGGER_CHANNEL:
+	return MUX_CAPTURE_CHANNEL == kind && (trigger.pin < 0 || pin == trigger.pin);
+    }
+
+    return false;
+}
+
+
+static void add_record(unsigned char kind, int level, int pin, int channel)
+{
+    if (MUX_CAPTURE_ARMED != state && MUX_CAPTURE_TRIGGERED != state) {
+	return;
+    }
+
+    unsigned char record[MUX_CAPTURE_MAX_RECORD];
+    unsigned int len = 0;
+
+    record[len++] = (kind << 1) | ((HIGH == level) ? 1 : 0);
+    len = put_varint(record, len, now - last_time);
+
+    if (MUX_CAPTURE_MARK != kind) {
+	len = put_varint(record, len, (unsigned int) pin);
+    }
+
+    if (MUX_CAPTURE_CHANNEL == kind) {
+	long zigzag = channel;
+	len = put_varint(record, len, (zigzag < 0) ? ((unsigned long) -(zigzag + 1) << 1) | 1
+			 : (unsigned long) zigzag << 1);
+    }
+
+    while (ring_size - used < len) {
+	if (MUX_CAPTURE_TRIGGERED == state) {
+	    /* Nothing after the trigger is ever thrown away */
+	    state = MUX_CAPTURE_DONE;
+	    return;
+	}
+
+	drop_oldest();
+    }
+
+    for (unsigned int i = 0; i < len; ++i) {
+	ring[head] = record[i];
+	head = (head + 1 == ring_size) ? 0 : head + 1;
+    }
+
+    used += len;
+    last_time = now;
+
+    if (MUX_CAPTURE_ARMED == state && triggers(kind, level, pin)) {
+	fire_trigger();
+    }
+}
+
+
+int mux_capture_start(unsigned char *buffer, unsigned int size, MuxCaptureTrigger new_trigger)
+{
+    if (NULL == buffer || size < MUX_CAPTURE_MIN_BUFFER) {
+	return 1;
+    }
+
+    if (new_trigger.type > MUX_TRIGGER_CHANNEL) {
+	return 2;
+    }
+
+    ring = buffer;
+    ring_size = size;
+    head = 0;
+    tail = 0;
+    used = 0;
+
+    now = micros();
+    base_time = now;
+    last_time = now;
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	last_levels[w] = mux_levels[w];
+    }
+
+    trigger = new_trigger;
+    state = MUX_CAPTURE_ARMED;
+
+    if (MUX_TRIGGER_NOW == trigger.type) {
+	fire_trigger();
+    }
+
+    return 0;
+}
+
+
+void mux_capture_stop()
+{
+    if (MUX_CAPTURE_ARMED == state || MUX_CAPTURE_TRIGGERED == state) {
+	state = MUX_CAPTURE_DONE;
+    }
+}
+
+
+MuxCaptureState mux_capture_state()
+{
+    return state;
+}
+
+
+unsigned long mux_capture_size()
+{
+    return MUX_CAPTURE_HEADER_SIZE + used;
+}
+
+
+static void write_u32(MuxImageWrite write, void *ctx, unsigned int address, unsigned long value)
+{
+    for (int i = 0; i < 4; ++i) {
+	write(ctx, address + i, (value >> (8 * i)) & 0xFF);
+    }
+}
+
+
+int mux_capture_export(MuxImageWrite write, void *ctx, unsigned long max_len)
+{
+    if (mux_capture_size() > max_len) {
+	return 1;
+    }
+
+    write(ctx, 0, 'M');
+    write(ctx, 1, 'X');
+    write(ctx, 2, 'C');
+    write(ctx, 3, 'P');
+    write(ctx, 4, MUX_CAPTURE_VERSION);
+    write_u32(write, ctx, 5, base_time);
+    write_u32(write, ctx, 9, used);
+
+    unsigned int position = tail;
+
+    for (unsigned int i = 0; i < used; ++i) {
+	write(ctx, MUX_CAPTURE_HEADER_SIZE + i, ring[position]);
+	position = (position + 1 == ring_size) ? 0 : position + 1;
+    }
+
+    return 0;
+}
+
+
+static void write_buffer(void *ctx, unsigned int address, unsigned char value)
+{
+    ((unsigned char *) ctx)[address] = value;
+}
+
+
+int mux_capture_export_buffer(unsigned char *buffer, unsigned long len)
+{
+    return mux_capture_export(write_buffer, buffer, len);
+}
+
+
+#ifndef ARDUINO
+
+static void write_file(void *ctx, unsigned int, unsigned char value)
+{
+    fputc(value, (FILE *) ctx);
+}
+
+
+int mux_capture_export_file(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (NULL == file) {
+	return 1;
+    }
+
+    mux_capture_export(write_file, file, mux_capture_size());
+
+    int result = ferror(file) ? 1 : 0;
+
+    if (0 != fclose(file)) {
+	result = 1;
+    }
+
+    return result;
+}
+
+#endif
+
+
+void mux_capture_inputs()
+{
+    if (MUX_CAPTURE_ARMED != state && MUX_CAPTURE_TRIGGERED != state) {
+	return;
+    }
+
+    now = micros();
+
+    if (MUX_CAPTURE_TRIGGERED == state && trigger.post
+	&& now - trigger_time >= trigger.post) {
+	state = MUX_CAPTURE_DONE;
+	return;
+    }
+
+    if (now - last_time >= IDLE_LIMIT) {
+	add_record(MUX_CAPTURE_MARK, LOW, 0, 0);
+    }
+
+    MuxWord external[MUX_SAMPLE_WORDS];
+    mux_sample_external(external);
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord changed = (mux_levels[w] ^ last_levels[w]) & external[w];
+
+	last_levels[w] = mux_levels[w];
+
+	while (changed) {
+	    int bit = __builtin_ctzl(changed);
+	    int slot = w * MUX_WORD_BITS + bit;
+
+	    add_record(MUX_CAPTURE_INPUT, MUX_BIT(mux_levels, slot) ? HIGH : LOW,
+		       mux_sample_pin(slot), 0);
+
+	    changed &= changed - 1;
+	}
+    }
+}
+
+
+void mux_capture_output(int out_pin, int level)
+{
+    add_record(MUX_CAPTURE_OUTPUT, level, out_pin, 0);
+}
+
+
+void mux_capture_channel(int out_pin, int channel)
+{
+    if (MUX_CAPTURE_ARMED != state && MUX_CAPTURE_TRIGGERED != state) {
+	return;
+    }
+
+    now = micros();
+    add_record(MUX_CAPTURE_CHANNEL, LOW, out_pin, channel);
+}
@@ -0,0 +1,277 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_CAPTURE_H
+#define MUX_CAPTURE_H
+
+/*
+  Logic analyzer style capture of what the pins did. While a capture
+  is running, every change in the level of an input or an output, and
+  every change of an output's channel, is recorded into a buffer
+  supplied by the sketch. Nothing is recorded while the signals sit
+  still, and each event only takes a few bytes, so a buffer of a few
+  KB covers hours of mostly idle signals.
+
+  Each event is a record of:
+
+      kind:    One byte, the MuxCaptureKind times 2, plus 1 if the
+	       level is HIGH.
+      delta:   Microseconds since the previous record, as a varint.
+      pin:     The input or output pin, as a varint (not for marks).
+      channel: The new channel for channel events, as a zigzag varint.
+
+  A varint is 7 bits per byte, lowest bits first, with the top bit set
+  on every byte but the last. A zigzag varint stores n as 2n for n >= 0
+  and -2n - 1 for n < 0, so small negative channels stay small.
+
+  The capture waits for its trigger before it settles on what to
+  keep. Until then the buffer is a ring, with the oldest records
+  dropped to make room for new ones. Once the trigger happens the
+  records from more than the pre-trigger window ago are dropped
+  (along with as many more as it takes to free half the buffer), the
+  level of every pin is recorded, and then records are added until
+  the post-trigger window is over or the buffer is full.
+
+  An exported capture is 'M' 'X' 'C' 'P', the format version, the
+  time of the first record's delta base and the length of the records
+  (both 32 bit little endian), followed by the records. The host tool
+  in tools/mux_capture_vcd.cpp turns it into a VCD file for waveform
+  viewers.
+ */
+
+#include "mux_image.h"
+
+
+/* Version of the export format written by mux_capture_export() */
+#define MUX_CAPTURE_VERSION 1
+
+/* Size of the export header */
+#define MUX_CAPTURE_HEADER_SIZE 13
+
+/* Smallest buffer that mux_capture_start() accepts */
+#define MUX_CAPTURE_MIN_BUFFER 32
+
+/* Longest record, in bytes */
+#define MUX_CAPTURE_MAX_RECORD 16
+
+
+/*
+  Kinds of record.
+
+      MUX_CAPTURE_INPUT: An input pin changed level.
+
+      MUX_CAPTURE_OUTPUT: An output pin changed level.
+
+      MUX_CAPTURE_CHANNEL: An output switched channels. The level bit
+			   is not used.
+
+      MUX_CAPTURE_MARK: No pin. The level bit is set on the record
+			for the trigger, and clear on records which
+			only move the time along (written when the
+			signals have been idle for a long time, so the
+			deltas never overflow).
+ */
+
+typedef enum MuxCaptureKind {
+    MUX_CAPTURE_INPUT = 0,
+    MUX_CAPTURE_OUTPUT = 1,
+    MUX_CAPTURE_CHANNEL = 2,
+    MUX_CAPTURE_MARK = 3
+} MuxCaptureKind;
+
+
+/*
+  What starts the capture.
+
+      MUX_TRIGGER_NOW: Trigger straight away.
+
+      MUX_TRIGGER_RISING: The pin (input or output) goes HIGH.
+
+      MUX_TRIGGER_FALLING: The pin goes LOW.
+
+      MUX_TRIGGER_EDGE: The pin changes level.
+
+      MUX_TRIGGER_CHANNEL: The output pin switches channels, or any
+			   output does if the pin is -1.
+ */
+
+typedef enum MuxTriggerType {
+    MUX_TRIGGER_NOW = 0,
+    MUX_TRIGGER_RISING = 1,
+    MUX_TRIGGER_FALLING = 2,
+    MUX_TRIGGER_EDGE = 3,
+    MUX_TRIGGER_CHANNEL = 4
+} MuxTriggerType;
+
+
+/*
+  Trigger settings.
+
+  Fields:
+      type: What to trigger on, see MuxTriggerType.
+
+      pin: The pin to watch.
+
+      pre: Microseconds of history to keep from before the trigger.
+	   At most half of the buffer is kept from before the
+	   trigger, so this may be cut short.
+
+      post: Microseconds to keep recording after the trigger, or 0
+	    to keep going until the buffer is full.
+ */
+
+typedef struct MuxCaptureTrigger {
+    unsigned char type;
+    int pin;
+    unsigned long pre;
+    unsigned long post;
+} MuxCaptureTrigger;
+
+
+/*
+  State of the capture.
+
+      MUX_CAPTURE_OFF: Not capturing.
+
+      MUX_CAPTURE_ARMED: Recording, waiting for the trigger.
+
+      MUX_CAPTURE_TRIGGERED: Recording after the trigger.
+
+      MUX_CAPTURE_DONE: Finished, ready to export.
+ */
+
+typedef enum MuxCaptureState {
+    MUX_CAPTURE_OFF = 0,
+    MUX_CAPTURE_ARMED = 1,
+    MUX_CAPTURE_TRIGGERED = 2,
+    MUX_CAPTURE_DONE = 3
+} MuxCaptureState;
+
+
+/*
+  Arguments:
+      buffer: Where to keep the records. It must stay around until
+	      the capture has been exported.
+
+      size: Size of the buffer, at least MUX_CAPTURE_MIN_BUFFER.
+
+      trigger: When to start capturing for real.
+
+  Starts a new capture, throwing away any previous one. Returns 0 on
+  success, 1 if the buffer is too small, or 2 if the trigger type is
+  not a MuxTriggerType.
+
+ */
+
+int mux_capture_start(unsigned char *buffer, unsigned int size, MuxCaptureTrigger trigger);
+
+
+/*
+  Stops recording. The records so far can still be exported.
+
+ */
+
+void mux_capture_stop();
+
+
+/*
+  Returns the state of the capture, see MuxCaptureState.
+
+ */
+
+MuxCaptureState mux_capture_state();
+
+
+/*
+  Returns the size in bytes of the exported capture.
+
+ */
+
+unsigned long mux_capture_size();
+
+
+/*
+  Arguments:
+      write: Callback used to store each byte, as for images.
+
+      ctx: Passed along to the callback.
+
+      max_len: Number of bytes available.
+
+  Exports the records in the buffer, oldest first. Returns 0 on
+  success, or 1 if the export does not fit in max_len bytes (nothing
+  is written in that case). This can be done while the capture is
+  still running, as long as no update happens in the middle of it.
+
+ */
+
+int mux_capture_export(MuxImageWrite write, void *ctx, unsigned long max_len);
+
+
+/*
+  Convenience function for exporting into a RAM buffer. Returns the
+  same values as mux_capture_export().
+
+ */
+
+int mux_capture_export_buffer(unsigned char *buffer, unsigned long len);
+
+
+#ifndef ARDUINO
+
+/*
+  Arguments:
+      path: The file to write.
+
+  Host build only. Exports the capture to a file. Returns 0 on
+  success, or 1 if the file could not be written.
+
+ */
+
+int mux_capture_export_file(const char *path);
+
+#endif
+
+
+/*
+  Hooks for the rest of MuxDuino, which do nothing unless a capture
+  is running.
+
+  mux_capture_inputs() is called by mux_update() once the inputs have
+  been sampled, and records the inputs that changed.
+
+  mux_capture_output() is called whenever an output is written with
+  a different level than before.
+
+  mux_capture_channel() is called whenever an output switches
+  channels.
+ */
+
+void mux_capture_inputs();
+void mux_capture_output(int out_pin, int level);
+void mux_capture_channel(int out_pin, int channel);
+
+#endif
@@ -0,0 +1,271 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_cascade.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+
+#include <stddef.h>
+
+
+static bool cascade = false;
+
+
+int mux_set_cascade(bool enabled)
+{
+    if (!enabled) {
+	/* Can't turn it off while any output is used as an input */
+	MuxOutputNode *out_node = mux_outs.head;
+	while (out_node) {
+	    if (out_node->slot >= 0) {
+		return 1;
+	    }
+
+	    out_node = out_node->next;
+	}
+    }
+
+    cascade = enabled;
+    return 0;
+}
+
+
+bool mux_cascade_enabled()
+{
+    return cascade;
+}
+
+
+void mux_cascade_restore(bool enabled)
+{
+    cascade = enabled;
+}
+
+
+/* Fills in which output drives each slot, NULL for real input pins */
+static void outputs_by_slot(MuxOutputNode **by_slot)
+{
+    for (int slot = 0; slot < MUX_MAX_INPUTS; ++slot) {
+	by_slot[slot] = NULL;
+    }
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	if (out_node->slot >= 0) {
+	    by_slot[out_node->slot] = out_node;
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+/* True if the output is one of the first count in the array */
+static bool seen_output(MuxOutputNode **seen, int count, MuxOutputNode *out_node)
+{
+    for (int i = 0; i < count; ++i) {
+	if (out_node == seen[i]) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+
+bool mux_cascade_creates_cycle(MuxPipe pipe)
+{
+    MuxOutputNode *start = find_output_node(&mux_outs, pipe.in_pin);
+
+    if (NULL == start) {
+	/* Input is a real pin, nothing feeds it */
+	return false;
+    }
+
+    /*
+      Every output but the start that feeds it is also an input, so
+      there are at most MUX_MAX_INPUTS of them, and each is pushed
+      once. Feeding outputs are looked up by pin rather than by slot,
+      so this works while the slots are out of date.
+     */
+    MuxOutputNode *stack[MUX_MAX_INPUTS + 1];
+    MuxOutputNode *seen[MUX_MAX_INPUTS + 1];
+    int top = 0;
+    int num_seen = 0;
+
+    stack[top++] = start;
+    seen[num_seen++] = start;
+
+    /* Walk back through everything that feeds the pipe's input */
+    while (top > 0) {
+	MuxOutputNode *out_node = stack[--top];
+
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		if (in_node->in_pin == pipe.out_pin) {
+		    return true;
+		}
+
+		MuxOutputNode *feeder = find_output_node(&mux_outs, in_node->in_pin);
+
+		if (NULL != feeder && num_seen <= MUX_MAX_INPUTS
+		    && !seen_output(seen, num_seen, feeder)) {
+		    seen[num_seen++] = feeder;
+		    stack[top++] = feeder;
+		}
+
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+    }
+
+    return false;
+}
+
+
+/* Works out the stage of every output */
+static void assign_stages(MuxOutputNode **by_slot)
+{
+    bool changed = true;
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	out_node->stage = 0;
+	out_node = out_node->next;
+    }
+
+    /*
+      Push each output past everything that feeds it until nothing
+      moves. There are no loops, so this settles after at most as many
+      rounds as there are stages.
+     */
+    while (changed) {
+	changed = false;
+
+	out_node = mux_outs.head;
+	while (out_node) {
+	    MuxChannelNode *channel_node = out_node->channels.head;
+	    while (channel_node) {
+		MuxInputNode *in_node = channel_node->inputs.head;
+		while (in_node) {
+		    int slot = in_node->slot;
+
+		    if (slot >= 0 && NULL != by_slot[slot]
+			&& by_slot[slot]->stage >= out_node->stage) {
+			out_node->stage = by_slot[slot]->stage + 1;
+			changed = true;
+		    }
+
+		    in_node = in_node->next;
+		}
+
+		channel_node = channel_node->next;
+	    }
+
+	    out_node = out_node->next;
+	}
+    }
+}
+
+
+/* Relinks the outputs in stage order, keeping the order within a stage */
+static void sort_by_stage()
+{
+    MuxOutputList sorted = {NULL, NULL};
+    MuxOutputNode *out_node = mux_outs.head;
+
+    while (out_node) {
+	MuxOutputNode *next_node = out_node->next;
+	out_node->next = NULL;
+
+	if (NULL == sorted.head) {
+	    sorted.head = out_node;
+	    sorted.tail = out_node;
+	}
+	else if (sorted.tail->stage <= out_node->stage) {
+	    /* Usually the case, since the list is mostly sorted already */
+	    sorted.tail->next = out_node;
+	    sorted.tail = out_node;
+	}
+	else if (out_node->stage < sorted.head->stage) {
+	    out_node->next = sorted.head;
+	    sorted.head = out_node;
+	}
+	else {
+	    /* Goes after the last node with the same or an earlier stage */
+	    MuxOutputNode *previous = sorted.head;
+	    while (previous->next->stage <= out_node->stage) {
+		previous = previous->next;
+	    }
+
+	    out_node->next = previous->next;
+	    previous->next = out_node;
+	}
+
+	out_node = next_node;
+    }
+
+    mux_outs = sorted;
+}
+
+
+void mux_cascade_rebuild()
+{
+    MuxWord internal[MUX_SAMPLE_WORDS];
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	internal[w] = 0;
+    }
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	out_node->slot = cascade ? mux_sample_slot(out_node->out_pin) : -1;
+
+	if (out_node->slot >= 0) {
+	    internal[out_node->slot / MUX_WORD_BITS] |= (MuxWord) 1 << (out_node->slot % MUX_WORD_BITS);
+	}
+
+	out_node = out_node->next;
+    }
+
+    mux_sample_set_internal(internal);
+
+    if (!cascade) {
+	return;
+    }
+
+    MuxOutputNode *by_slot[MUX_MAX_INPUTS];
+    outputs_by_slot(by_slot);
+
+    assign_stages(by_slot);
+    sort_by_stage();
+}
@@ -0,0 +1,103 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_CASCADE_H
+#define MUX_CASCADE_H
+
+/*
+  Cascaded routing. Normally an output can never be used as an input
+  (register_pipe() returns 2 or 3), so chaining logic together takes
+  loopback wires and costs a whole update per hop. With cascading
+  turned on, an output may also be the input of other pipes. The
+  output is then an internal signal: it is not read back from the
+  pin, the level just worked out for it is used directly.
+
+  The outputs are kept sorted into stages. An output whose inputs are
+  all real input pins is in stage 0, and any other output is one stage
+  after the latest output that feeds it, on any of its channels. Since
+  mux_update() goes through the outputs in stage order, a signal
+  passes through any number of hops in a single update. Pipes which
+  would make a loop are rejected by register_pipe() with error 5.
+ */
+
+#include "mux_pipe.h"
+
+
+/*
+  Arguments:
+      enabled: True to allow outputs to be used as inputs.
+
+  Turns cascading on or off. It can only be turned off while no
+  output is used as an input, returns 0 on success and 1 otherwise.
+
+ */
+
+int mux_set_cascade(bool enabled);
+
+
+/*
+  Returns true if cascading is turned on.
+
+ */
+
+bool mux_cascade_enabled();
+
+
+/*
+  Arguments:
+      pipe: A pipe which is about to be registered.
+
+  Returns true if adding the pipe would make a loop, which is the case
+  if the pipe's input already depends on its output. Only mux_outs is
+  looked at, so this can be used before the slots are rebuilt.
+
+ */
+
+bool mux_cascade_creates_cycle(MuxPipe pipe);
+
+
+/*
+  Sets the slot of every output which is also an input, marks those
+  slots as internal signals for the sampler, and sorts the outputs
+  into stage order. Called by mux_topology_changed() after the input
+  slots have been worked out.
+
+ */
+
+void mux_cascade_rebuild();
+
+
+/*
+  Arguments:
+      enabled: Whether cascading should be on.
+
+  Sets the flag without any of the checks in mux_set_cascade(), for
+  bringing back a saved context (see mux_state.h).
+
+ */
+
+void mux_cascade_restore(bool enabled);
+
+#endif
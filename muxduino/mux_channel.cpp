@@ -25,8 +25,11 @@
 #include "mux_channel.h"
 #include "mux_pipe.h"
 #include "mux_input.h"
+#include "mux_lut.h"
 #include "mem_alloc.h"
 
+#include "mux_platform.h"
+
 
 /* Allocate an input node for a given a pipe */
 static MuxChannelNode * create_channel_node(MuxPipe pipe)
@@ -34,6 +37,20 @@ static MuxChannelNode * create_channel_node(MuxPipe pipe)
     MuxChannelNode *node = (MuxChannelNode *) allocate_memory(sizeof(MuxChannelNode));
 
     node->channel = pipe.channel;
+    node->combine = MUX_COMBINE_OR;
+    node->priority_bit = 0;
+    node->num_inputs = 0;
+    node->num_transforms = 0;
+    node->lut = NULL;
+
+#if MUX_STATS
+    node->selected = 0;
+#endif
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	node->transformed[w] = 0;
+	node->shaped[w] = 0;
+    }
 
     /* Set up the inputs list */
     node->inputs.head = NULL;
@@ -46,6 +63,37 @@ static MuxChannelNode * create_channel_node(MuxPipe pipe)
 }
 
 
+/* Free a node along with its table, its inputs must already be gone */
+static void free_channel_node(MuxChannelNode *node)
+{
+    mux_lut_free(node);
+    free_memory(node);
+}
+
+
+/* Unlink a node from the list given its predecessor, and free it */
+static void destroy_channel_node(MuxChannelList *list,
+				 MuxChannelNode *previous_node,
+				 MuxChannelNode *node)
+{
+    if (NULL != previous_node) {
+	previous_node->next = node->next;
+    }
+
+    /* Adjust the head and tail if necessary */
+    if (node == list->head) {
+	list->head = node->next;
+    }
+
+    if (node == list->tail) {
+	list->tail = previous_node;
+    }
+
+    mux_input_list_clear(&node->inputs);
+    free_channel_node(node);
+}
+
+
 /* Find a channel node in a list. Returns NULL if it is not in the list */
 MuxChannelNode * find_channel_node(MuxChannelList *list, int channel)
 {
@@ -63,6 +111,151 @@ MuxChannelNode * find_channel_node(MuxChannelList *list, int channel)
 }
 
 
+MuxChannelNode * mux_channel_list_append(MuxChannelList *list, int channel)
+{
+    MuxChannelNode *node = (MuxChannelNode *) allocate_memory(sizeof(MuxChannelNode));
+
+    node->channel = channel;
+    node->combine = MUX_COMBINE_OR;
+    node->priority_bit = 0;
+    node->num_inputs = 0;
+    node->num_transforms = 0;
+    node->lut = NULL;
+
+#if MUX_STATS
+    node->selected = 0;
+#endif
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	node->transformed[w] = 0;
+	node->shaped[w] = 0;
+    }
+
+    node->inputs.head = NULL;
+    node->inputs.tail = NULL;
+    node->next = NULL;
+
+    if (NULL == list->head) {
+	list->head = node;
+    }
+    else {
+	list->tail->next = node;
+    }
+
+    list->tail = node;
+
+    return node;
+}
+
+
+void mux_channel_compile(MuxChannelNode *node)
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	node->mask[w] = 0;
+	node->transformed[w] = 0;
+    }
+
+    MuxInputNode *in_node = node->inputs.head;
+    while (in_node) {
+	int slot = in_node->slot;
+
+	if (slot >= 0) {
+	    MuxWord bit = (MuxWord) 1 << (slot % MUX_WORD_BITS);
+
+	    node->mask[slot / MUX_WORD_BITS] |= bit;
+
+	    if (in_node->transform) {
+		node->transformed[slot / MUX_WORD_BITS] |= bit;
+	    }
+	}
+
+	in_node = in_node->next;
+    }
+
+    int num_inputs = 0;
+    int num_transforms = 0;
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	num_inputs += __builtin_popcountl(node->mask[w]);
+	num_transforms += __builtin_popcountl(node->transformed[w]);
+	node->shaped[w] &= node->transformed[w];
+    }
+
+    node->num_inputs = num_inputs;
+    node->num_transforms = num_transforms;
+}
+
+
+int mux_channel_level(const MuxChannelNode *node, const MuxWord *levels)
+{
+    MuxWord any = 0;
+    MuxWord missing = 0;
+    int high = 0;
+
+    if (node->lut) {
+	return mux_lut_level(node->lut, levels);
+    }
+
+    /* Swap in the transformed levels */
+    MuxWord merged[MUX_SAMPLE_WORDS];
+
+    if (node->num_transforms) {
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    merged[w] = (levels[w] & ~node->transformed[w]) | node->shaped[w];
+	}
+
+	levels = merged;
+    }
+
+    switch (node->combine) {
+    case MUX_COMBINE_OR:
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    any |= levels[w] & node->mask[w];
+	}
+
+	return any ? HIGH : LOW;
+
+    case MUX_COMBINE_AND:
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    missing |= node->mask[w] & ~levels[w];
+	}
+
+	return missing ? LOW : HIGH;
+
+    case MUX_COMBINE_XOR:
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    any ^= levels[w] & node->mask[w];
+	}
+
+	return __builtin_parityl(any) ? HIGH : LOW;
+
+    case MUX_COMBINE_MAJORITY:
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    high += __builtin_popcountl(levels[w] & node->mask[w]);
+	}
+
+	return (2 * high > node->num_inputs) ? HIGH : LOW;
+
+    case MUX_COMBINE_PRIORITY:
+	/* Ranked by the channel's own order, so other outputs' slots don't matter */
+	for (MuxInputNode *in_node = node->inputs.head; in_node; in_node = in_node->next) {
+	    if (in_node->slot < 0) {
+		continue;
+	    }
+
+	    ++high;
+
+	    if (MUX_BIT(levels, in_node->slot)) {
+		return ((high >> node->priority_bit) & 1) ? HIGH : LOW;
+	    }
+	}
+
+	return LOW;
+    }
+
+    return LOW;
+}
+
+
 void mux_channel_list_add(MuxChannelList *list, MuxPipe pipe)
 {
     if (NULL == list->head) {
@@ -118,7 +311,7 @@ void mux_channel_list_remove(MuxChannelList *list, MuxPipe pipe)
 		    list->tail = previous_node;
 		}
 
-		free_memory(current_node);
+		free_channel_node(current_node);
 	    }
 
 	    return;
@@ -128,3 +321,83 @@ void mux_channel_list_remove(MuxChannelList *list, MuxPipe pipe)
 	current_node = current_node->next;
     }
 }
+
+
+void mux_channel_list_remove_channel(MuxChannelList *list, int channel)
+{
+    MuxChannelNode *current_node = list->head;
+    MuxChannelNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	if (current_node->channel == channel) {
+	    destroy_channel_node(list, previous_node, current_node);
+	    return;
+	}
+
+	previous_node = current_node;
+	current_node = current_node->next;
+    }
+}
+
+
+void mux_channel_list_remove_input(MuxChannelList *list, int in_pin)
+{
+    MuxChannelNode *current_node = list->head;
+    MuxChannelNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	MuxChannelNode *next_node = current_node->next;
+
+	mux_input_list_remove(&current_node->inputs, in_pin);
+
+	if (NULL == current_node->inputs.head) {
+	    /* Channel is empty now, previous node stays the same */
+	    destroy_channel_node(list, previous_node, current_node);
+	}
+	else {
+	    previous_node = current_node;
+	}
+
+	current_node = next_node;
+    }
+}
+
+
+void mux_channel_list_sweep(MuxChannelList *list)
+{
+    MuxChannelNode *current_node = list->head;
+    MuxChannelNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	MuxChannelNode *next_node = current_node->next;
+
+	mux_input_list_sweep(&current_node->inputs);
+
+	if (NULL == current_node->inputs.head) {
+	    destroy_channel_node(list, previous_node, current_node);
+	}
+	else {
+	    previous_node = current_node;
+	}
+
+	current_node = next_node;
+    }
+}
+
+
+void mux_channel_list_clear(MuxChannelList *list)
+{
+    MuxChannelNode *current_node = list->head;
+
+    while (NULL != current_node) {
+	MuxChannelNode *next_node = current_node->next;
+
+	mux_input_list_clear(&current_node->inputs);
+	free_channel_node(current_node);
+
+	current_node = next_node;
+    }
+
+    list->head = NULL;
+    list->tail = NULL;
+}
@@ -25,8 +25,43 @@
 #ifndef MUX_CHANNEL_H
 #define MUX_CHANNEL_H
 
+#include "mux_config.h"
 #include "mux_input.h"
 #include "mux_pipe.h"
+#include "mux_sample.h"
+
+
+/*
+  Ways of combining the inputs on a digital channel into the output
+  level.
+
+      MUX_COMBINE_OR: HIGH if any input is HIGH (the default).
+
+      MUX_COMBINE_AND: HIGH if every input is HIGH.
+
+      MUX_COMBINE_XOR: HIGH if an odd number of inputs are HIGH.
+
+      MUX_COMBINE_MAJORITY: HIGH if more than half of the inputs are
+			    HIGH.
+
+      MUX_COMBINE_PRIORITY: The inputs are ranked 1, 2, 3... in the
+			    order they were added to the channel
+			    (the order of its input list), and the
+			    HIGH input with the lowest rank
+			    wins (0 if none are HIGH). The output is
+			    one bit of the winner's rank, picked by
+			    the channel's priority_bit. Registering
+			    a channel on several outputs with
+			    different bits gives a priority encoder.
+ */
+
+typedef enum MuxCombine {
+    MUX_COMBINE_OR = 0,
+    MUX_COMBINE_AND = 1,
+    MUX_COMBINE_XOR = 2,
+    MUX_COMBINE_MAJORITY = 3,
+    MUX_COMBINE_PRIORITY = 4
+} MuxCombine;
 
 
 /*
@@ -35,15 +70,56 @@
   Fields:
       channel: The number for the channel that this represents.
 
+      combine: How the inputs are combined into one value. This is
+	       0 for a new channel. Digital channels use the MuxCombine
+	       values, and analog channels use MuxAnalogCombine (see
+	       mux_analog.h).
+
+      priority_bit: Bit of the rank used by MUX_COMBINE_PRIORITY.
+
       inputs: List of inputs on the channel.
 
+      mask: Bit for the slot of every input, set by
+	    mux_channel_compile().
+
+      num_inputs: Number of bits set in mask.
+
+      transformed: Bit for the slot of every input with a transform
+		   (see mux_transform.h), set by mux_channel_compile().
+
+      shaped: Levels of the transformed inputs after their
+	      transforms, used in place of their sampled levels.
+
+      num_transforms: Number of bits set in transformed.
+
+      lut: The channel's lookup table (see mux_lut.h), or NULL if it
+	   is evaluated from its mask.
+
+      selected: With MUX_STATS, the number of updates that the
+		channel was evaluated for its output.
+
       next: Next node in the linked list, NULL on the last node.
  */
 
 typedef struct MuxChannelNode {
     int channel;
+    unsigned char combine;
+    unsigned char priority_bit;
     MuxInputList inputs;
 
+    MuxWord mask[MUX_SAMPLE_WORDS];
+    unsigned char num_inputs;
+
+    MuxWord transformed[MUX_SAMPLE_WORDS];
+    MuxWord shaped[MUX_SAMPLE_WORDS];
+    unsigned char num_transforms;
+
+    struct MuxLut *lut;
+
+#if MUX_STATS
+    uint32_t selected;
+#endif
+
     struct MuxChannelNode *next;
 } MuxChannelNode;
 
@@ -104,4 +180,101 @@ void mux_channel_list_add(MuxChannelList *list, MuxPipe pipe);
 
 void mux_channel_list_remove(MuxChannelList *list, MuxPipe pipe);
 
+
+/*
+  Arguments:
+      list: The channel list we are removing from.
+
+      channel: The number of the channel that we want to remove.
+
+  Removes the whole channel node from the list, freeing it along with
+  all of its inputs. Does nothing if the channel is not in the list.
+
+ */
+
+void mux_channel_list_remove_channel(MuxChannelList *list, int channel);
+
+
+/*
+  Arguments:
+      list: The channel list we are removing from.
+
+      in_pin: The input pin that we want to remove from every channel.
+
+  Removes the input from each channel in the list in a single pass,
+  freeing any channel nodes which are left without inputs.
+
+ */
+
+void mux_channel_list_remove_input(MuxChannelList *list, int in_pin);
+
+
+/*
+  Arguments:
+      list: The channel list that we want to empty.
+
+  Frees every channel node in the list along with their inputs,
+  leaving the list empty.
+
+ */
+
+void mux_channel_list_clear(MuxChannelList *list);
+
+
+/*
+  Arguments:
+      list: The channel list to sweep.
+
+  Sweeps the inputs of every channel (see mux_input_list_sweep()),
+  freeing any channel nodes which are left without inputs.
+
+ */
+
+void mux_channel_list_sweep(MuxChannelList *list);
+
+
+/*
+  Arguments:
+      list: The channel list we are adding to.
+
+      channel: The number of the channel to add.
+
+  Adds a new channel node with no inputs to the end of the list, and
+  returns it. This does not check whether the channel already exists,
+  and the caller is expected to give the channel some inputs.
+
+ */
+
+MuxChannelNode * mux_channel_list_append(MuxChannelList *list, int channel);
+
+
+/*
+  Arguments:
+      node: The channel to compile.
+
+  Works out the channel's mask and transformed bits from the slots of
+  its inputs. This has to be done whenever the inputs, their slots, or
+  their transforms change.
+
+ */
+
+void mux_channel_compile(MuxChannelNode *node);
+
+
+/*
+  Arguments:
+      node: The channel to evaluate.
+
+      levels: Sampled levels of the inputs, one bit per slot.
+
+  Returns the level of the channel, HIGH or LOW, according to its
+  combine function. Inputs with a transform use the channel's shaped
+  bits instead of levels. A channel with a lookup table is evaluated
+  from the table. This is a fixed number of word operations for any
+  number of inputs.
+
+ */
+
+int mux_channel_level(const MuxChannelNode *node, const MuxWord *levels);
+
 #endif
@@ -0,0 +1,101 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_CONFIG_H
+#define MUX_CONFIG_H
+
+/*
+  Compile time options for MuxDuino. Each of these can be changed
+  here, or set on the compiler's command line (-DMUX_STATS=1).
+ */
+
+
+/*
+  Most distinct digital input pins, including outputs which feed
+  other outputs when cascading. The sampler and debounce filter keep
+  a few arrays of this size, and every channel keeps three bit arrays
+  with a bit per input, so on small AVR boards this defaults to 16 to
+  save RAM. register_pipe() returns 4 once the limit is reached.
+ */
+
+#ifndef MUX_MAX_INPUTS
+#ifdef __AVR__
+#define MUX_MAX_INPUTS 16
+#else
+#define MUX_MAX_INPUTS 64
+#endif
+#endif
+
+
+/*
+  Activity counters for the pipes, see mux_stats.h. These cost a few
+  bytes per input, channel and output, and a little time on every
+  update, so they are left out unless this is 1.
+ */
+
+#ifndef MUX_STATS
+#define MUX_STATS 0
+#endif
+
+
+/*
+  Sleep on pin change interrupts in mux_idle_update() on AVR boards,
+  see mux_idle.h. This defines the PCINT0_vect to PCINT3_vect vectors,
+  which SoftwareSerial, PinChangeInterrupt and others also define, so
+  it is left out unless this is 1. Without it the pins are watched
+  until one changes instead of sleeping.
+ */
+
+#ifndef MUX_IDLE_PCINT
+#define MUX_IDLE_PCINT 0
+#endif
+
+
+/*
+  Run the scheduler's updates from the Timer1 compare interrupt on AVR
+  boards, see mux_schedule.h. This defines TIMER1_COMPA_vect, which
+  the Servo and TimerOne libraries also use, so it is left out unless
+  this is 1. Without it the updates are run by mux_schedule_poll(),
+  just as on other boards.
+ */
+
+#ifndef MUX_SCHEDULE_TIMER1
+#define MUX_SCHEDULE_TIMER1 0
+#endif
+
+
+/*
+  Run the ADC from its interrupt for analog pipes on AVR boards, see
+  mux_analog.h. This defines ADC_vect, which no other code in the
+  sketch can then use, so it is left out unless this is 1. Without it
+  one conversion is done with analogRead() on every update.
+ */
+
+#ifndef MUX_ANALOG_ISR
+#define MUX_ANALOG_ISR 0
+#endif
+
+#endif
@@ -0,0 +1,465 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef ARDUINO
+
+#include "mux_host.h"
+#include "mux_bus.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+
+/* Pin levels and modes, from mux_host_use_pins() if that was called */
+static MuxHostPins own_pins;
+static MuxHostPins *pins = &own_pins;
+
+/* Values for analogRead() and from analogWrite() */
+static int analog_inputs[MUX_HOST_PINS];
+static int analog_outputs[MUX_HOST_PINS];
+
+/* Manual clock for tests, used instead of the real one when set */
+static bool manual_clock = false;
+static unsigned long long manual_us = 0;
+static unsigned long manual_step = 0;
+
+/*
+  Count of calls to mux_host_set_input(), so that mux_host_wait_input()
+  can tell when one happens. The lock and condition are what let
+  another thread wake a waiting one.
+ */
+static unsigned long input_changes = 0;
+static pthread_mutex_t input_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t input_changed = PTHREAD_COND_INITIALIZER;
+
+/*
+  The shared memory pin bus, if one is attached. bus_inputs are the
+  inputs from the last consistent read of the bus, and input_mask has
+  a bit for each pin which isn't an output, so takes its level from
+  the bus. The mask is worked out again when the modes change.
+ */
+static MuxBus *bus = NULL;
+static char bus_name[256];
+static uint32_t bus_inputs[MUX_BUS_WORDS];
+static uint32_t input_mask[MUX_BUS_WORDS];
+static bool mask_stale = true;
+static unsigned long bus_torn = 0;
+
+/* Tries at reading the bus inputs before using the last ones again */
+#define BUS_TRIES 64
+
+#if MUX_BUS_PINS != MUX_HOST_PINS
+#error "The pin bus must have as many pins as the host backend"
+#endif
+
+/* Called whenever digitalWrite() changes a pin */
+static MuxHostWriteHook write_hook = NULL;
+
+MuxHostSerial Serial;
+
+
+/* True if the pin number is one that we keep track of */
+static bool valid_pin(int pin)
+{
+    return pin >= 0 && pin < MUX_HOST_PINS;
+}
+
+
+/*
+  Sets the level of a pin, returning true if it changed. The word is
+  updated atomically, since another thread may be setting an input in
+  the same word while the router writes an output.
+ */
+static bool set_level(int pin, int level)
+{
+    unsigned long *word = &pins->levels[pin / MUX_HOST_PIN_WORD_BITS];
+    unsigned long bit = 1UL << (pin % MUX_HOST_PIN_WORD_BITS);
+    unsigned long before;
+
+    if (LOW != level) {
+	before = __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+	return !(before & bit);
+    }
+
+    before = __atomic_fetch_and(word, ~bit, __ATOMIC_RELAXED);
+    return before & bit;
+}
+
+
+void pinMode(int pin, int mode)
+{
+    if (valid_pin(pin)) {
+	pins->modes[pin] = mode;
+	mask_stale = true;
+
+	if (INPUT_PULLUP == mode) {
+	    set_level(pin, HIGH);
+	}
+    }
+}
+
+
+int digitalRead(int pin)
+{
+    return mux_host_get_level(pin);
+}
+
+
+void digitalWrite(int pin, int value)
+{
+    if (valid_pin(pin) && set_level(pin, value) && write_hook) {
+	write_hook(pin, (LOW != value) ? HIGH : LOW);
+    }
+}
+
+
+int analogRead(int pin)
+{
+    return valid_pin(pin) ? analog_inputs[pin] : 0;
+}
+
+
+void analogWrite(int pin, int value)
+{
+    if (valid_pin(pin)) {
+	analog_outputs[pin] = value;
+    }
+}
+
+
+/* There are no interrupts to turn off on the host */
+void noInterrupts()
+{
+}
+
+
+void interrupts()
+{
+}
+
+
+/* Microseconds on the monotonic clock since the first call */
+static unsigned long long host_clock_us()
+{
+    static unsigned long long start = 0;
+    struct timespec now;
+
+    if (manual_clock) {
+	unsigned long long us = manual_us;
+
+	manual_us += manual_step;
+	return us;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    unsigned long long us = (unsigned long long) now.tv_sec * 1000000ULL
+	+ now.tv_nsec / 1000;
+
+    if (0 == start) {
+	start = us;
+    }
+
+    return us - start;
+}
+
+
+unsigned long millis()
+{
+    return (unsigned long) (host_clock_us() / 1000);
+}
+
+
+unsigned long micros()
+{
+    return (unsigned long) host_clock_us();
+}
+
+
+void mux_host_set_clock(unsigned long us)
+{
+    manual_clock = true;
+    manual_us = us;
+}
+
+
+void mux_host_set_clock_step(unsigned long us)
+{
+    manual_step = us;
+}
+
+
+void mux_host_advance_clock(unsigned long us)
+{
+    manual_us += us;
+}
+
+
+void mux_host_use_pins(MuxHostPins *use)
+{
+    pins = use ? use : &own_pins;
+    mask_stale = true;
+}
+
+
+void mux_host_set_input(int pin, int level)
+{
+    if (valid_pin(pin)) {
+	pthread_mutex_lock(&input_lock);
+
+	set_level(pin, level);
+	++input_changes;
+
+	pthread_cond_broadcast(&input_changed);
+	pthread_mutex_unlock(&input_lock);
+    }
+}
+
+
+unsigned long mux_host_input_changes()
+{
+    pthread_mutex_lock(&input_lock);
+    unsigned long changes = input_changes;
+    pthread_mutex_unlock(&input_lock);
+
+    return changes;
+}
+
+
+bool mux_host_wait_input(unsigned long seen, unsigned long timeout)
+{
+    struct timespec until;
+
+    /* Condition waits are against the real clock, never the manual one */
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += timeout / 1000000;
+    until.tv_nsec += (timeout % 1000000) * 1000;
+
+    if (until.tv_nsec >= 1000000000L) {
+	until.tv_nsec -= 1000000000L;
+	++until.tv_sec;
+    }
+
+    pthread_mutex_lock(&input_lock);
+
+    while (input_changes == seen) {
+	if (0 != pthread_cond_timedwait(&input_changed, &input_lock, &until)) {
+	    break;
+	}
+    }
+
+    bool changed = (input_changes != seen);
+    pthread_mutex_unlock(&input_lock);
+
+    return changed;
+}
+
+
+int mux_host_get_level(int pin)
+{
+    if (!valid_pin(pin)) {
+	return LOW;
+    }
+
+    unsigned long word = __atomic_load_n(&pins->levels[pin / MUX_HOST_PIN_WORD_BITS], __ATOMIC_RELAXED);
+
+    return (word >> (pin % MUX_HOST_PIN_WORD_BITS)) & 1 ? HIGH : LOW;
+}
+
+
+void mux_host_set_write_hook(MuxHostWriteHook hook)
+{
+    write_hook = hook;
+}
+
+
+void mux_host_set_analog(int pin, int value)
+{
+    if (valid_pin(pin)) {
+	analog_inputs[pin] = value;
+    }
+}
+
+
+int mux_host_get_analog(int pin)
+{
+    return valid_pin(pin) ? analog_outputs[pin] : 0;
+}
+
+
+int mux_host_get_mode(int pin)
+{
+    if (!valid_pin(pin)) {
+	return INPUT;
+    }
+
+    return pins->modes[pin];
+}
+
+
+void MuxHostSerial::print(const char *str)
+{
+    fputs(str, stdout);
+}
+
+
+void MuxHostSerial::print(long value)
+{
+    printf("%ld", value);
+}
+
+
+void MuxHostSerial::println(const char *str)
+{
+    printf("%s\n", str);
+}
+
+
+void MuxHostSerial::println(long value)
+{
+    printf("%ld\n", value);
+}
+
+
+void MuxHostSerial::println()
+{
+    putchar('\n');
+}
+
+
+/* Copies the pin levels into the bus layout, 32 pins to a word */
+static void levels_to_bus(uint32_t *words)
+{
+    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	int bit = w * 32;
+
+	words[w] = (uint32_t) (pins->levels[bit / MUX_HOST_PIN_WORD_BITS] >> (bit % MUX_HOST_PIN_WORD_BITS));
+    }
+}
+
+
+static void find_input_mask()
+{
+    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	input_mask[w] = 0;
+    }
+
+    for (int pin = 0; pin < MUX_HOST_PINS; ++pin) {
+	if (OUTPUT != pins->modes[pin]) {
+	    input_mask[pin / 32] |= (uint32_t) 1 << (pin % 32);
+	}
+    }
+
+    mask_stale = false;
+}
+
+
+int mux_host_attach_bus(const char *name)
+{
+    if (bus) {
+	return 1;
+    }
+
+    if (strlen(name) >= sizeof(bus_name)) {
+	return 2;
+    }
+
+    levels_to_bus(bus_inputs);
+    bus = mux_bus_create(name, bus_inputs);
+
+    if (NULL == bus) {
+	return 2;
+    }
+
+    strcpy(bus_name, name);
+    mask_stale = true;
+    bus_torn = 0;
+
+    return 0;
+}
+
+
+void mux_host_detach_bus()
+{
+    if (bus) {
+	mux_bus_close(bus);
+	mux_bus_remove(bus_name);
+	bus = NULL;
+    }
+}
+
+
+unsigned long mux_host_bus_torn()
+{
+    return bus_torn;
+}
+
+
+void mux_host_bus_sample()
+{
+    if (NULL == bus) {
+	return;
+    }
+
+    if (!mux_bus_read_inputs(bus, bus_inputs, BUS_TRIES)) {
+	++bus_torn;
+    }
+
+    if (mask_stale) {
+	find_input_mask();
+    }
+
+    for (int w = 0; w < MUX_BUS_WORDS; ++w) {
+	int bit = w * 32;
+	int shift = bit % MUX_HOST_PIN_WORD_BITS;
+	unsigned long *word = &pins->levels[bit / MUX_HOST_PIN_WORD_BITS];
+	unsigned long mask = (unsigned long) input_mask[w] << shift;
+	unsigned long bits = ((unsigned long) bus_inputs[w] << shift) & mask;
+
+	/* Other pins in the word may be set by another thread, as in set_level() */
+	unsigned long before = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+	while (!__atomic_compare_exchange_n(word, &before, (before & ~mask) | bits, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+    }
+}
+
+
+void mux_host_bus_publish()
+{
+    if (NULL == bus) {
+	return;
+    }
+
+    uint32_t levels[MUX_BUS_WORDS];
+
+    levels_to_bus(levels);
+    mux_bus_publish(bus, levels);
+}
+
+#endif
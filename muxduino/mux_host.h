@@ -0,0 +1,308 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_HOST_H
+#define MUX_HOST_H
+
+/*
+  Host backend for MuxDuino. This provides stand-ins for the parts of
+  the Arduino core that MuxDuino uses so that the library can be
+  built on a regular computer. Pin levels are kept in a bit-packed
+  array in memory, and the host program can drive the inputs and
+  look at the outputs with the mux_host_* functions below.
+
+  None of this is built on an Arduino.
+ */
+
+#ifndef ARDUINO
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+/* Number of pins that the host backend keeps track of */
+#define MUX_HOST_PINS 256
+
+/* Number of pins packed into each word of MuxHostPins.levels */
+#define MUX_HOST_PIN_WORD_BITS ((int) (8 * sizeof(unsigned long)))
+#define MUX_HOST_PIN_WORDS (MUX_HOST_PINS / MUX_HOST_PIN_WORD_BITS)
+
+
+/*
+  The level and mode of every pin. Levels are bit-packed, with pin n
+  in bit n % MUX_HOST_PIN_WORD_BITS of word n / MUX_HOST_PIN_WORD_BITS.
+ */
+
+typedef struct MuxHostPins {
+    unsigned long levels[MUX_HOST_PIN_WORDS];
+    unsigned char modes[MUX_HOST_PINS];
+} MuxHostPins;
+
+
+/* The usual Arduino pin and timing functions */
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+
+int analogRead(int pin);
+void analogWrite(int pin, int value);
+
+unsigned long millis();
+unsigned long micros();
+
+void noInterrupts();
+void interrupts();
+
+
+/*
+  Arguments:
+      us: The time to start the manual clock at, in microseconds.
+
+  Switches millis() and micros() over from the real clock to a manual
+  one, which only moves when the host program says so. This makes
+  anything which depends on timing (such as the scheduler in
+  mux_schedule.h) repeatable in tests.
+
+ */
+
+void mux_host_set_clock(unsigned long us);
+
+
+/*
+  Arguments:
+      us: Microseconds to add to the manual clock on every read.
+
+  Makes the manual clock tick along by itself as it is read, so that
+  anything timed with micros() appears to take this long. 0 by
+  default.
+
+ */
+
+void mux_host_set_clock_step(unsigned long us);
+
+
+/*
+  Arguments:
+      us: Microseconds to move the manual clock forward by.
+
+ */
+
+void mux_host_advance_clock(unsigned long us);
+
+
+/*
+  Arguments:
+      pins: Pins to use from now on, or NULL to go back to the backend's
+	    own. Should start out zeroed.
+
+  Swaps out every pin level and mode at once, so that a program can
+  keep a set of pins for each of several boards (see mux_sim.h). The
+  analog values are still shared.
+
+ */
+
+void mux_host_use_pins(MuxHostPins *pins);
+
+
+/*
+  Arguments:
+      pin: The pin to drive.
+
+      level: HIGH or LOW.
+
+  Sets the level that digitalRead() will see on the pin. This is how
+  the host program provides the inputs.
+
+ */
+
+void mux_host_set_input(int pin, int level);
+
+
+/*
+  Returns the number of calls to mux_host_set_input() so far.
+
+ */
+
+unsigned long mux_host_input_changes();
+
+
+/*
+  Arguments:
+      seen: The value of mux_host_input_changes() that we have
+	    already dealt with.
+
+      timeout: Longest time to wait, in real microseconds.
+
+  Blocks until mux_host_set_input() is called from another thread
+  (or has been since seen), or until the timeout runs out. Returns
+  true if an input was set. This stands in for sleeping until a pin
+  changes, see mux_idle.h. mux_host_set_input() is safe to call from
+  any thread.
+
+ */
+
+bool mux_host_wait_input(unsigned long seen, unsigned long timeout);
+
+
+/*
+  Arguments:
+      pin: The pin we want to look at.
+
+  Returns the current level of the pin, which is the last thing
+  written with digitalWrite() or mux_host_set_input().
+
+ */
+
+int mux_host_get_level(int pin);
+
+
+/* Function called when an output pin changes, see below */
+typedef void (*MuxHostWriteHook)(int pin, int level);
+
+
+/*
+  Arguments:
+      hook: Function to call with the pin and its new level whenever
+	    digitalWrite() changes a pin, or NULL for none.
+
+  Lets the host program see exactly when each output changes, such as
+  for timing how long an input takes to reach an output. The hook is
+  called from inside mux_update(), so it should be quick.
+
+ */
+
+void mux_host_set_write_hook(MuxHostWriteHook hook);
+
+
+/*
+  Arguments:
+      pin: The pin to drive.
+
+      value: Value from 0 to 1023.
+
+  Sets the value that analogRead() will see on the pin.
+
+ */
+
+void mux_host_set_analog(int pin, int value);
+
+
+/*
+  Arguments:
+      pin: The pin we want to look at.
+
+  Returns the last value written to the pin with analogWrite(), or 0
+  if nothing has been written.
+
+ */
+
+int mux_host_get_analog(int pin);
+
+
+/*
+  Arguments:
+      pin: The pin we want to look at.
+
+  Returns the mode last set with pinMode(), INPUT by default.
+
+ */
+
+int mux_host_get_mode(int pin);
+
+
+/*
+  Arguments:
+      name: Name for the shared memory object, starting with a '/'.
+
+  Puts the pins on a shared memory bus (see mux_bus.h), so that other
+  processes can drive the inputs and read the outputs. At the start of
+  every update each pin which isn't an OUTPUT takes its level from the
+  bus, and at the end every pin's level is published. Returns 0 on
+  success, 1 if a bus is already attached, and 2 if the region can't
+  be created.
+
+  While the bus is attached mux_host_set_input() is overridden by the
+  bus on the next update, and mux_host_wait_input() isn't woken by
+  clients, so mux_idle_update() only returns on its timeout.
+
+ */
+
+int mux_host_attach_bus(const char *name);
+
+
+/*
+  Unmaps the bus and removes its name. Clients which still have it
+  mapped keep their mapping, but won't see any more updates.
+
+ */
+
+void mux_host_detach_bus();
+
+
+/*
+  Returns the number of updates which found a client in the middle of
+  writing the inputs, and used the inputs from the update before.
+
+ */
+
+unsigned long mux_host_bus_torn();
+
+
+/*
+  Latch the inputs from the bus, and publish the levels to it. These
+  are called by mux_pins_sample() and mux_pins_flush() on every
+  update, and do nothing if no bus is attached.
+
+ */
+
+void mux_host_bus_sample();
+void mux_host_bus_publish();
+
+
+/*
+  Stand-in for the Arduino Serial object, which just prints to
+  standard output.
+ */
+
+class MuxHostSerial {
+public:
+    void print(const char *str);
+    void print(long value);
+    void println(const char *str);
+    void println(long value);
+    void println();
+};
+
+extern MuxHostSerial Serial;
+
+#endif
+
+#endif
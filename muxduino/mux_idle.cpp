@@ -0,0 +1,371 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_idle.h"
+#include "muxduino.h"
+#include "mux_sample.h"
+#include "mux_analog.h"
+#include "mux_pins.h"
+#include "mux_config.h"
+
+#include "mux_platform.h"
+
+#if defined(ARDUINO) && defined(__AVR__) && MUX_IDLE_PCINT
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#define PIN_CHANGE_WAKE 1
+#else
+#define PIN_CHANGE_WAKE 0
+#endif
+
+/* True if "sleeping" is blocking in mux_host_wait_input() */
+#ifdef ARDUINO
+#define HOST_WAIT 0
+#else
+#define HOST_WAIT 1
+#endif
+
+
+static MuxIdleMode idle_mode = MUX_IDLE_LIGHT;
+
+/* Set once something wakes us, along with when it happened */
+static volatile bool woken = false;
+static volatile unsigned long wake_time = 0;
+
+static unsigned long wakes = 0;
+static unsigned long timeouts = 0;
+static unsigned long asleep = 0;
+static unsigned long last_latency = 0;
+static unsigned long max_latency = 0;
+static unsigned long stats_start = 0;
+static bool stats_started = false;
+
+
+/* Calls fn on every input pin which is read from a pin, stopping if it returns false */
+static bool for_each_input_pin(bool (*fn)(int pin, int slot))
+{
+    MuxWord external[MUX_SAMPLE_WORDS];
+    mux_sample_external(external);
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord slots = external[w];
+
+	while (slots) {
+	    int slot = w * MUX_WORD_BITS + __builtin_ctzl(slots);
+
+	    if (!fn(mux_sample_pin(slot), slot)) {
+		return false;
+	    }
+
+	    slots &= slots - 1;
+	}
+    }
+
+    return true;
+}
+
+
+static bool can_wake(int pin, int)
+{
+#if PIN_CHANGE_WAKE
+    return pin < MUX_EXPANDER_PIN_BASE && 0 != digitalPinToPCICR(pin);
+#else
+    return pin < MUX_EXPANDER_PIN_BASE;
+#endif
+}
+
+
+/* True if the pin still reads the level from the last update */
+static bool unchanged(int pin, int slot)
+{
+    return mux_pin_read(pin) == (MUX_BIT(mux_levels, slot) ? HIGH : LOW);
+}
+
+
+#if PIN_CHANGE_WAKE
+
+static void pin_changed()
+{
+    if (!woken) {
+	woken = true;
+	wake_time = micros();
+    }
+}
+
+
+#ifdef PCINT0_vect
+ISR(PCINT0_vect)
+{
+    pin_changed();
+}
+#endif
+
+#ifdef PCINT1_vect
+ISR(PCINT1_vect)
+{
+    pin_changed();
+}
+#endif
+
+#ifdef PCINT2_vect
+ISR(PCINT2_vect)
+{
+    pin_changed();
+}
+#endif
+
+#ifdef PCINT3_vect
+ISR(PCINT3_vect)
+{
+    pin_changed();
+}
+#endif
+
+
+/*
+  Bits that arming turned on in PCICR and in each PCMSK register, so
+  that only those are turned off again. Pin change interrupts that
+  something else set up are left as they were.
+ */
+static unsigned char groups_armed = 0;
+static unsigned char masks_armed[4];
+static volatile uint8_t *mask_registers[4];
+
+/* Every PCICR bit for a group with one of our pins, armed by us or not */
+static unsigned char groups_used = 0;
+
+
+static bool arm_pin(int pin, int)
+{
+    unsigned char group = digitalPinToPCICRbit(pin);
+    unsigned char bit = _BV(digitalPinToPCMSKbit(pin));
+    volatile uint8_t *mask = digitalPinToPCMSK(pin);
+
+    if (!(*mask & bit)) {
+	*mask |= bit;
+	masks_armed[group] |= bit;
+	mask_registers[group] = mask;
+    }
+
+    if (!(PCICR & _BV(group))) {
+	PCICR |= _BV(group);
+	groups_armed |= _BV(group);
+    }
+
+    groups_used |= _BV(group);
+
+    return true;
+}
+
+
+static void disarm_pins()
+{
+    for (unsigned char group = 0; group < 4; ++group) {
+	if (masks_armed[group]) {
+	    *mask_registers[group] &= ~masks_armed[group];
+	    masks_armed[group] = 0;
+	}
+    }
+
+    PCICR &= ~groups_armed;
+    groups_armed = 0;
+    groups_used = 0;
+}
+
+
+/*
+  Sleep until a pin changes or the timeout runs out. Returns false
+  without sleeping if an input had already changed since the last
+  update.
+ */
+static bool sleep_until_woken(unsigned long timeout)
+{
+    /*
+      Arm first and look second: a change from before arming shows up
+      when the pins are read, and one from after sets woken, so none
+      can fall in between the two.
+     */
+    for_each_input_pin(arm_pin);
+
+    /* Stale flags from before arming would only wake us for nothing */
+    PCIFR = groups_used;
+
+    cli();
+    bool settled = for_each_input_pin(unchanged);
+    sei();
+
+    if (settled) {
+	set_sleep_mode((MUX_IDLE_DEEP == idle_mode) ? SLEEP_MODE_PWR_DOWN : SLEEP_MODE_IDLE);
+
+	unsigned long start = millis();
+
+	while (true) {
+	    cli();
+
+	    if (woken || (MUX_IDLE_DEEP != idle_mode && millis() - start >= timeout)) {
+		sei();
+		break;
+	    }
+
+	    /* The instruction after sei() always runs, so no wake up can be lost */
+	    sleep_enable();
+	    sei();
+	    sleep_cpu();
+	    sleep_disable();
+	}
+    }
+
+    disarm_pins();
+
+    return settled;
+}
+
+#elif !HOST_WAIT
+
+/* No way to sleep on this board, so just watch the pins until one changes */
+static void wait_for_change(unsigned long timeout)
+{
+    unsigned long start = millis();
+
+    while (millis() - start < timeout) {
+	if (!for_each_input_pin(unchanged)) {
+	    woken = true;
+	    wake_time = micros();
+	    return;
+	}
+    }
+}
+
+#endif
+
+
+void mux_set_idle_mode(MuxIdleMode mode)
+{
+    idle_mode = mode;
+}
+
+
+int mux_idle_update(unsigned long timeout)
+{
+    if (!stats_started) {
+	mux_idle_reset_stats();
+    }
+
+    /* Nothing wakes us when an analog input moves, so those need updating */
+    if (!mux_sample_settled() || 0 != mux_analog_num_pipes()
+	|| !for_each_input_pin(can_wake)) {
+	mux_update();
+	return 2;
+    }
+
+    woken = false;
+
+#if HOST_WAIT
+    unsigned long seen = mux_host_input_changes();
+#endif
+
+    unsigned long sleep_start = micros();
+
+#if PIN_CHANGE_WAKE
+    bool slept = sleep_until_woken(timeout);
+#else
+    bool slept = for_each_input_pin(unchanged);
+
+    if (slept) {
+#if HOST_WAIT
+	if (mux_host_wait_input(seen, timeout * 1000)) {
+	    woken = true;
+	    wake_time = micros();
+	}
+#else
+	wait_for_change(timeout);
+#endif
+    }
+#endif
+
+    if (!slept) {
+	/* Something changed since the last update, no sense sleeping */
+	woken = true;
+	wake_time = sleep_start;
+    }
+    else if (MUX_IDLE_DEEP != idle_mode || !PIN_CHANGE_WAKE) {
+	asleep += micros() - sleep_start;
+    }
+
+    mux_update();
+
+    if (!woken) {
+	++timeouts;
+	return 1;
+    }
+
+    last_latency = micros() - wake_time;
+
+    if (last_latency > max_latency) {
+	max_latency = last_latency;
+    }
+
+    ++wakes;
+    return 0;
+}
+
+
+void mux_idle_stats(MuxIdleStats *stats)
+{
+    stats->wakes = wakes;
+    stats->timeouts = timeouts;
+    stats->asleep = asleep;
+    stats->total = micros() - stats_start;
+    stats->last_latency = last_latency;
+    stats->max_latency = max_latency;
+}
+
+
+unsigned int mux_idle_asleep_permille()
+{
+    unsigned long total = micros() - stats_start;
+
+    if (total < 1000) {
+	return 0;
+    }
+
+    /* Scale the total down rather than the time asleep up, so nothing overflows */
+    unsigned long permille = asleep / (total / 1000);
+
+    return (permille > 1000) ? 1000 : permille;
+}
+
+
+void mux_idle_reset_stats()
+{
+    wakes = 0;
+    timeouts = 0;
+    asleep = 0;
+    last_latency = 0;
+    max_latency = 0;
+    stats_start = micros();
+    stats_started = true;
+}
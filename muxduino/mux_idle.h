@@ -0,0 +1,159 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_IDLE_H
+#define MUX_IDLE_H
+
+/*
+  Sleeping while the inputs are quiet. Calling mux_update() over and
+  over from loop() keeps the CPU busy even when the inputs only change
+  a few times a minute. mux_idle_update() instead sleeps until one of
+  the input pins changes (or a timeout runs out), and then runs a
+  single update.
+
+  With MUX_IDLE_PCINT set to 1 in mux_config.h, AVR boards arm a pin
+  change interrupt for every input pin and put the MCU to sleep. This
+  defines the PCINT interrupt vectors, so it can't be linked along
+  with anything else that defines them (such as SoftwareSerial), and
+  is off unless asked for. On the host build it blocks in
+  mux_host_wait_input() until another thread sets an input. Other
+  boards, and AVR boards without MUX_IDLE_PCINT, don't sleep: they
+  just watch the pins until one changes, which still saves running
+  updates that do nothing.
+
+  Sleeping only works if every input pin can wake us up. Pins on
+  expanders (see mux_pins.h), and on AVR pins without a pin change
+  interrupt, can't, and neither can analog inputs, so we never sleep
+  while an analog pipe is registered. Anything that
+  counts updates (debounce filters, delays and stretches, schedules
+  and rate dividers) only moves along when an update runs, so use a
+  timeout if those need to keep time while the inputs are quiet. We
+  never sleep while a debounce filter is still counting.
+ */
+
+
+/*
+  How deeply to sleep.
+
+      MUX_IDLE_LIGHT: The CPU stops but the clocks keep going, so the
+		      timeout works and the time spent asleep is
+		      measured. This is the default.
+
+      MUX_IDLE_DEEP: On AVR boards with MUX_IDLE_PCINT, power down. Only a pin change can
+		     wake the MCU, so the timeout is ignored, and since
+		     millis() and micros() stop while asleep the time
+		     spent asleep isn't counted. Elsewhere this is the
+		     same as MUX_IDLE_LIGHT.
+ */
+
+typedef enum MuxIdleMode {
+    MUX_IDLE_LIGHT = 0,
+    MUX_IDLE_DEEP = 1
+} MuxIdleMode;
+
+
+/*
+  Statistics for idling.
+
+  Fields:
+      wakes: Number of times we were woken by an input.
+
+      timeouts: Number of times the timeout ran out first.
+
+      asleep: Microseconds spent asleep (or watching the pins, on
+	      boards that can't sleep).
+
+      total: Microseconds since the statistics were reset.
+
+      last_latency: Microseconds from the last wake until its update
+		    had written the outputs.
+
+      max_latency: Longest latency seen.
+ */
+
+typedef struct MuxIdleStats {
+    unsigned long wakes;
+    unsigned long timeouts;
+    unsigned long asleep;
+    unsigned long total;
+    unsigned long last_latency;
+    unsigned long max_latency;
+} MuxIdleStats;
+
+
+/*
+  Arguments:
+      timeout: Longest time to sleep for, in milliseconds.
+
+  Sleeps until an input pin changes or the timeout runs out, and then
+  runs mux_update(). Returns:
+
+      0: Woken by an input.
+      1: The timeout ran out.
+      2: We couldn't sleep, because an input can't wake us up, a
+	 filter is still counting, or an analog pipe is registered.
+	 The update is still run.
+
+ */
+
+int mux_idle_update(unsigned long timeout);
+
+
+/*
+  Arguments:
+      mode: How deeply to sleep, see MuxIdleMode.
+
+ */
+
+void mux_set_idle_mode(MuxIdleMode mode);
+
+
+/*
+  Arguments:
+      stats: Filled in with the statistics.
+
+ */
+
+void mux_idle_stats(MuxIdleStats *stats);
+
+
+/*
+  Returns the fraction of the time since the statistics were reset
+  that was spent asleep, in thousandths.
+
+ */
+
+unsigned int mux_idle_asleep_permille();
+
+
+/*
+  Resets the statistics.
+
+ */
+
+void mux_idle_reset_stats();
+
+#endif
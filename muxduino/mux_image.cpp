@@ -0,0 +1,547 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_image.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_state.h"
+#include "mux_pins.h"
+#include "mux_cascade.h"
+#include "mux_sample.h"
+#include "mem_alloc.h"
+#include "muxduino.h"
+
+#include "mux_platform.h"
+
+#ifdef ARDUINO
+#include <EEPROM.h>
+#else
+#include <stdio.h>
+#endif
+
+
+/* Size of the header and trailer, and of each kind of record */
+#define HEADER_SIZE 14
+#define TRAILER_SIZE 2
+#define OUTPUT_RECORD_SIZE 6
+#define CHANNEL_RECORD_SIZE 6
+#define INPUT_RECORD_SIZE 2
+
+/* Flags in the header */
+#define IMAGE_CASCADE 0x01
+
+
+/*
+  Position in an image that is being read or written, along with the
+  running Fletcher-16 sums of every byte that has gone by.
+ */
+
+typedef struct ImageCursor {
+    MuxImageRead read;
+    MuxImageWrite write;
+    void *ctx;
+
+    unsigned int address;
+    unsigned int sum1;
+    unsigned int sum2;
+} ImageCursor;
+
+
+static void cursor_init(ImageCursor *cursor, void *ctx)
+{
+    cursor->read = NULL;
+    cursor->write = NULL;
+    cursor->ctx = ctx;
+
+    cursor->address = 0;
+    cursor->sum1 = 0;
+    cursor->sum2 = 0;
+}
+
+
+static void add_to_checksum(ImageCursor *cursor, unsigned char value)
+{
+    cursor->sum1 = (cursor->sum1 + value) % 255;
+    cursor->sum2 = (cursor->sum2 + cursor->sum1) % 255;
+}
+
+
+static unsigned int checksum(ImageCursor *cursor)
+{
+    return (cursor->sum2 << 8) | cursor->sum1;
+}
+
+
+static unsigned char read_byte(ImageCursor *cursor)
+{
+    unsigned char value = cursor->read(cursor->ctx, cursor->address++);
+
+    add_to_checksum(cursor, value);
+    return value;
+}
+
+
+static unsigned int read_u16(ImageCursor *cursor)
+{
+    unsigned int low = read_byte(cursor);
+
+    return low | ((unsigned int) read_byte(cursor) << 8);
+}
+
+
+static void write_byte(ImageCursor *cursor, unsigned char value)
+{
+    cursor->write(cursor->ctx, cursor->address++, value);
+    add_to_checksum(cursor, value);
+}
+
+
+static void write_u16(ImageCursor *cursor, unsigned int value)
+{
+    write_byte(cursor, value & 0xFF);
+    write_byte(cursor, (value >> 8) & 0xFF);
+}
+
+
+/* Counts of everything in the topology, which go in the header */
+typedef struct ImageCounts {
+    unsigned int outputs;
+    unsigned int channels;
+    unsigned int inputs;
+} ImageCounts;
+
+
+static void count_topology(ImageCounts *counts)
+{
+    counts->outputs = 0;
+    counts->channels = 0;
+    counts->inputs = 0;
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	++counts->outputs;
+
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    ++counts->channels;
+
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		++counts->inputs;
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+static unsigned long body_size(const ImageCounts *counts)
+{
+    return (unsigned long) counts->outputs * OUTPUT_RECORD_SIZE
+	+ (unsigned long) counts->channels * CHANNEL_RECORD_SIZE
+	+ (unsigned long) counts->inputs * INPUT_RECORD_SIZE;
+}
+
+
+unsigned int mux_image_size()
+{
+    ImageCounts counts;
+    count_topology(&counts);
+
+    return HEADER_SIZE + body_size(&counts) + TRAILER_SIZE;
+}
+
+
+int mux_save_image(MuxImageWrite write, void *ctx, unsigned int max_len)
+{
+    ImageCounts counts;
+    count_topology(&counts);
+
+    unsigned long body_len = body_size(&counts);
+    if (body_len > 0xFFFF || HEADER_SIZE + body_len + TRAILER_SIZE > max_len) {
+	return 1;
+    }
+
+    ImageCursor cursor;
+    cursor_init(&cursor, ctx);
+    cursor.write = write;
+
+    write_byte(&cursor, 'M');
+    write_byte(&cursor, 'X');
+    write_byte(&cursor, 'I');
+    write_byte(&cursor, 'M');
+    write_byte(&cursor, MUX_IMAGE_VERSION);
+    write_byte(&cursor, mux_cascade_enabled() ? IMAGE_CASCADE : 0);
+    write_u16(&cursor, counts.outputs);
+    write_u16(&cursor, counts.channels);
+    write_u16(&cursor, counts.inputs);
+    write_u16(&cursor, body_len);
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	unsigned int num_channels = 0;
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    ++num_channels;
+	    channel_node = channel_node->next;
+	}
+
+	write_u16(&cursor, out_node->out_pin);
+	write_u16(&cursor, out_node->channel_num);
+	write_u16(&cursor, num_channels);
+
+	channel_node = out_node->channels.head;
+	while (channel_node) {
+	    unsigned int num_inputs = 0;
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		++num_inputs;
+		in_node = in_node->next;
+	    }
+
+	    write_u16(&cursor, channel_node->channel);
+	    write_u16(&cursor, num_inputs);
+	    write_u16(&cursor, channel_node->combine | (channel_node->priority_bit << 8));
+
+	    in_node = channel_node->inputs.head;
+	    while (in_node) {
+		write_u16(&cursor, in_node->in_pin);
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+
+    /* The checksum itself is not part of the sum */
+    unsigned int sum = checksum(&cursor);
+    write_u16(&cursor, sum);
+
+    return 0;
+}
+
+
+/* Adds the pin to the distinct pins seen so far, false if there is no room for it */
+static bool note_input(int *pins, unsigned int *num_pins, int pin)
+{
+    for (unsigned int i = 0; i < *num_pins; ++i) {
+	if (pin == pins[i]) {
+	    return true;
+	}
+    }
+
+    if (*num_pins >= MUX_MAX_INPUTS) {
+	return false;
+    }
+
+    pins[(*num_pins)++] = pin;
+    return true;
+}
+
+
+/* Image values are 16 bit, channels are signed */
+static int to_channel(unsigned int value)
+{
+    return (int) (short) value;
+}
+
+
+int mux_load_image(MuxImageRead read, void *ctx, unsigned int len)
+{
+    ImageCursor cursor;
+    cursor_init(&cursor, ctx);
+    cursor.read = read;
+
+    if (len < HEADER_SIZE + TRAILER_SIZE) {
+	return 3;
+    }
+
+    if ('M' != read_byte(&cursor) || 'X' != read_byte(&cursor)
+	|| 'I' != read_byte(&cursor) || 'M' != read_byte(&cursor)) {
+	return 1;
+    }
+
+    if (MUX_IMAGE_VERSION != read_byte(&cursor)) {
+	return 2;
+    }
+
+    unsigned char flags = read_byte(&cursor);
+
+    ImageCounts counts;
+    counts.outputs = read_u16(&cursor);
+    counts.channels = read_u16(&cursor);
+    counts.inputs = read_u16(&cursor);
+    unsigned long body_len = read_u16(&cursor);
+
+    if (HEADER_SIZE + body_len + TRAILER_SIZE > len) {
+	return 3;
+    }
+
+    if (body_len != body_size(&counts)) {
+	return 4;
+    }
+
+    /*
+      First pass: make sure that the records add up to the counts in
+      the header, and that the checksum is right. Nothing is changed
+      until this passes.
+     */
+
+    unsigned int seen_channels = 0;
+    unsigned int seen_inputs = 0;
+
+    /* Every distinct input needs a sampler slot, just as in register_pipe() */
+    int pins[MUX_MAX_INPUTS];
+    unsigned int num_pins = 0;
+
+    for (unsigned int i = 0; i < counts.outputs; ++i) {
+	read_u16(&cursor);
+	read_u16(&cursor);
+	unsigned int num_channels = read_u16(&cursor);
+
+	if (0 == num_channels || num_channels > counts.channels - seen_channels) {
+	    return 4;
+	}
+
+	seen_channels += num_channels;
+
+	for (unsigned int j = 0; j < num_channels; ++j) {
+	    read_u16(&cursor);
+	    unsigned int num_inputs = read_u16(&cursor);
+	    unsigned int combine = read_u16(&cursor);
+
+	    if (0 == num_inputs || num_inputs > counts.inputs - seen_inputs) {
+		return 4;
+	    }
+
+	    if ((combine & 0xFF) > MUX_COMBINE_PRIORITY || (combine >> 8) > 7) {
+		return 4;
+	    }
+
+	    seen_inputs += num_inputs;
+
+	    for (unsigned int k = 0; k < num_inputs; ++k) {
+		if (!note_input(pins, &num_pins, read_u16(&cursor))) {
+		    return 4;
+		}
+	    }
+	}
+    }
+
+    if (seen_channels != counts.channels || seen_inputs != counts.inputs) {
+	return 4;
+    }
+
+    unsigned int sum = checksum(&cursor);
+    if (sum != read_u16(&cursor)) {
+	return 5;
+    }
+
+    /*
+      Second pass: throw out the old digital pipes and build the new
+      ones straight from the records, out of one chunk of memory. The
+      analog pipes are not in the image, so they are left alone.
+     */
+
+    mux_output_list_clear(&mux_outs);
+    mux_set_cascade(flags & IMAGE_CASCADE);
+
+    size_t total = counts.outputs * reserved_size(sizeof(MuxOutputNode))
+	+ counts.channels * reserved_size(sizeof(MuxChannelNode))
+	+ counts.inputs * reserved_size(sizeof(MuxInputNode));
+
+    if (0 != total) {
+	reserve_memory(total);
+    }
+
+    cursor.address = HEADER_SIZE;
+
+    for (unsigned int i = 0; i < counts.outputs; ++i) {
+	int out_pin = read_u16(&cursor);
+	int channel_num = to_channel(read_u16(&cursor));
+	unsigned int num_channels = read_u16(&cursor);
+
+	MuxOutputNode *out_node = mux_output_list_append(&mux_outs, out_pin, channel_num);
+
+	for (unsigned int j = 0; j < num_channels; ++j) {
+	    int channel = to_channel(read_u16(&cursor));
+	    unsigned int num_inputs = read_u16(&cursor);
+	    unsigned int combine = read_u16(&cursor);
+
+	    MuxChannelNode *channel_node = mux_channel_list_append(&out_node->channels, channel);
+	    channel_node->combine = combine & 0xFF;
+	    channel_node->priority_bit = combine >> 8;
+
+	    if (channel == channel_num) {
+		out_node->current_channel = channel_node;
+	    }
+
+	    for (unsigned int k = 0; k < num_inputs; ++k) {
+		int in_pin = read_u16(&cursor);
+
+		mux_input_list_append(&channel_node->inputs, in_pin);
+		mux_pin_mode(in_pin, INPUT);
+	    }
+	}
+    }
+
+    /* Outputs last, since with cascading an output may also be an input */
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	mux_pin_mode(out_node->out_pin, OUTPUT);
+	out_node = out_node->next;
+    }
+
+    mux_topology_changed();
+
+    return 0;
+}
+
+
+static unsigned char read_buffer(void *ctx, unsigned int address)
+{
+    return ((const unsigned char *) ctx)[address];
+}
+
+
+static void write_buffer(void *ctx, unsigned int address, unsigned char value)
+{
+    ((unsigned char *) ctx)[address] = value;
+}
+
+
+int mux_save_image_buffer(unsigned char *buffer, unsigned int len)
+{
+    return mux_save_image(write_buffer, buffer, len);
+}
+
+
+int mux_load_image_buffer(const unsigned char *buffer, unsigned int len)
+{
+    return mux_load_image(read_buffer, (void *) buffer, len);
+}
+
+
+#ifdef ARDUINO
+
+/* For the EEPROM the context is the address the image starts at */
+static unsigned char read_eeprom(void *ctx, unsigned int address)
+{
+    return EEPROM.read(*(unsigned int *) ctx + address);
+}
+
+
+static void write_eeprom(void *ctx, unsigned int address, unsigned char value)
+{
+    EEPROM.update(*(unsigned int *) ctx + address, value);
+}
+
+
+int mux_save_eeprom(unsigned int address)
+{
+    if (address >= EEPROM.length()) {
+	return 1;
+    }
+
+    return mux_save_image(write_eeprom, &address, EEPROM.length() - address);
+}
+
+
+int mux_load_eeprom(unsigned int address)
+{
+    if (address >= EEPROM.length()) {
+	return 3;
+    }
+
+    return mux_load_image(read_eeprom, &address, EEPROM.length() - address);
+}
+
+#else
+
+int mux_save_file(const char *path)
+{
+    unsigned int len = mux_image_size();
+    unsigned char *buffer = (unsigned char *) malloc(len);
+
+    if (NULL == buffer) {
+	return 6;
+    }
+
+    int result = mux_save_image_buffer(buffer, len);
+
+    if (0 != result) {
+	free(buffer);
+	return result;
+    }
+
+    FILE *file = fopen(path, "wb");
+
+    if (NULL == file || fwrite(buffer, 1, len, file) != len) {
+	result = 6;
+    }
+
+    if (NULL != file && 0 != fclose(file)) {
+	result = 6;
+    }
+
+    free(buffer);
+    return result;
+}
+
+
+int mux_load_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+
+    if (NULL == file) {
+	return 6;
+    }
+
+    /* Images are never bigger than the 16 bit body length allows */
+    unsigned int max_len = HEADER_SIZE + 0xFFFF + TRAILER_SIZE;
+    unsigned char *buffer = (unsigned char *) malloc(max_len);
+
+    if (NULL == buffer) {
+	fclose(file);
+	return 6;
+    }
+
+    unsigned int len = fread(buffer, 1, max_len, file);
+    int result = ferror(file) ? 6 : mux_load_image_buffer(buffer, len);
+
+    fclose(file);
+    free(buffer);
+
+    return result;
+}
+
+#endif
@@ -0,0 +1,172 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_IMAGE_H
+#define MUX_IMAGE_H
+
+/*
+  Binary images of the MuxDuino topology. An image holds every
+  registered pipe along with the currently selected channel of each
+  output, so that a sketch can save its network once and restore it
+  on the next boot without replaying all of the register_pipe() calls.
+
+  The image is a small header followed by the outputs, their channels
+  and their inputs in list order, and finally a checksum. All values
+  are 16 bit little endian:
+
+      header:  'M' 'X' 'I' 'M', version, flags,
+	       output count, channel count, input count, body length
+
+      output:  out_pin, channel_num, channel count
+      channel: channel, input count, combine + 256 * priority_bit,
+	       in_pin...
+
+      trailer: Fletcher-16 checksum of everything before it
+
+  The version and flags are single bytes. The only flag is bit 0,
+  which is set if cascading was turned on (see mux_cascade.h).
+
+  Only the digital pipes are stored. Analog pipes (see mux_analog.h)
+  are neither saved nor touched by loading an image.
+
+  Since the topology was validated when it was first registered,
+  loading an image skips the checks that register_pipe() does. The
+  checksum and the counts in the header are what protect us from a
+  corrupt image.
+ */
+
+#include <stddef.h>
+
+
+/* Version of the image format written by mux_save_image() */
+#define MUX_IMAGE_VERSION 2
+
+
+/*
+  Callbacks for reading and writing one byte of an image. The address
+  is relative to the start of the image, and ctx is passed through
+  untouched from mux_save_image() / mux_load_image().
+ */
+
+typedef unsigned char (*MuxImageRead)(void *ctx, unsigned int address);
+typedef void (*MuxImageWrite)(void *ctx, unsigned int address, unsigned char value);
+
+
+/*
+  Returns the size in bytes of an image of the current topology.
+
+ */
+
+unsigned int mux_image_size();
+
+
+/*
+  Arguments:
+      write: Callback used to store each byte of the image.
+
+      ctx: Passed along to the callback.
+
+      max_len: Number of bytes available for the image.
+
+  Writes an image of the current topology. Returns 0 on success, or 1
+  if the image does not fit in max_len bytes (nothing is written in
+  that case).
+
+ */
+
+int mux_save_image(MuxImageWrite write, void *ctx, unsigned int max_len);
+
+
+/*
+  Arguments:
+      read: Callback used to fetch each byte of the image.
+
+      ctx: Passed along to the callback.
+
+      len: Number of bytes available to read.
+
+  Replaces the digital pipes with the ones in the image. The whole
+  image is checked before anything is changed, so on failure the old
+  topology is left alone. The nodes are all built in one pass from a
+  single allocation, and the pin modes are set as in register_pipe().
+
+  Returns 0 on success, otherwise:
+
+      1: The image does not start with the right magic number.
+      2: The image was written by a different version of the format.
+      3: The image is longer than len.
+      4: The counts in the image do not match its contents, or it
+	 has more than MUX_MAX_INPUTS distinct input pins (the same
+	 limit that register_pipe() returns 4 for).
+      5: The checksum does not match.
+
+ */
+
+int mux_load_image(MuxImageRead read, void *ctx, unsigned int len);
+
+
+/*
+  Convenience functions for images held in a RAM buffer. These return
+  the same values as mux_save_image() and mux_load_image().
+
+ */
+
+int mux_save_image_buffer(unsigned char *buffer, unsigned int len);
+int mux_load_image_buffer(const unsigned char *buffer, unsigned int len);
+
+
+#ifdef ARDUINO
+
+/*
+  Arguments:
+      address: EEPROM address where the image starts.
+
+  Save or load the image in the EEPROM. Saving only writes the bytes
+  that have changed, to go easy on the EEPROM. These return the same
+  values as mux_save_image() and mux_load_image().
+
+ */
+
+int mux_save_eeprom(unsigned int address);
+int mux_load_eeprom(unsigned int address);
+
+#else
+
+/*
+  Arguments:
+      path: The file to save to or load from.
+
+  Host build only. Save or load the image as a file. These return the
+  same values as mux_save_image() and mux_load_image(), and 6 if the
+  file could not be opened, read, or written.
+
+ */
+
+int mux_save_file(const char *path);
+int mux_load_file(const char *path);
+
+#endif
+
+#endif
@@ -32,12 +32,31 @@ static MuxInputNode * create_input_node(int in_pin)
     MuxInputNode *node = (MuxInputNode *) allocate_memory(sizeof(MuxInputNode));
 
     node->in_pin = in_pin;
+    node->slot = -1;
+    node->transform = NULL;
+    node->marked = false;
+
+#if MUX_STATS
+    node->wins = 0;
+#endif
+
     node->next = NULL;
 
     return node;
 }
 
 
+/* Free an input node along with its transform */
+static void destroy_input_node(MuxInputNode *node)
+{
+    if (node->transform) {
+	free_memory(node->transform);
+    }
+
+    free_memory(node);
+}
+
+
 /* Find the input node for the in_pin. Returns NULL if it is not in the list */
 MuxInputNode * find_input_node(MuxInputList *list, int in_pin)
 {
@@ -77,6 +96,21 @@ void mux_input_list_add(MuxInputList *list, int in_pin)
 }
 
 
+void mux_input_list_append(MuxInputList *list, int in_pin)
+{
+    MuxInputNode *node = create_input_node(in_pin);
+
+    if (NULL == list->head) {
+	list->head = node;
+    }
+    else {
+	list->tail->next = node;
+    }
+
+    list->tail = node;
+}
+
+
 void mux_input_list_remove(MuxInputList *list, int in_pin)
 {
     MuxInputNode *current_node = list->head;
@@ -101,7 +135,7 @@ void mux_input_list_remove(MuxInputList *list, int in_pin)
 		list->tail = previous_node;
 	    }
 
-	    free_memory(current_node);
+	    destroy_input_node(current_node);
 	    return;
 	}
 
@@ -109,3 +143,52 @@ void mux_input_list_remove(MuxInputList *list, int in_pin)
 	current_node = current_node->next;
     }
 }
+
+
+void mux_input_list_clear(MuxInputList *list)
+{
+    MuxInputNode *current_node = list->head;
+
+    while (NULL != current_node) {
+	MuxInputNode *next_node = current_node->next;
+
+	destroy_input_node(current_node);
+	current_node = next_node;
+    }
+
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+
+void mux_input_list_sweep(MuxInputList *list)
+{
+    MuxInputNode *current_node = list->head;
+    MuxInputNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	MuxInputNode *next_node = current_node->next;
+
+	if (current_node->marked) {
+	    current_node->marked = false;
+	    previous_node = current_node;
+	}
+	else {
+	    if (NULL != previous_node) {
+		previous_node->next = next_node;
+	    }
+
+	    if (current_node == list->head) {
+		list->head = next_node;
+	    }
+
+	    if (current_node == list->tail) {
+		list->tail = previous_node;
+	    }
+
+	    destroy_input_node(current_node);
+	}
+
+	current_node = next_node;
+    }
+}
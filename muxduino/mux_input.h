@@ -25,12 +25,30 @@
 #ifndef MUX_INPUT_H
 #define MUX_INPUT_H
 
+#include <stdint.h>
+
+#include "mux_config.h"
+
 /*
-  Nodes for a singly linked list of inputs.
+  Nodes for a singly linked list of inputs. The slot is where the
+  input's level is kept in the sampled bit arrays (see mux_sample.h),
+  or -1 if it has not been given one. The transform is the running
+  state of the pipe's transform (see mux_transform.h), or NULL if the
+  input is passed straight through. With MUX_STATS, wins counts the
+  updates where the input helped make its channel HIGH (see
+  mux_stats.h). marked is only set while mux_apply_topology() is
+  working out which pipes to keep (see mux_apply.h).
  */
 
 typedef struct MuxInputNode {
     int in_pin;
+    int slot;
+    struct MuxTransformState *transform;
+    bool marked;
+
+#if MUX_STATS
+    uint32_t wins;
+#endif
 
     struct MuxInputNode *next;
 } MuxInputNode;
@@ -89,4 +107,42 @@ void mux_input_list_add(MuxInputList *list, int in_pin);
 void mux_input_list_remove(MuxInputList *list, int in_pin);
 
 
+/*
+  Arguments:
+      list: The input list that we want to empty.
+
+  Frees every node in the list, leaving it empty.
+
+ */
+
+void mux_input_list_clear(MuxInputList *list);
+
+
+/*
+  Arguments:
+      list: The input list that we are adding to.
+
+      in_pin: The input pin we want to add.
+
+  Adds the input pin to the end of the list without checking for
+  duplicates. This is for building lists which are already known to
+  be valid, use mux_input_list_add() otherwise.
+
+ */
+
+void mux_input_list_append(MuxInputList *list, int in_pin);
+
+
+/*
+  Arguments:
+      list: The input list to sweep.
+
+  Frees every input which isn't marked, and clears the mark on the
+  rest.
+
+ */
+
+void mux_input_list_sweep(MuxInputList *list);
+
+
 #endif
@@ -0,0 +1,139 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_lut.h"
+#include "mem_alloc.h"
+
+#include "mux_platform.h"
+
+
+/* Index of the highest set bit in a non-zero word */
+static int highest_bit(MuxWord word)
+{
+    return 8 * sizeof(unsigned long) - 1 - __builtin_clzl(word);
+}
+
+
+/* Pull width bits out of the words, starting at slot start */
+static unsigned int window_bits(const MuxWord *levels, unsigned char start, unsigned char width)
+{
+    int w = start / MUX_WORD_BITS;
+    int shift = start % MUX_WORD_BITS;
+    MuxWord window = levels[w] >> shift;
+
+    /* The window might carry on into the next word */
+    if (shift + width > MUX_WORD_BITS) {
+	window |= levels[w + 1] << (MUX_WORD_BITS - shift);
+    }
+
+    return window & ((1U << width) - 1);
+}
+
+
+void mux_lut_free(MuxChannelNode *node)
+{
+    if (node->lut) {
+	free_memory(node->lut);
+	node->lut = NULL;
+    }
+}
+
+
+void mux_lut_compile(MuxChannelNode *node)
+{
+    mux_lut_free(node);
+
+    if (0 == node->num_inputs || node->num_transforms) {
+	return;
+    }
+
+    /* Find the lowest and highest slots on the channel */
+    int low = -1;
+    int high = -1;
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord mask = node->mask[w];
+
+	if (mask) {
+	    if (low < 0) {
+		low = w * MUX_WORD_BITS + __builtin_ctzl(mask);
+	    }
+
+	    high = w * MUX_WORD_BITS + highest_bit(mask);
+	}
+    }
+
+    int width = high - low + 1;
+
+    if (width > MUX_LUT_MAX_WIDTH) {
+	return;
+    }
+
+    unsigned int entries = 1U << width;
+    unsigned int bytes = (entries + 7) / 8;
+    MuxLut *lut = (MuxLut *) allocate_memory(sizeof(MuxLut) + bytes - 1);
+
+    if (NULL == lut) {
+	return;
+    }
+
+    lut->start = low;
+    lut->width = width;
+
+    for (unsigned int i = 0; i < bytes; ++i) {
+	lut->bits[i] = 0;
+    }
+
+    /* Try every combination of the window */
+    for (unsigned int index = 0; index < entries; ++index) {
+	MuxWord levels[MUX_SAMPLE_WORDS];
+
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    levels[w] = 0;
+	}
+
+	for (int bit = 0; bit < width; ++bit) {
+	    if (index & (1U << bit)) {
+		int slot = low + bit;
+		levels[slot / MUX_WORD_BITS] |= (MuxWord) 1 << (slot % MUX_WORD_BITS);
+	    }
+	}
+
+	if (HIGH == mux_channel_level(node, levels)) {
+	    lut->bits[index / 8] |= 1 << (index % 8);
+	}
+    }
+
+    node->lut = lut;
+}
+
+
+int mux_lut_level(const MuxLut *lut, const MuxWord *levels)
+{
+    unsigned int index = window_bits(levels, lut->start, lut->width);
+
+    return ((lut->bits[index / 8] >> (index % 8)) & 1) ? HIGH : LOW;
+}
@@ -0,0 +1,112 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_LUT_H
+#define MUX_LUT_H
+
+/*
+  Lookup tables for channels. When all of a channel's inputs sit in a
+  window of at most MUX_LUT_MAX_WIDTH neighbouring slots, its level is
+  a function of just those few bits. The channel can then be compiled
+  into a table with one bit for every combination of the window, and
+  evaluating it is a shift to pull the window out of the sampled
+  levels and a single table load.
+
+  The table is built by evaluating the channel's combine function on
+  every combination, so it works for every combine function. Channels
+  whose inputs don't fit in a window, or which have transforms (see
+  mux_transform.h), are evaluated the usual way.
+
+  Slots are handed out lowest first in the order that pins are first
+  registered, so the inputs of a channel end up in neighbouring slots
+  when they are registered together.
+ */
+
+#include "mux_channel.h"
+#include "mux_sample.h"
+
+
+/* Most slots in a window */
+#define MUX_LUT_MAX_WIDTH 8
+
+
+/*
+  A compiled channel.
+
+  Fields:
+      start: The lowest slot of the window.
+
+      width: Number of slots in the window.
+
+      bits: Bit n is the level of the channel when the window holds
+	    n. This is allocated along with the rest of the table, with
+	    room for 2^width bits.
+ */
+
+typedef struct MuxLut {
+    unsigned char start;
+    unsigned char width;
+    unsigned char bits[1];
+} MuxLut;
+
+
+/*
+  Arguments:
+      node: The channel to compile.
+
+  Builds the channel's table, replacing any it had before, or frees
+  it if the channel can't be compiled. The channel's mask must be up
+  to date (see mux_channel_compile()).
+
+ */
+
+void mux_lut_compile(MuxChannelNode *node);
+
+
+/*
+  Arguments:
+      node: The channel whose table should go.
+
+  Frees the channel's table, if it has one.
+
+ */
+
+void mux_lut_free(MuxChannelNode *node);
+
+
+/*
+  Arguments:
+      lut: A compiled channel.
+
+      levels: Sampled levels of the inputs, one bit per slot.
+
+  Returns the level of the channel, HIGH or LOW.
+
+ */
+
+int mux_lut_level(const MuxLut *lut, const MuxWord *levels);
+
+#endif
@@ -42,12 +42,59 @@ static MuxOutputNode * create_output_node(MuxPipe pipe)
     mux_channel_list_add(&node->channels, pipe);
 
     node->current_channel = node->channels.head;
+    node->level = -1;
+    node->slot = -1;
+    node->stage = 0;
+    node->transformed = false;
+    node->divider = 1;
+    node->countdown = 1;
+    node->tdm = NULL;
+    node->use_lut = false;
+
+#if MUX_STATS
+    node->toggles = 0;
+#endif
+
     node->next = NULL;
 
     return node;
 }
 
 
+/* Free a node along with its TDM schedule, its channels must already be gone */
+static void free_output_node(MuxOutputNode *node)
+{
+    if (node->tdm) {
+	free_memory(node->tdm);
+    }
+
+    free_memory(node);
+}
+
+
+/* Unlink a node from the list given its predecessor, and free it */
+static void destroy_output_node(MuxOutputList *list,
+				MuxOutputNode *previous_node,
+				MuxOutputNode *node)
+{
+    if (NULL != previous_node) {
+	previous_node->next = node->next;
+    }
+
+    /* Adjust the head and tail if necessary */
+    if (node == list->head) {
+	list->head = node->next;
+    }
+
+    if (node == list->tail) {
+	list->tail = previous_node;
+    }
+
+    mux_channel_list_clear(&node->channels);
+    free_output_node(node);
+}
+
+
 /* Find an output node in a list, returns NULL if not found. */
 MuxOutputNode * find_output_node(MuxOutputList *list, int out_pin)
 {
@@ -65,6 +112,45 @@ MuxOutputNode * find_output_node(MuxOutputList *list, int out_pin)
 }
 
 
+MuxOutputNode * mux_output_list_append(MuxOutputList *list, int out_pin, int channel_num)
+{
+    MuxOutputNode *node = (MuxOutputNode *) allocate_memory(sizeof(MuxOutputNode));
+
+    node->out_pin = out_pin;
+    node->channel_num = channel_num;
+
+    node->channels.head = NULL;
+    node->channels.tail = NULL;
+
+    node->current_channel = NULL;
+    node->level = -1;
+    node->slot = -1;
+    node->stage = 0;
+    node->transformed = false;
+    node->divider = 1;
+    node->countdown = 1;
+    node->tdm = NULL;
+    node->use_lut = false;
+
+#if MUX_STATS
+    node->toggles = 0;
+#endif
+
+    node->next = NULL;
+
+    if (NULL == list->head) {
+	list->head = node;
+    }
+    else {
+	list->tail->next = node;
+    }
+
+    list->tail = node;
+
+    return node;
+}
+
+
 void mux_output_list_add(MuxOutputList *list, MuxPipe pipe)
 {
     if (NULL == list->head) {
@@ -129,7 +215,7 @@ void mux_output_list_remove(MuxOutputList *list, MuxPipe pipe)
 		    list->tail = previous_node;
 		}
 
-		free_memory(current_node);
+		free_output_node(current_node);
 	    }
 
 	    return;
@@ -139,3 +225,114 @@ void mux_output_list_remove(MuxOutputList *list, MuxPipe pipe)
 	current_node = current_node->next;
     }
 }
+
+
+void mux_output_list_remove_output(MuxOutputList *list, int out_pin)
+{
+    MuxOutputNode *current_node = list->head;
+    MuxOutputNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	if (current_node->out_pin == out_pin) {
+	    destroy_output_node(list, previous_node, current_node);
+	    return;
+	}
+
+	previous_node = current_node;
+	current_node = current_node->next;
+    }
+}
+
+
+void mux_output_list_remove_channel(MuxOutputList *list, int out_pin, int channel)
+{
+    MuxOutputNode *current_node = list->head;
+    MuxOutputNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	if (current_node->out_pin == out_pin) {
+	    mux_channel_list_remove_channel(&current_node->channels, channel);
+
+	    if (NULL == current_node->channels.head) {
+		destroy_output_node(list, previous_node, current_node);
+	    }
+	    else if (channel == current_node->channel_num) {
+		current_node->current_channel = NULL;
+	    }
+
+	    return;
+	}
+
+	previous_node = current_node;
+	current_node = current_node->next;
+    }
+}
+
+
+void mux_output_list_remove_input(MuxOutputList *list, int in_pin)
+{
+    MuxOutputNode *current_node = list->head;
+    MuxOutputNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	MuxOutputNode *next_node = current_node->next;
+
+	mux_channel_list_remove_input(&current_node->channels, in_pin);
+
+	if (NULL == current_node->channels.head) {
+	    /* Output is empty now, previous node stays the same */
+	    destroy_output_node(list, previous_node, current_node);
+	}
+	else {
+	    /* Need to adjust the current channel */
+	    current_node->current_channel = find_channel_node(&current_node->channels,
+							      current_node->channel_num);
+	    previous_node = current_node;
+	}
+
+	current_node = next_node;
+    }
+}
+
+
+void mux_output_list_clear(MuxOutputList *list)
+{
+    MuxOutputNode *current_node = list->head;
+
+    while (NULL != current_node) {
+	MuxOutputNode *next_node = current_node->next;
+
+	mux_channel_list_clear(&current_node->channels);
+	free_output_node(current_node);
+
+	current_node = next_node;
+    }
+
+    list->head = NULL;
+    list->tail = NULL;
+}
+
+
+void mux_output_list_sweep(MuxOutputList *list)
+{
+    MuxOutputNode *current_node = list->head;
+    MuxOutputNode *previous_node = NULL;
+
+    while (NULL != current_node) {
+	MuxOutputNode *next_node = current_node->next;
+
+	mux_channel_list_sweep(&current_node->channels);
+
+	if (NULL == current_node->channels.head) {
+	    /* Output is empty now, previous node stays the same */
+	    destroy_output_node(list, previous_node, current_node);
+	}
+	else {
+	    current_node->current_channel = find_channel_node(&current_node->channels,
+							      current_node->channel_num);
+	    previous_node = current_node;
+	}
+
+	current_node = next_node;
+    }
+}
@@ -25,6 +25,7 @@
 #ifndef MUX_OUTPUT_H
 #define MUX_OUTPUT_H
 
+#include "mux_config.h"
 #include "mux_channel.h"
 
 
@@ -33,6 +34,29 @@
   collection of channels which consist of various inputs.
 
   This is also a node in a singly linked list of outputs.
+
+  The level is the last value written to the output, or -1 if nothing
+  has been written yet.
+
+  When cascading is turned on (see mux_cascade.h) an output may also
+  be an input. The slot is then the slot of out_pin, otherwise it is
+  -1. The stage is the output's place in the evaluation order.
+
+  Transformed is true if any pipe on the output has a transform (see
+  mux_transform.h), so outputs without any can skip stepping them.
+
+  The output is only evaluated on every divider'th update. The
+  countdown is the number of updates left until the next one, and
+  the output is evaluated when it reaches 1.
+
+  The tdm field is the output's time-division schedule (see
+  mux_tdm.h), or NULL if its channel is only changed by hand.
+
+  If use_lut is true the output's channels are compiled into lookup
+  tables where possible (see mux_lut.h).
+
+  With MUX_STATS, toggles counts the changes in level written to the
+  output (see mux_stats.h).
  */
 
 typedef struct MuxOutputNode {
@@ -41,6 +65,24 @@ typedef struct MuxOutputNode {
     int channel_num;
     MuxChannelNode *current_channel;
 
+    int level;
+
+    int slot;
+    unsigned char stage;
+
+    bool transformed;
+
+    unsigned char divider;
+    unsigned char countdown;
+
+    struct MuxTdmSchedule *tdm;
+
+    bool use_lut;
+
+#if MUX_STATS
+    uint32_t toggles;
+#endif
+
     MuxChannelList channels;
 
     struct MuxOutputNode *next;
@@ -102,4 +144,96 @@ void mux_output_list_add(MuxOutputList *list, MuxPipe pipe);
 
 void mux_output_list_remove(MuxOutputList *list, MuxPipe pipe);
 
+
+/*
+  Arguments:
+      list: The list that we are removing from.
+
+      out_pin: The output pin that we want to remove.
+
+  Removes the output node for out_pin, freeing all of its channels
+  and inputs. Does nothing if the output is not in the list.
+
+ */
+
+void mux_output_list_remove_output(MuxOutputList *list, int out_pin);
+
+
+/*
+  Arguments:
+      list: The list that we are removing from.
+
+      out_pin: The output pin which owns the channel.
+
+      channel: The channel that we want to remove.
+
+  Removes a whole channel from an output, freeing all of its
+  inputs. The output node is freed if this was its last channel, and
+  the current_channel pointer becomes NULL if this was the current
+  channel.
+
+ */
+
+void mux_output_list_remove_channel(MuxOutputList *list, int out_pin, int channel);
+
+
+/*
+  Arguments:
+      list: The list that we are removing from.
+
+      in_pin: The input pin that we want to remove.
+
+  Removes every pipe with the given input pin in a single pass over
+  the outputs. Channels and outputs which are left empty are freed,
+  and current_channel pointers are adjusted as in
+  mux_output_list_remove().
+
+ */
+
+void mux_output_list_remove_input(MuxOutputList *list, int in_pin);
+
+
+/*
+  Arguments:
+      list: The list that we want to empty.
+
+  Frees every output in the list along with all of their channels and
+  inputs, leaving the list empty.
+
+ */
+
+void mux_output_list_clear(MuxOutputList *list);
+
+
+/*
+  Arguments:
+      list: The list to sweep.
+
+  Removes every pipe whose input node isn't marked, in a single pass
+  (see mux_input_list_sweep()). Channels and outputs which are left
+  empty are freed, and current_channel pointers are adjusted as in
+  mux_output_list_remove().
+
+ */
+
+void mux_output_list_sweep(MuxOutputList *list);
+
+
+/*
+  Arguments:
+      list: The list that we are adding to.
+
+      out_pin: The output pin to add.
+
+      channel_num: The channel that the output starts on.
+
+  Adds a new output node with no channels to the end of the list, and
+  returns it. This does not check whether the output already exists,
+  and the caller is expected to give the output some channels and
+  then set current_channel.
+
+ */
+
+MuxOutputNode * mux_output_list_append(MuxOutputList *list, int out_pin, int channel_num);
+
 #endif
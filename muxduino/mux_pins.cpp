@@ -0,0 +1,433 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_pins.h"
+
+#include "mux_platform.h"
+
+#ifdef ARDUINO
+#include <SPI.h>
+#include <Wire.h>
+#endif
+
+
+/* Kinds of expanders */
+#define SHIFT_IN 0
+#define SHIFT_OUT 1
+#define MCP23017 2
+
+/* MCP23017 registers, with IOCON.BANK = 0 so that A and B alternate */
+#define MCP_IODIRA 0x00
+#define MCP_GPIOA 0x12
+#define MCP_OLATA 0x14
+
+
+/*
+  A chip or chain of chips. Pin n of the expander is bit n % 8 of
+  byte n / 8 in the in and out buffers.
+
+  Fields:
+      type: SHIFT_IN, SHIFT_OUT or MCP23017.
+
+      control: The load / latch pin for a chain, or the I2C address.
+
+      num_bytes: Number of bytes of pins.
+
+      dirty: True if out has changed since the last flush.
+
+      base_pin: Virtual pin number of the expander's first pin.
+
+      in: Levels read in the last sample.
+
+      out: Levels to write in the next flush.
+
+      directions: MCP23017 only, IODIR bits (1 for input).
+
+      directions_dirty: MCP23017 only, true if directions needs writing.
+ */
+
+typedef struct MuxExpander {
+    unsigned char type;
+    unsigned char control;
+    unsigned char num_bytes;
+    unsigned char dirty;
+
+    int base_pin;
+
+    unsigned char in[MUX_MAX_CHAIN_LENGTH];
+    unsigned char out[MUX_MAX_CHAIN_LENGTH];
+
+    unsigned char directions[2];
+    unsigned char directions_dirty;
+} MuxExpander;
+
+
+static MuxExpander expanders[MUX_MAX_EXPANDERS];
+static int num_expanders = 0;
+
+/* Next virtual pin number to hand out */
+static int next_pin = MUX_EXPANDER_PIN_BASE;
+
+static unsigned long num_transfers = 0;
+
+
+static int add_expander(int type, int control, int num_bytes)
+{
+    if (num_expanders >= MUX_MAX_EXPANDERS) {
+	return -1;
+    }
+
+    if (num_bytes < 1 || num_bytes > MUX_MAX_CHAIN_LENGTH) {
+	return -1;
+    }
+
+#ifndef ARDUINO
+    /* The emulated chips need a host pin for every virtual pin */
+    if (next_pin + 8 * num_bytes > MUX_HOST_PINS) {
+	return -1;
+    }
+#else
+    if (0 == num_expanders) {
+	SPI.begin();
+	Wire.begin();
+    }
+#endif
+
+    MuxExpander *expander = &expanders[num_expanders++];
+
+    expander->type = type;
+    expander->control = control;
+    expander->num_bytes = num_bytes;
+    expander->dirty = true;
+    expander->base_pin = next_pin;
+
+    for (int i = 0; i < num_bytes; ++i) {
+	expander->in[i] = 0;
+	expander->out[i] = 0;
+    }
+
+    /* Everything on an MCP23017 starts off as an input */
+    expander->directions[0] = 0xFF;
+    expander->directions[1] = 0xFF;
+    expander->directions_dirty = true;
+
+    next_pin += 8 * num_bytes;
+
+    return expander->base_pin;
+}
+
+
+int mux_add_shift_in(int load_pin, int num_chips)
+{
+    int base_pin = add_expander(SHIFT_IN, load_pin, num_chips);
+
+    if (base_pin >= 0) {
+	pinMode(load_pin, OUTPUT);
+	digitalWrite(load_pin, HIGH);
+    }
+
+    return base_pin;
+}
+
+
+int mux_add_shift_out(int latch_pin, int num_chips)
+{
+    int base_pin = add_expander(SHIFT_OUT, latch_pin, num_chips);
+
+    if (base_pin >= 0) {
+	pinMode(latch_pin, OUTPUT);
+	digitalWrite(latch_pin, LOW);
+
+#ifndef ARDUINO
+	/* The emulated chain drives its host pins, so they aren't inputs */
+	for (int pin = base_pin; pin < base_pin + 8 * num_chips; ++pin) {
+	    pinMode(pin, OUTPUT);
+	}
+#endif
+    }
+
+    return base_pin;
+}
+
+
+int mux_add_mcp23017(unsigned char address)
+{
+    return add_expander(MCP23017, address, 2);
+}
+
+
+void mux_clear_expanders()
+{
+#ifndef ARDUINO
+    /* Hand the emulated pins back to the host as inputs */
+    for (int pin = MUX_EXPANDER_PIN_BASE; pin < next_pin; ++pin) {
+	pinMode(pin, INPUT);
+    }
+#endif
+
+    num_expanders = 0;
+    next_pin = MUX_EXPANDER_PIN_BASE;
+}
+
+
+/* Find the expander with the virtual pin, NULL if there isn't one */
+static MuxExpander * find_expander(int pin)
+{
+    for (int i = 0; i < num_expanders; ++i) {
+	MuxExpander *expander = &expanders[i];
+
+	if (pin >= expander->base_pin
+	    && pin < expander->base_pin + 8 * expander->num_bytes) {
+	    return expander;
+	}
+    }
+
+    return NULL;
+}
+
+
+void mux_pin_mode(int pin, int mode)
+{
+    if (pin < MUX_EXPANDER_PIN_BASE) {
+	pinMode(pin, mode);
+	return;
+    }
+
+    MuxExpander *expander = find_expander(pin);
+
+    if (NULL == expander || MCP23017 != expander->type) {
+	return;
+    }
+
+    int offset = pin - expander->base_pin;
+    unsigned char bit = 1 << (offset % 8);
+    unsigned char directions = expander->directions[offset / 8];
+
+    if (OUTPUT == mode) {
+	directions &= ~bit;
+    }
+    else {
+	directions |= bit;
+    }
+
+    if (directions != expander->directions[offset / 8]) {
+	expander->directions[offset / 8] = directions;
+	expander->directions_dirty = true;
+    }
+
+#ifndef ARDUINO
+    /* So the host, and the pin bus, leave the emulated outputs alone */
+    pinMode(pin, mode);
+#endif
+}
+
+
+int mux_pin_read(int pin)
+{
+    if (pin < MUX_EXPANDER_PIN_BASE) {
+	return digitalRead(pin);
+    }
+
+    MuxExpander *expander = find_expander(pin);
+
+    if (NULL == expander) {
+	return LOW;
+    }
+
+    int offset = pin - expander->base_pin;
+    return (expander->in[offset / 8] >> (offset % 8)) & 1 ? HIGH : LOW;
+}
+
+
+void mux_pin_write(int pin, int value)
+{
+    if (pin < MUX_EXPANDER_PIN_BASE) {
+	digitalWrite(pin, value);
+	return;
+    }
+
+    MuxExpander *expander = find_expander(pin);
+
+    if (NULL == expander || SHIFT_IN == expander->type) {
+	return;
+    }
+
+    int offset = pin - expander->base_pin;
+    unsigned char bit = 1 << (offset % 8);
+    unsigned char out = expander->out[offset / 8];
+
+    if (LOW != value) {
+	out |= bit;
+    }
+    else {
+	out &= ~bit;
+    }
+
+    if (out != expander->out[offset / 8]) {
+	expander->out[offset / 8] = out;
+	expander->dirty = true;
+    }
+}
+
+
+#ifdef ARDUINO
+
+static void read_chip(MuxExpander *expander)
+{
+    if (SHIFT_IN == expander->type) {
+	/* Latch the parallel inputs, then clock them all out */
+	digitalWrite(expander->control, LOW);
+	digitalWrite(expander->control, HIGH);
+
+	SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+	for (int i = 0; i < expander->num_bytes; ++i) {
+	    expander->in[i] = SPI.transfer(0);
+	}
+	SPI.endTransaction();
+    }
+    else {
+	Wire.beginTransmission(expander->control);
+	Wire.write(MCP_GPIOA);
+	Wire.endTransmission();
+
+	Wire.requestFrom(expander->control, (unsigned char) 2);
+	expander->in[0] = Wire.read();
+	expander->in[1] = Wire.read();
+    }
+}
+
+
+static void write_chip(MuxExpander *expander)
+{
+    if (SHIFT_OUT == expander->type) {
+	/* Farthest chip first, so that chip 0 ends up nearest the Arduino */
+	SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+	for (int i = expander->num_bytes - 1; i >= 0; --i) {
+	    SPI.transfer(expander->out[i]);
+	}
+	SPI.endTransaction();
+
+	digitalWrite(expander->control, HIGH);
+	digitalWrite(expander->control, LOW);
+    }
+    else {
+	if (expander->directions_dirty) {
+	    Wire.beginTransmission(expander->control);
+	    Wire.write(MCP_IODIRA);
+	    Wire.write(expander->directions[0]);
+	    Wire.write(expander->directions[1]);
+	    Wire.endTransmission();
+	}
+
+	Wire.beginTransmission(expander->control);
+	Wire.write(MCP_OLATA);
+	Wire.write(expander->out[0]);
+	Wire.write(expander->out[1]);
+	Wire.endTransmission();
+    }
+}
+
+#else
+
+/* Emulated chips just copy bits between memory and the host pins */
+static void read_chip(MuxExpander *expander)
+{
+    for (int i = 0; i < expander->num_bytes; ++i) {
+	unsigned char in = 0;
+
+	for (int bit = 0; bit < 8; ++bit) {
+	    if (HIGH == mux_host_get_level(expander->base_pin + 8 * i + bit)) {
+		in |= 1 << bit;
+	    }
+	}
+
+	expander->in[i] = in;
+    }
+}
+
+
+static void write_chip(MuxExpander *expander)
+{
+    for (int i = 0; i < expander->num_bytes; ++i) {
+	/* Inputs on an MCP23017 are driven by the host, leave them be */
+	unsigned char outputs = (MCP23017 == expander->type) ? ~expander->directions[i] : 0xFF;
+
+	for (int bit = 0; bit < 8; ++bit) {
+	    if (outputs & (1 << bit)) {
+		digitalWrite(expander->base_pin + 8 * i + bit,
+			     (expander->out[i] >> bit) & 1 ? HIGH : LOW);
+	    }
+	}
+    }
+}
+
+#endif
+
+
+void mux_pins_sample()
+{
+#ifndef ARDUINO
+    mux_host_bus_sample();
+#endif
+
+    for (int i = 0; i < num_expanders; ++i) {
+	MuxExpander *expander = &expanders[i];
+
+	if (SHIFT_OUT != expander->type) {
+	    read_chip(expander);
+	    ++num_transfers;
+	}
+    }
+}
+
+
+void mux_pins_flush()
+{
+    for (int i = 0; i < num_expanders; ++i) {
+	MuxExpander *expander = &expanders[i];
+
+	if (SHIFT_IN == expander->type) {
+	    continue;
+	}
+
+	if (expander->dirty || expander->directions_dirty) {
+	    write_chip(expander);
+	    ++num_transfers;
+
+	    expander->dirty = false;
+	    expander->directions_dirty = false;
+	}
+    }
+
+#ifndef ARDUINO
+    mux_host_bus_publish();
+#endif
+}
+
+
+unsigned long mux_expander_transfers()
+{
+    return num_transfers;
+}
@@ -0,0 +1,167 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_PINS_H
+#define MUX_PINS_H
+
+/*
+  Pin backends for MuxDuino. Pins below MUX_EXPANDER_PIN_BASE are the
+  Arduino's own pins, and are handled with digitalRead() and
+  digitalWrite() as usual. Pins from MUX_EXPANDER_PIN_BASE up are
+  virtual pins which live on shift registers or I/O expanders:
+
+      74HC165: Parallel in, serial out shift registers for inputs. The
+	       chain is read over SPI (MISO and SCK) after pulsing
+	       its load pin.
+
+      74HC595: Serial in, parallel out shift registers for outputs. The
+	       chain is written over SPI (MOSI and SCK) and then its
+	       latch pin is pulsed.
+
+      MCP23017: 16 bit I2C expander, for inputs and outputs. Each pin
+		is an input or output depending on pinMode.
+
+  Reading or writing a virtual pin only touches a copy of the chip's
+  bits in memory. All of the chips are read in one go by
+  mux_pins_sample(), and written in one go by mux_pins_flush(), which
+  mux_update() calls at the start and end of each update. Only chips
+  with changed outputs are written.
+
+  On the host build the chips are emulated with the host backend's
+  pins: sampling copies the host levels of a chip's virtual pins into
+  memory, and flushing copies them back out. So the host program can
+  use mux_host_set_input() and mux_host_get_level() on virtual pins
+  just like on any other pin, and sees the same latching behaviour as
+  the real chips. Output bits (every bit of a 74HC595 chain, and the
+  MCP23017 bits set to OUTPUT) are host outputs too, so an attached
+  pin bus doesn't overwrite them.
+ */
+
+/* First virtual pin number */
+#define MUX_EXPANDER_PIN_BASE 100
+
+/* Most chips of all kinds that can be added */
+#define MUX_MAX_EXPANDERS 8
+
+/* Most 74HC165 / 74HC595 chips in one chain */
+#define MUX_MAX_CHAIN_LENGTH 8
+
+
+/*
+  Arguments:
+      load_pin: Arduino pin wired to the chain's SH/LD pin.
+
+      num_chips: Number of chips in the chain, up to MUX_MAX_CHAIN_LENGTH.
+
+  Adds a chain of 74HC165 input shift registers. Returns the virtual
+  pin number of the chain's first pin, or -1 if there is no room for
+  more chips. Input Dk of chip n is the virtual pin first + 8 * n + k,
+  where chip 0 is the one whose QH is wired to the Arduino.
+
+ */
+
+int mux_add_shift_in(int load_pin, int num_chips);
+
+
+/*
+  Arguments:
+      latch_pin: Arduino pin wired to the chain's RCLK pin.
+
+      num_chips: Number of chips in the chain, up to MUX_MAX_CHAIN_LENGTH.
+
+  Adds a chain of 74HC595 output shift registers. Returns the virtual
+  pin number of the chain's first pin, or -1 if there is no room for
+  more chips. Output Qk of chip n is the virtual pin first + 8 * n + k,
+  where chip 0 is the one whose SER is wired to the Arduino.
+
+ */
+
+int mux_add_shift_out(int latch_pin, int num_chips);
+
+
+/*
+  Arguments:
+      address: I2C address of the expander, 0x20 to 0x27.
+
+  Adds an MCP23017 expander. Returns the virtual pin number for GPA0,
+  followed by GPA1..GPA7 and then GPB0..GPB7. Returns -1 if there is
+  no room for more chips.
+
+ */
+
+int mux_add_mcp23017(unsigned char address);
+
+
+/*
+  Forgets about every expander, so that the virtual pins can be
+  handed out again.
+
+ */
+
+void mux_clear_expanders();
+
+
+/*
+  Same as pinMode(), digitalRead() and digitalWrite(), but they work
+  on virtual pins too. Virtual pins on a 74HC165 are always inputs
+  and on a 74HC595 are always outputs.
+
+ */
+
+void mux_pin_mode(int pin, int mode);
+int mux_pin_read(int pin);
+void mux_pin_write(int pin, int value);
+
+
+/*
+  Reads every input chip in one batch. Reads of virtual pins return
+  what was read here until the next sample. On the host this also
+  latches the inputs from the pin bus, if there is one.
+
+ */
+
+void mux_pins_sample();
+
+
+/*
+  Writes out every output chip whose bits have changed since it was
+  last written. On the host this also publishes the pin levels to the
+  pin bus, if there is one.
+
+ */
+
+void mux_pins_flush();
+
+
+/*
+  Returns the number of chip transfers done so far by
+  mux_pins_sample() and mux_pins_flush(), which is handy for checking
+  that chips are only written when they need to be.
+
+ */
+
+unsigned long mux_expander_transfers();
+
+#endif
@@ -0,0 +1,441 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_protocol.h"
+#include "mux_output.h"
+#include "mux_state.h"
+#include "mux_scene.h"
+#include "mux_analog.h"
+#include "muxduino.h"
+
+#include "mux_platform.h"
+
+#ifndef ARDUINO
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+
+/* Parser states */
+#define WAIT_SYNC 0
+#define WAIT_SEQUENCE 1
+#define WAIT_LENGTH 2
+#define WAIT_PAYLOAD 3
+#define WAIT_CRC 4
+
+
+/* Number of 16 bit arguments for each opcode, -1 if not an opcode */
+static int op_arguments(unsigned char op)
+{
+    switch (op) {
+    case MUX_OP_ADD:
+    case MUX_OP_REMOVE:
+	return 3;
+    case MUX_OP_SET_CHANNEL:
+    case MUX_OP_REMOVE_CHANNEL:
+	return 2;
+    case MUX_OP_REMOVE_OUTPUT:
+    case MUX_OP_REMOVE_INPUT:
+    case MUX_OP_SCENE_STORE:
+    case MUX_OP_SCENE_RECALL:
+	return 1;
+    case MUX_OP_CLEAR:
+	return 0;
+    default:
+	return -1;
+    }
+}
+
+
+/* CRC-8 with polynomial 0x07, one byte at a time */
+static unsigned char crc8(unsigned char crc, unsigned char value)
+{
+    crc ^= value;
+
+    for (int i = 0; i < 8; ++i) {
+	crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+
+    return crc;
+}
+
+
+static void send_ack(MuxProtocol *protocol, unsigned char status,
+		     unsigned char ops_run, unsigned char failed_op,
+		     unsigned char error)
+{
+    unsigned char frame[8];
+
+    frame[0] = MUX_PROTOCOL_SYNC;
+    frame[1] = protocol->sequence;
+    frame[2] = 4;
+    frame[3] = status;
+    frame[4] = ops_run;
+    frame[5] = failed_op;
+    frame[6] = error;
+
+    unsigned char crc = 0;
+    for (int i = 1; i < 7; ++i) {
+	crc = crc8(crc, frame[i]);
+    }
+
+    frame[7] = crc;
+
+    protocol->stream.write(protocol->stream.ctx, frame, sizeof(frame));
+
+    if (MUX_STATUS_OK == status) {
+	++protocol->frames_ok;
+    }
+    else {
+	++protocol->frames_failed;
+    }
+}
+
+
+/* Returns true if every opcode is known and has all of its arguments */
+static bool payload_valid(const unsigned char *payload, unsigned int length)
+{
+    unsigned int position = 0;
+
+    while (position < length) {
+	int arguments = op_arguments(payload[position]);
+
+	if (arguments < 0) {
+	    return false;
+	}
+
+	position += 1 + 2 * arguments;
+    }
+
+    return position == length;
+}
+
+
+static int argument(const unsigned char *op, int index)
+{
+    return (int) (short) (op[1 + 2 * index] | (op[2 + 2 * index] << 8));
+}
+
+
+/*
+  Runs a single operation, returning 0 on success. Pipes are added and
+  removed straight on mux_outs, and changed is set, so that the frame
+  only has to bring the rest of the topology up to date once.
+ */
+static int run_op(const unsigned char *op, bool *changed)
+{
+    MuxPipe pipe;
+    int result;
+
+    switch (op[0]) {
+    case MUX_OP_ADD:
+    case MUX_OP_REMOVE:
+	pipe.in_pin = argument(op, 0);
+	pipe.out_pin = argument(op, 1);
+	pipe.channel = argument(op, 2);
+
+	if (MUX_OP_ADD == op[0]) {
+	    result = mux_add_pipe(pipe);
+	    *changed = *changed || 0 == result;
+	    return result;
+	}
+
+	mux_output_list_remove(&mux_outs, pipe);
+	*changed = true;
+	return 0;
+
+    case MUX_OP_SET_CHANNEL:
+	if (NULL == find_output_node(&mux_outs, argument(op, 0))) {
+	    return 1;
+	}
+
+	set_output_channel(argument(op, 0), argument(op, 1));
+	return 0;
+
+    case MUX_OP_REMOVE_OUTPUT:
+	mux_output_list_remove_output(&mux_outs, argument(op, 0));
+	*changed = true;
+	return 0;
+
+    case MUX_OP_REMOVE_INPUT:
+	mux_output_list_remove_input(&mux_outs, argument(op, 0));
+	*changed = true;
+	return 0;
+
+    case MUX_OP_REMOVE_CHANNEL:
+	mux_output_list_remove_channel(&mux_outs, argument(op, 0), argument(op, 1));
+	*changed = true;
+	return 0;
+
+    case MUX_OP_CLEAR:
+	mux_output_list_clear(&mux_outs);
+	mux_analog_clear();
+	*changed = true;
+	return 0;
+
+    case MUX_OP_SCENE_STORE:
+	return mux_scene_store(argument(op, 0));
+
+    case MUX_OP_SCENE_RECALL:
+	return mux_scene_recall(argument(op, 0));
+    }
+
+    return 1;
+}
+
+
+/* Runs a complete frame whose crc has been checked */
+static void run_frame(MuxProtocol *protocol)
+{
+    if (!payload_valid(protocol->payload, protocol->length)) {
+	send_ack(protocol, MUX_STATUS_MALFORMED, 0, 0, 0);
+	return;
+    }
+
+    unsigned int position = 0;
+    unsigned char ops_run = 0;
+    bool changed = false;
+    int error = 0;
+
+    while (position < protocol->length) {
+	const unsigned char *op = protocol->payload + position;
+
+	error = run_op(op, &changed);
+
+	if (0 != error) {
+	    break;
+	}
+
+	++ops_run;
+	position += 1 + 2 * op_arguments(op[0]);
+    }
+
+    /* One rebuild for the whole batch, including the ops before a failure */
+    if (changed) {
+	mux_topology_changed();
+    }
+
+    if (0 != error) {
+	send_ack(protocol, MUX_STATUS_OP_FAILED, ops_run, ops_run, error);
+    }
+    else {
+	send_ack(protocol, MUX_STATUS_OK, ops_run, 0, 0);
+    }
+}
+
+
+void mux_protocol_begin(MuxProtocol *protocol, MuxStream stream)
+{
+    protocol->stream = stream;
+    protocol->state = WAIT_SYNC;
+
+    protocol->frames_ok = 0;
+    protocol->frames_failed = 0;
+}
+
+
+int mux_protocol_poll(MuxProtocol *protocol, unsigned int max_bytes)
+{
+    int frames = 0;
+
+    for (unsigned int i = 0; i < max_bytes; ++i) {
+	int value = protocol->stream.read(protocol->stream.ctx);
+
+	if (value < 0) {
+	    break;
+	}
+
+	unsigned char byte = value;
+
+	switch (protocol->state) {
+	case WAIT_SYNC:
+	    if (MUX_PROTOCOL_SYNC == byte) {
+		protocol->state = WAIT_SEQUENCE;
+	    }
+	    break;
+
+	case WAIT_SEQUENCE:
+	    protocol->sequence = byte;
+	    protocol->crc = crc8(0, byte);
+	    protocol->state = WAIT_LENGTH;
+	    break;
+
+	case WAIT_LENGTH:
+	    if (byte > MUX_PROTOCOL_MAX_PAYLOAD) {
+		send_ack(protocol, MUX_STATUS_TOO_LONG, 0, 0, 0);
+		protocol->state = WAIT_SYNC;
+		++frames;
+		break;
+	    }
+
+	    protocol->length = byte;
+	    protocol->received = 0;
+	    protocol->crc = crc8(protocol->crc, byte);
+	    protocol->state = (0 == byte) ? WAIT_CRC : WAIT_PAYLOAD;
+	    break;
+
+	case WAIT_PAYLOAD:
+	    protocol->payload[protocol->received++] = byte;
+	    protocol->crc = crc8(protocol->crc, byte);
+
+	    if (protocol->received == protocol->length) {
+		protocol->state = WAIT_CRC;
+	    }
+	    break;
+
+	case WAIT_CRC:
+	    if (byte == protocol->crc) {
+		run_frame(protocol);
+	    }
+	    else {
+		send_ack(protocol, MUX_STATUS_BAD_CRC, 0, 0, 0);
+	    }
+
+	    protocol->state = WAIT_SYNC;
+	    ++frames;
+	    break;
+	}
+    }
+
+    return frames;
+}
+
+
+#ifdef ARDUINO
+
+static int read_serial(void *ctx)
+{
+    return ((Stream *) ctx)->read();
+}
+
+
+static void write_serial(void *ctx, const unsigned char *data, unsigned int len)
+{
+    ((Stream *) ctx)->write(data, len);
+}
+
+
+MuxStream mux_stream_serial(Stream *serial)
+{
+    MuxStream stream;
+
+    stream.read = read_serial;
+    stream.write = write_serial;
+    stream.ctx = serial;
+
+    return stream;
+}
+
+#else
+
+/* Sends as much of the queue as the descriptor will take right now */
+static void flush_fd(MuxFdStream *stream)
+{
+    while (stream->queued > 0) {
+	ssize_t written = write(stream->fd, stream->queue, stream->queued);
+
+	if (written < 0) {
+	    if (EINTR == errno) {
+		continue;
+	    }
+
+	    if (EAGAIN != errno && EWOULDBLOCK != errno) {
+		/* The other end is gone, so nothing queued will ever get there */
+		stream->queued = 0;
+		++stream->dropped;
+	    }
+
+	    return;
+	}
+
+	stream->queued -= written;
+	memmove(stream->queue, stream->queue + written, stream->queued);
+    }
+}
+
+
+static int read_fd(void *ctx)
+{
+    MuxFdStream *stream = (MuxFdStream *) ctx;
+    unsigned char byte;
+
+    /* Anything left over from earlier writes gets another go on every poll */
+    if (stream->queued > 0) {
+	flush_fd(stream);
+    }
+
+    if (1 != read(stream->fd, &byte, 1)) {
+	return -1;
+    }
+
+    return byte;
+}
+
+
+static void write_fd(void *ctx, const unsigned char *data, unsigned int len)
+{
+    MuxFdStream *stream = (MuxFdStream *) ctx;
+
+    /*
+      Never wait for the other end. Whatever it won't take right now is
+      queued behind what is already waiting, and if even that doesn't
+      fit the whole write is dropped rather than sending part of it.
+     */
+    if (len > MUX_FD_QUEUE - stream->queued) {
+	flush_fd(stream);
+
+	if (len > MUX_FD_QUEUE - stream->queued) {
+	    ++stream->dropped;
+	    return;
+	}
+    }
+
+    memcpy(stream->queue + stream->queued, data, len);
+    stream->queued += len;
+
+    flush_fd(stream);
+}
+
+
+MuxStream mux_stream_fd(MuxFdStream *fd_stream, int fd)
+{
+    MuxStream stream;
+
+    fd_stream->fd = fd;
+    fd_stream->queued = 0;
+    fd_stream->dropped = 0;
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    stream.read = read_fd;
+    stream.write = write_fd;
+    stream.ctx = fd_stream;
+
+    return stream;
+}
+
+#endif
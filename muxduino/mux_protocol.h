@@ -0,0 +1,224 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_PROTOCOL_H
+#define MUX_PROTOCOL_H
+
+/*
+  Binary control protocol for changing the MuxDuino topology while it
+  is running. Commands arrive in frames over a byte stream (Serial on
+  an Arduino, a pipe or pty on the host), and each frame is answered
+  with an acknowledgement frame.
+
+  A frame looks like this:
+
+      0xA5, sequence, length, payload[length], crc
+
+  Where the sequence number is picked by the sender and echoed in the
+  acknowledgement, and the crc is a CRC-8 (polynomial 0x07) over the
+  sequence, length and payload bytes. The payload is a batch of
+  operations, each an opcode followed by its arguments as 16 bit
+  little endian values:
+
+      MUX_OP_ADD             in_pin, out_pin, channel
+      MUX_OP_REMOVE          in_pin, out_pin, channel
+      MUX_OP_SET_CHANNEL     out_pin, channel
+      MUX_OP_REMOVE_OUTPUT   out_pin
+      MUX_OP_REMOVE_INPUT    in_pin
+      MUX_OP_REMOVE_CHANNEL  out_pin, channel
+      MUX_OP_CLEAR
+      MUX_OP_SCENE_STORE     scene
+      MUX_OP_SCENE_RECALL    scene
+
+  The whole payload is checked before any operation runs, then the
+  operations are run in order until one of them fails. Everything
+  worked out from the topology is brought up to date once, after the
+  operations have run, rather than after each one. The
+  acknowledgement uses the same sequence number and a four byte
+  payload:
+
+      status, operations run, index of the failed operation, error
+
+  See MuxProtocolStatus for the status values. The error is whatever
+  the failed operation returned (register_pipe() error codes for
+  MUX_OP_ADD, 1 for an unknown output or scene otherwise).
+ */
+
+#define MUX_PROTOCOL_SYNC 0xA5
+
+/* Largest payload that a frame may carry */
+#define MUX_PROTOCOL_MAX_PAYLOAD 64
+
+
+typedef enum MuxProtocolOp {
+    MUX_OP_ADD = 0x01,
+    MUX_OP_REMOVE = 0x02,
+    MUX_OP_SET_CHANNEL = 0x03,
+    MUX_OP_REMOVE_OUTPUT = 0x04,
+    MUX_OP_REMOVE_INPUT = 0x05,
+    MUX_OP_REMOVE_CHANNEL = 0x06,
+    MUX_OP_CLEAR = 0x07,
+    MUX_OP_SCENE_STORE = 0x08,
+    MUX_OP_SCENE_RECALL = 0x09
+} MuxProtocolOp;
+
+
+typedef enum MuxProtocolStatus {
+    MUX_STATUS_OK = 0,         /* Every operation ran */
+    MUX_STATUS_BAD_CRC = 1,    /* Frame was corrupt, nothing ran */
+    MUX_STATUS_MALFORMED = 2,  /* Unknown opcode or missing arguments, nothing ran */
+    MUX_STATUS_OP_FAILED = 3,  /* An operation failed, the ones before it ran */
+    MUX_STATUS_TOO_LONG = 4    /* Payload was longer than MUX_PROTOCOL_MAX_PAYLOAD */
+} MuxProtocolStatus;
+
+
+/*
+  A byte stream for the protocol to talk over.
+
+  Fields:
+      read: Returns the next byte, or -1 if there is nothing to read
+	    right now. This must not block.
+
+      write: Sends len bytes. This is called from
+	     mux_protocol_poll(), so it should not wait on the other end.
+
+      ctx: Passed along to read and write.
+ */
+
+typedef struct MuxStream {
+    int (*read)(void *ctx);
+    void (*write)(void *ctx, const unsigned char *data, unsigned int len);
+    void *ctx;
+} MuxStream;
+
+
+/*
+  State of the frame parser. Set it up with mux_protocol_begin() and
+  leave the fields alone, except for the counters which may be read
+  at any time.
+ */
+
+typedef struct MuxProtocol {
+    MuxStream stream;
+
+    unsigned char state;
+    unsigned char sequence;
+    unsigned char length;
+    unsigned char received;
+    unsigned char crc;
+    unsigned char payload[MUX_PROTOCOL_MAX_PAYLOAD];
+
+    unsigned long frames_ok;      /* Frames where every operation ran */
+    unsigned long frames_failed;  /* Frames that were rejected or had a failed operation */
+} MuxProtocol;
+
+
+/*
+  Arguments:
+      protocol: The parser to set up.
+
+      stream: The stream to read commands from and write
+	      acknowledgements to.
+
+ */
+
+void mux_protocol_begin(MuxProtocol *protocol, MuxStream stream);
+
+
+/*
+  Arguments:
+      protocol: The parser.
+
+      max_bytes: Most bytes to read in this call.
+
+  Reads whatever is available on the stream, up to max_bytes, and
+  runs any frame which is completed. This never blocks, and frames
+  may be split across any number of calls, so it can be called
+  between calls to mux_update() to keep the work per loop bounded.
+  A frame holds at most MUX_PROTOCOL_MAX_PAYLOAD bytes of operations,
+  which bounds the work of running it as well.
+
+  Returns the number of frames that were completed.
+
+ */
+
+int mux_protocol_poll(MuxProtocol *protocol, unsigned int max_bytes);
+
+
+#ifdef ARDUINO
+
+class Stream;
+
+/*
+  Arguments:
+      serial: The Arduino stream to use, such as &Serial.
+
+  Returns a MuxStream which talks over an Arduino Stream.
+
+ */
+
+MuxStream mux_stream_serial(Stream *serial);
+
+#else
+
+/* Bytes that a MuxFdStream holds on to while the other end isn't reading */
+#define MUX_FD_QUEUE 64
+
+
+/*
+  A file descriptor to talk over, along with anything written to it
+  that the other end hasn't taken yet. Set it up with
+  mux_stream_fd(), and leave the fields alone except for dropped,
+  which may be read at any time.
+ */
+
+typedef struct MuxFdStream {
+    int fd;
+    unsigned int queued;
+    unsigned long dropped;  /* Writes thrown away because they didn't fit, or the fd failed */
+    unsigned char queue[MUX_FD_QUEUE];
+} MuxFdStream;
+
+
+/*
+  Arguments:
+      fd_stream: Where to keep the stream's state. It must stay valid
+		 while the stream is in use.
+
+      fd: A pipe, pty or socket. It is made non-blocking.
+
+  Host build only. Returns a MuxStream which talks over the file
+  descriptor. Writes never wait: whatever the descriptor won't take
+  right away is queued, and sent on later writes and reads (so on
+  every mux_protocol_poll()). A write that doesn't fit in the queue
+  is dropped whole, so the other end never gets part of a frame.
+
+ */
+
+MuxStream mux_stream_fd(MuxFdStream *fd_stream, int fd);
+
+#endif
+
+#endif
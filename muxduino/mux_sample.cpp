@@ -0,0 +1,528 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_sample.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_state.h"
+#include "mux_pins.h"
+#include "mux_stats.h"
+
+#include "mux_platform.h"
+
+
+MuxWord mux_levels[MUX_SAMPLE_WORDS];
+
+/* Pin for each slot, only meaningful if the slot is used */
+static int slot_pins[MUX_MAX_INPUTS];
+
+/* Bit for each slot which is in use */
+static MuxWord used_slots[MUX_SAMPLE_WORDS];
+
+/* Bit for each slot which is an internal signal rather than a pin */
+static MuxWord internal_slots[MUX_SAMPLE_WORDS];
+
+/* Unfiltered levels from the last sample */
+static MuxWord raw_levels[MUX_SAMPLE_WORDS];
+
+/*
+  Vertical counters, one bit plane per word array. For each slot this
+  counts how many updates in a row the raw level has differed from the
+  filtered level.
+ */
+static MuxWord count0[MUX_SAMPLE_WORDS];
+static MuxWord count1[MUX_SAMPLE_WORDS];
+static MuxWord count2[MUX_SAMPLE_WORDS];
+
+/* Filter depth for each slot, in the same layout as the counters */
+static MuxWord depth0[MUX_SAMPLE_WORDS];
+static MuxWord depth1[MUX_SAMPLE_WORDS];
+static MuxWord depth2[MUX_SAMPLE_WORDS];
+
+/* True if any slot has a depth above 1, otherwise the filter is skipped */
+static bool filtering = false;
+
+static unsigned int glitches[MUX_MAX_INPUTS];
+static unsigned long total_glitches = 0;
+
+#if MUX_STATS
+static uint32_t edges[MUX_MAX_INPUTS];
+#endif
+
+
+/* Index of the lowest set bit in a non-zero word */
+static int lowest_bit(MuxWord word)
+{
+    return __builtin_ctzl(word);
+}
+
+
+int mux_sample_slot(int pin)
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord used = used_slots[w];
+
+	while (used) {
+	    int slot = w * MUX_WORD_BITS + lowest_bit(used);
+
+	    if (pin == slot_pins[slot]) {
+		return slot;
+	    }
+
+	    used &= used - 1;
+	}
+    }
+
+    return -1;
+}
+
+
+int mux_sample_pin(int slot)
+{
+    if (slot < 0 || slot >= MUX_MAX_INPUTS || !MUX_BIT(used_slots, slot)) {
+	return -1;
+    }
+
+    return slot_pins[slot];
+}
+
+
+void mux_sample_external(MuxWord *mask)
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	mask[w] = used_slots[w] & ~internal_slots[w];
+    }
+}
+
+
+bool mux_sample_has_room(int pin)
+{
+    /* Distinct inputs so far, counted from mux_outs since the slots may be out of date */
+    int pins[MUX_MAX_INPUTS];
+    int num_pins = 0;
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		if (pin == in_node->in_pin) {
+		    return true;
+		}
+
+		int i = 0;
+		while (i < num_pins && in_node->in_pin != pins[i]) {
+		    ++i;
+		}
+
+		if (i == num_pins && num_pins < MUX_MAX_INPUTS) {
+		    pins[num_pins++] = in_node->in_pin;
+		}
+
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+
+    return num_pins < MUX_MAX_INPUTS;
+}
+
+
+/* Sets the depth of a slot, without updating the filtering flag */
+static void set_slot_depth(int slot, int depth)
+{
+    int w = slot / MUX_WORD_BITS;
+    MuxWord bit = (MuxWord) 1 << (slot % MUX_WORD_BITS);
+
+    depth0[w] = (depth & 1) ? (depth0[w] | bit) : (depth0[w] & ~bit);
+    depth1[w] = (depth & 2) ? (depth1[w] | bit) : (depth1[w] & ~bit);
+    depth2[w] = (depth & 4) ? (depth2[w] | bit) : (depth2[w] & ~bit);
+}
+
+
+/* Grab the lowest free slot for the pin, -1 if there are none */
+static int allocate_slot(int pin)
+{
+    for (int slot = 0; slot < MUX_MAX_INPUTS; ++slot) {
+	int w = slot / MUX_WORD_BITS;
+	MuxWord bit = (MuxWord) 1 << (slot % MUX_WORD_BITS);
+
+	if (!(used_slots[w] & bit)) {
+	    /* Start off fresh, with no filtering */
+	    used_slots[w] |= bit;
+	    slot_pins[slot] = pin;
+
+	    mux_levels[w] &= ~bit;
+	    raw_levels[w] &= ~bit;
+	    count0[w] &= ~bit;
+	    count1[w] &= ~bit;
+	    count2[w] &= ~bit;
+	    set_slot_depth(slot, 1);
+	    glitches[slot] = 0;
+
+#if MUX_STATS
+	    edges[slot] = 0;
+#endif
+
+	    return slot;
+	}
+    }
+
+    return -1;
+}
+
+
+static void update_filtering()
+{
+    filtering = false;
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	if ((depth1[w] | depth2[w]) & used_slots[w]) {
+	    filtering = true;
+	}
+    }
+}
+
+
+/* Calls fn on every input node of every digital output */
+static void for_each_input(void (*fn)(MuxInputNode *, MuxWord *), MuxWord *seen)
+{
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		fn(in_node, seen);
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+static void mark_slot(MuxInputNode *in_node, MuxWord *seen)
+{
+    int slot = mux_sample_slot(in_node->in_pin);
+
+    if (slot >= 0) {
+	seen[slot / MUX_WORD_BITS] |= (MuxWord) 1 << (slot % MUX_WORD_BITS);
+    }
+}
+
+
+static void assign_slot(MuxInputNode *in_node, MuxWord *)
+{
+    int slot = mux_sample_slot(in_node->in_pin);
+
+    if (slot < 0) {
+	slot = allocate_slot(in_node->in_pin);
+    }
+
+    in_node->slot = slot;
+}
+
+
+void mux_sample_rebuild()
+{
+    MuxWord seen[MUX_SAMPLE_WORDS];
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	seen[w] = 0;
+    }
+
+    /* Find out which of the slots are still needed, and free the rest */
+    for_each_input(mark_slot, seen);
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	used_slots[w] = seen[w];
+    }
+
+    /* Now hand out slots to any new pins */
+    for_each_input(assign_slot, seen);
+
+    update_filtering();
+}
+
+
+void mux_sample_set_internal(const MuxWord *internal)
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	internal_slots[w] = internal[w] & used_slots[w];
+    }
+}
+
+
+#if MUX_STATS
+
+/* Count the edges on every pin whose filtered level changed */
+static void count_edges(const MuxWord *before)
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord changed = (before[w] ^ mux_levels[w]) & used_slots[w] & ~internal_slots[w];
+
+	while (changed) {
+	    MUX_STATS_INC(edges[w * MUX_WORD_BITS + lowest_bit(changed)]);
+	    changed &= changed - 1;
+	}
+    }
+}
+
+#endif
+
+
+void mux_sample_inputs()
+{
+#if MUX_STATS
+    MuxWord before[MUX_SAMPLE_WORDS];
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	before[w] = mux_levels[w];
+    }
+#endif
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord used = used_slots[w] & ~internal_slots[w];
+
+	/* Internal signals keep whatever level they were last given */
+	MuxWord levels = mux_levels[w] & internal_slots[w];
+
+	while (used) {
+	    int bit = lowest_bit(used);
+
+	    if (HIGH == mux_pin_read(slot_pins[w * MUX_WORD_BITS + bit])) {
+		levels |= (MuxWord) 1 << bit;
+	    }
+
+	    used &= used - 1;
+	}
+
+	raw_levels[w] = levels;
+    }
+
+    if (!filtering) {
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    mux_levels[w] = raw_levels[w];
+	}
+
+#if MUX_STATS
+	count_edges(before);
+#endif
+
+	return;
+    }
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	MuxWord delta = raw_levels[w] ^ mux_levels[w];
+	MuxWord counting = count0[w] | count1[w] | count2[w];
+
+	/* Count up where the level differs, back to zero where it doesn't */
+	MuxWord c0 = ~count0[w] & delta;
+	MuxWord c1 = (count1[w] ^ count0[w]) & delta;
+	MuxWord c2 = (count2[w] ^ (count1[w] & count0[w])) & delta;
+
+	/* Pins whose counter has reached their depth take the new level */
+	MuxWord reached = delta & ~((c0 ^ depth0[w]) | (c1 ^ depth1[w]) | (c2 ^ depth2[w]));
+
+	mux_levels[w] ^= reached;
+
+	count0[w] = c0 & ~reached;
+	count1[w] = c1 & ~reached;
+	count2[w] = c2 & ~reached;
+
+	/* Counters that were running but went back to zero were glitches */
+	MuxWord rejected = counting & ~delta;
+
+	while (rejected) {
+	    ++glitches[w * MUX_WORD_BITS + lowest_bit(rejected)];
+	    ++total_glitches;
+
+	    rejected &= rejected - 1;
+	}
+    }
+
+#if MUX_STATS
+    count_edges(before);
+#endif
+}
+
+
+bool mux_sample_settled()
+{
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	if (count0[w] | count1[w] | count2[w]) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+
+/* Copies count words from one bit array to another */
+static void copy_words(MuxWord *to, const MuxWord *from, int count)
+{
+    for (int w = 0; w < count; ++w) {
+	to[w] = from[w];
+    }
+}
+
+
+void mux_sample_save(MuxSampleState *state)
+{
+    copy_words(state->levels, mux_levels, MUX_SAMPLE_WORDS);
+    copy_words(state->used_slots, used_slots, MUX_SAMPLE_WORDS);
+    copy_words(state->internal_slots, internal_slots, MUX_SAMPLE_WORDS);
+    copy_words(state->raw_levels, raw_levels, MUX_SAMPLE_WORDS);
+    copy_words(state->count0, count0, MUX_SAMPLE_WORDS);
+    copy_words(state->count1, count1, MUX_SAMPLE_WORDS);
+    copy_words(state->count2, count2, MUX_SAMPLE_WORDS);
+    copy_words(state->depth0, depth0, MUX_SAMPLE_WORDS);
+    copy_words(state->depth1, depth1, MUX_SAMPLE_WORDS);
+    copy_words(state->depth2, depth2, MUX_SAMPLE_WORDS);
+
+    for (int slot = 0; slot < MUX_MAX_INPUTS; ++slot) {
+	state->slot_pins[slot] = slot_pins[slot];
+	state->glitches[slot] = glitches[slot];
+#if MUX_STATS
+	state->edges[slot] = edges[slot];
+#endif
+    }
+
+    state->filtering = filtering;
+    state->total_glitches = total_glitches;
+}
+
+
+void mux_sample_load(const MuxSampleState *state)
+{
+    copy_words(mux_levels, state->levels, MUX_SAMPLE_WORDS);
+    copy_words(used_slots, state->used_slots, MUX_SAMPLE_WORDS);
+    copy_words(internal_slots, state->internal_slots, MUX_SAMPLE_WORDS);
+    copy_words(raw_levels, state->raw_levels, MUX_SAMPLE_WORDS);
+    copy_words(count0, state->count0, MUX_SAMPLE_WORDS);
+    copy_words(count1, state->count1, MUX_SAMPLE_WORDS);
+    copy_words(count2, state->count2, MUX_SAMPLE_WORDS);
+    copy_words(depth0, state->depth0, MUX_SAMPLE_WORDS);
+    copy_words(depth1, state->depth1, MUX_SAMPLE_WORDS);
+    copy_words(depth2, state->depth2, MUX_SAMPLE_WORDS);
+
+    for (int slot = 0; slot < MUX_MAX_INPUTS; ++slot) {
+	slot_pins[slot] = state->slot_pins[slot];
+	glitches[slot] = state->glitches[slot];
+#if MUX_STATS
+	edges[slot] = state->edges[slot];
+#endif
+    }
+
+    filtering = state->filtering;
+    total_glitches = state->total_glitches;
+}
+
+
+int mux_set_input_filter(int in_pin, int depth)
+{
+    int slot = mux_sample_slot(in_pin);
+
+    if (slot < 0 || depth < 1 || depth > MUX_MAX_FILTER_DEPTH) {
+	return 1;
+    }
+
+    set_slot_depth(slot, depth);
+    update_filtering();
+
+    return 0;
+}
+
+
+int mux_set_channel_filter(int out_pin, int channel, int depth)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node || depth < 1 || depth > MUX_MAX_FILTER_DEPTH) {
+	return 1;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, channel);
+
+    if (NULL == channel_node) {
+	return 1;
+    }
+
+    MuxInputNode *in_node = channel_node->inputs.head;
+    while (in_node) {
+	if (in_node->slot >= 0) {
+	    set_slot_depth(in_node->slot, depth);
+	}
+
+	in_node = in_node->next;
+    }
+
+    update_filtering();
+
+    return 0;
+}
+
+
+unsigned int mux_input_glitches(int in_pin)
+{
+    int slot = mux_sample_slot(in_pin);
+
+    return (slot < 0) ? 0 : glitches[slot];
+}
+
+
+unsigned long mux_total_glitches()
+{
+    return total_glitches;
+}
+
+
+#if MUX_STATS
+
+uint32_t mux_sample_edges(int slot)
+{
+    return (mux_sample_pin(slot) < 0) ? 0 : edges[slot];
+}
+
+
+void mux_sample_reset_edges()
+{
+    for (int slot = 0; slot < MUX_MAX_INPUTS; ++slot) {
+	edges[slot] = 0;
+    }
+}
+
+#endif
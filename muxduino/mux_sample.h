@@ -0,0 +1,296 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_SAMPLE_H
+#define MUX_SAMPLE_H
+
+/*
+  Input sampling and debouncing. Every distinct input pin of the
+  digital pipes gets a slot, and once per update all of the input
+  pins are read into a bit array with one bit per slot. The channels
+  then work from these bits instead of reading the pins themselves, so
+  each pin is only read once per update no matter how many channels
+  it is on.
+
+  Between reading the pins and handing the bits to the channels there
+  is a debounce filter. A pin only changes level once the new level
+  has been read for a number of updates in a row (the filter depth).
+  The filter uses vertical counters: bit n of each counter word is
+  one bit of the counter for slot n, so the counters for every input
+  are stepped with a handful of word operations per update, no matter
+  how many inputs there are.
+ */
+
+#include <stdint.h>
+
+#include "mux_config.h"
+
+
+/* Word used for the bit arrays, one bit per input slot */
+typedef uint32_t MuxWord;
+
+#define MUX_WORD_BITS 32
+
+/* MUX_MAX_INPUTS, the most distinct digital input pins, is set in mux_config.h */
+
+/* Number of words in each bit array */
+#define MUX_SAMPLE_WORDS ((MUX_MAX_INPUTS + MUX_WORD_BITS - 1) / MUX_WORD_BITS)
+
+/* Largest filter depth */
+#define MUX_MAX_FILTER_DEPTH 7
+
+
+/*
+  Filtered input levels from the last call to mux_sample_inputs(),
+  bit n is the level of the input in slot n.
+ */
+
+extern MuxWord mux_levels[MUX_SAMPLE_WORDS];
+
+
+/*
+  Everything that the sampler keeps between updates, so that it can
+  be put aside and brought back later (see mux_context_save() in
+  mux_state.h). The fields are copies of the sampler's own arrays.
+ */
+
+typedef struct MuxSampleState {
+    MuxWord levels[MUX_SAMPLE_WORDS];
+    int slot_pins[MUX_MAX_INPUTS];
+    MuxWord used_slots[MUX_SAMPLE_WORDS];
+    MuxWord internal_slots[MUX_SAMPLE_WORDS];
+    MuxWord raw_levels[MUX_SAMPLE_WORDS];
+
+    MuxWord count0[MUX_SAMPLE_WORDS];
+    MuxWord count1[MUX_SAMPLE_WORDS];
+    MuxWord count2[MUX_SAMPLE_WORDS];
+
+    MuxWord depth0[MUX_SAMPLE_WORDS];
+    MuxWord depth1[MUX_SAMPLE_WORDS];
+    MuxWord depth2[MUX_SAMPLE_WORDS];
+
+    bool filtering;
+
+    unsigned int glitches[MUX_MAX_INPUTS];
+    unsigned long total_glitches;
+
+#if MUX_STATS
+    uint32_t edges[MUX_MAX_INPUTS];
+#endif
+} MuxSampleState;
+
+
+/* Reading a single bit out of one of the bit arrays */
+#define MUX_BIT(words, n) (((words)[(n) / MUX_WORD_BITS] >> ((n) % MUX_WORD_BITS)) & 1)
+
+
+/*
+  Arguments:
+      pin: The input pin to look up.
+
+  Returns the slot for the pin, or -1 if it is not an input of any
+  digital pipe.
+
+ */
+
+int mux_sample_slot(int pin);
+
+
+/*
+  Arguments:
+      slot: The slot to look up.
+
+  Returns the pin in the slot, or -1 if the slot is not in use.
+
+ */
+
+int mux_sample_pin(int slot);
+
+
+/*
+  Arguments:
+      mask: Filled in with a bit for every slot which is read from a
+	    pin, leaving out free slots and internal signals.
+
+ */
+
+void mux_sample_external(MuxWord *mask);
+
+
+/*
+  Arguments:
+      pin: An input pin that is about to be registered.
+
+  Returns true if the pin is already an input, or there are fewer
+  than MUX_MAX_INPUTS distinct inputs. This goes by mux_outs rather
+  than the slots, so it is right even when mux_sample_rebuild() has
+  not been called since the last change.
+
+ */
+
+bool mux_sample_has_room(int pin);
+
+
+/*
+  Brings the slots up to date with the inputs in mux_outs, and sets
+  the slot field of every input node. Pins which are still there keep
+  their slot and filter state, pins which have gone away give up
+  their slot, and new pins get a free slot with a depth of 1.
+
+ */
+
+void mux_sample_rebuild();
+
+
+/*
+  Arguments:
+      internal: Bit for every slot which is an internal signal.
+
+  Internal signals are slots whose level is set directly in
+  mux_levels by whoever produces them (see mux_cascade.h), rather than
+  being read from a pin. They are skipped by mux_sample_inputs() and
+  are never filtered.
+
+ */
+
+void mux_sample_set_internal(const MuxWord *internal);
+
+
+/*
+  Reads every input pin and runs the filter, leaving the results in
+  mux_levels.
+
+ */
+
+void mux_sample_inputs();
+
+
+/*
+  Returns true if the filter has nothing in progress, so that the
+  filtered levels can't change until a pin does.
+
+ */
+
+bool mux_sample_settled();
+
+
+/*
+  Arguments:
+      state: Where to copy the sampler's state to.
+
+ */
+
+void mux_sample_save(MuxSampleState *state);
+
+
+/*
+  Arguments:
+      state: State from mux_sample_save() to carry on from.
+
+ */
+
+void mux_sample_load(const MuxSampleState *state);
+
+
+/*
+  Arguments:
+      in_pin: The input pin to filter.
+
+      depth: Number of updates in a row that a new level must be read
+	     before it is passed on, from 1 (no filtering) to
+	     MUX_MAX_FILTER_DEPTH.
+
+  Sets the filter depth of an input. Returns 0 on success, or 1 if
+  the pin is not an input or the depth is out of range. The depth is
+  forgotten once the pin is no longer the input of any pipe.
+
+ */
+
+int mux_set_input_filter(int in_pin, int depth);
+
+
+/*
+  Arguments:
+      out_pin: The output which owns the channel.
+
+      channel: The channel whose inputs we want to filter.
+
+      depth: The filter depth, as for mux_set_input_filter().
+
+  Sets the filter depth of every input on a channel. Since each input
+  pin is only filtered once, this affects the pin on every other
+  channel too. Returns 0 on success, or 1 if the channel does not
+  exist or the depth is out of range.
+
+ */
+
+int mux_set_channel_filter(int out_pin, int channel, int depth);
+
+
+/*
+  Arguments:
+      in_pin: The input pin.
+
+  Returns the number of glitches rejected on the pin since it was
+  registered. A glitch is a change in level which went away before
+  it lasted for the filter depth.
+
+ */
+
+unsigned int mux_input_glitches(int in_pin);
+
+
+/*
+  Returns the total number of glitches rejected on all inputs.
+
+ */
+
+unsigned long mux_total_glitches();
+
+
+#if MUX_STATS
+
+/*
+  Arguments:
+      slot: The slot to look at.
+
+  Returns the number of changes in the filtered level of the input in
+  the slot, stopping at MUX_STATS_MAX. See mux_stats.h.
+
+ */
+
+uint32_t mux_sample_edges(int slot);
+
+
+/*
+  Sets the edge count of every slot back to 0.
+
+ */
+
+void mux_sample_reset_edges();
+
+#endif
+
+#endif
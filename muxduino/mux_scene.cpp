@@ -0,0 +1,126 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#include "mux_scene.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "muxduino.h"
+
+
+/* One output's channel in a scene */
+typedef struct MuxSceneEntry {
+    int out_pin;
+    int channel;
+} MuxSceneEntry;
+
+
+typedef struct MuxScene {
+    MuxSceneEntry *entries;  /* NULL if nothing is stored */
+    int num_entries;
+} MuxScene;
+
+
+static MuxScene scenes[MUX_MAX_SCENES];
+
+
+int mux_scene_store(int id)
+{
+    if (id < 0 || id >= MUX_MAX_SCENES) {
+	return 1;
+    }
+
+    mux_scene_forget(id);
+
+    int num_entries = 0;
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	++num_entries;
+	out_node = out_node->next;
+    }
+
+    MuxScene *scene = &scenes[id];
+    /* One extra byte so that an empty scene is still non-NULL */
+    scene->entries = (MuxSceneEntry *) allocate_memory(num_entries * sizeof(MuxSceneEntry) + 1);
+    scene->num_entries = num_entries;
+
+    MuxSceneEntry *entry = scene->entries;
+    out_node = mux_outs.head;
+    while (out_node) {
+	entry->out_pin = out_node->out_pin;
+	entry->channel = out_node->channel_num;
+
+	++entry;
+	out_node = out_node->next;
+    }
+
+    return 0;
+}
+
+
+int mux_scene_recall(int id)
+{
+    if (id < 0 || id >= MUX_MAX_SCENES || NULL == scenes[id].entries) {
+	return 1;
+    }
+
+    MuxScene *scene = &scenes[id];
+
+    /*
+      The entries were stored in list order, so as long as the outputs
+      have not changed we can walk both together instead of searching
+      for each output.
+     */
+    MuxOutputNode *out_node = mux_outs.head;
+
+    for (int i = 0; i < scene->num_entries; ++i) {
+	MuxSceneEntry *entry = &scene->entries[i];
+
+	if (NULL != out_node && entry->out_pin == out_node->out_pin) {
+	    mux_select_channel(out_node, entry->channel,
+			       find_channel_node(&out_node->channels, entry->channel));
+	    out_node = out_node->next;
+	}
+	else {
+	    set_output_channel(entry->out_pin, entry->channel);
+	}
+    }
+
+    return 0;
+}
+
+
+void mux_scene_forget(int id)
+{
+    if (id < 0 || id >= MUX_MAX_SCENES || NULL == scenes[id].entries) {
+	return;
+    }
+
+    free_memory(scenes[id].entries);
+
+    scenes[id].entries = NULL;
+    scenes[id].num_entries = 0;
+}
@@ -0,0 +1,77 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_SCENE_H
+#define MUX_SCENE_H
+
+/*
+  Scenes are snapshots of the selected channel for every output. A
+  scene can be stored and then recalled later on to switch a whole
+  bunch of outputs over at once.
+ */
+
+/* Number of scenes that can be stored at once */
+#define MUX_MAX_SCENES 8
+
+
+/*
+  Arguments:
+      id: The scene to store, from 0 to MUX_MAX_SCENES - 1.
+
+  Remembers the current channel of every output as the scene,
+  replacing whatever was stored there before. This allocates some
+  memory. Returns 0 on success, or 1 if the id is out of range.
+
+ */
+
+int mux_scene_store(int id);
+
+
+/*
+  Arguments:
+      id: The scene to recall.
+
+  Sets the channel of every output in the scene back to what it was
+  when the scene was stored. Outputs which have been unregistered
+  since then are skipped. Returns 0 on success, or 1 if the id is out
+  of range or nothing is stored there.
+
+ */
+
+int mux_scene_recall(int id);
+
+
+/*
+  Arguments:
+      id: The scene to forget.
+
+  Frees the memory used by the scene. Does nothing if the id is out of
+  range or nothing is stored there.
+
+ */
+
+void mux_scene_forget(int id);
+
+#endif
@@ -0,0 +1,240 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_schedule.h"
+#include "muxduino.h"
+#include "mux_config.h"
+
+#include "mux_platform.h"
+
+#if defined(ARDUINO) && defined(__AVR__) && MUX_SCHEDULE_TIMER1
+#include <avr/interrupt.h>
+#define TIMER_UPDATES 1
+#else
+#define TIMER_UPDATES 0
+#endif
+
+
+static volatile bool running = false;
+
+/* Time between updates, and when the next update is due, in microseconds */
+static unsigned long period = 0;
+static volatile unsigned long due = 0;
+
+static volatile unsigned long cycles = 0;
+static volatile unsigned long overruns = 0;
+static volatile unsigned long missed = 0;
+static volatile unsigned long late = 0;
+static volatile unsigned long longest = 0;
+
+
+/* Run a single update which was due at the given time, and time it */
+static void run_cycle(unsigned long cycle_due)
+{
+    unsigned long start = micros();
+
+    if ((long) (start - cycle_due) > (long) (period / 2)) {
+	++late;
+    }
+
+    mux_update();
+
+    unsigned long took = micros() - start;
+
+    if (took > period) {
+	++overruns;
+    }
+
+    if (took > longest) {
+	longest = took;
+    }
+
+    ++cycles;
+}
+
+
+#if TIMER_UPDATES
+
+/* True while the timer interrupt is running an update */
+static volatile bool in_cycle = false;
+
+
+/* Timer1 prescalers, and the clock select bits for each */
+static const unsigned int prescalers[] = {1, 8, 64, 256, 1024};
+static const unsigned char clock_selects[] = {1, 2, 3, 4, 5};
+
+
+static void start_timer()
+{
+    unsigned long ticks = 0;
+    unsigned char select = 0;
+
+    /* Use the finest prescaler that the period fits in */
+    for (unsigned char i = 0; i < sizeof(prescalers) / sizeof(prescalers[0]); ++i) {
+	ticks = period * (F_CPU / 1000000UL) / prescalers[i];
+	select = clock_selects[i];
+
+	if (ticks <= 65536UL) {
+	    break;
+	}
+    }
+
+    if (ticks > 65536UL) {
+	ticks = 65536UL;
+    }
+
+    /* Clear timer on compare match with OCR1A */
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = ticks - 1;
+    TIFR1 = (1 << OCF1A);
+    TCCR1B = (1 << WGM12) | select;
+    TIMSK1 |= (1 << OCIE1A);
+}
+
+
+static void stop_timer()
+{
+    TIMSK1 &= ~(1 << OCIE1A);
+    TCCR1B = 0;
+}
+
+
+ISR(TIMER1_COMPA_vect)
+{
+    unsigned long cycle_due = due;
+    due = cycle_due + period;
+
+    if (in_cycle) {
+	/* The last update is still going, so this one has to be skipped */
+	++missed;
+	return;
+    }
+
+    in_cycle = true;
+
+    /* Let the other interrupts in while the update runs */
+    sei();
+    run_cycle(cycle_due);
+    cli();
+
+    in_cycle = false;
+}
+
+#endif
+
+
+int mux_schedule_start(unsigned long new_period)
+{
+    if (new_period < MUX_MIN_PERIOD || new_period > MUX_MAX_PERIOD) {
+	return 1;
+    }
+
+    mux_schedule_stop();
+    mux_schedule_reset_stats();
+
+    period = new_period;
+    due = micros() + period;
+    running = true;
+
+#if TIMER_UPDATES
+    start_timer();
+#endif
+
+    return 0;
+}
+
+
+void mux_schedule_stop()
+{
+#if TIMER_UPDATES
+    stop_timer();
+#endif
+
+    running = false;
+}
+
+
+bool mux_schedule_running()
+{
+    return running;
+}
+
+
+void mux_schedule_poll()
+{
+#if !TIMER_UPDATES
+    if (!running) {
+	return;
+    }
+
+    long ahead = (long) (micros() - due);
+
+    if (ahead < 0) {
+	return;
+    }
+
+    /* Skip over any whole periods which went by without a poll */
+    unsigned long behind = (unsigned long) ahead / period;
+
+    missed += behind;
+    due += behind * period;
+
+    unsigned long cycle_due = due;
+    due = cycle_due + period;
+
+    run_cycle(cycle_due);
+#endif
+}
+
+
+void mux_schedule_stats(MuxScheduleStats *stats)
+{
+    noInterrupts();
+
+    stats->cycles = cycles;
+    stats->overruns = overruns;
+    stats->missed = missed;
+    stats->late = late;
+    stats->longest = longest;
+
+    interrupts();
+}
+
+
+void mux_schedule_reset_stats()
+{
+    noInterrupts();
+
+    cycles = 0;
+    overruns = 0;
+    missed = 0;
+    late = 0;
+    longest = 0;
+
+    interrupts();
+}
@@ -0,0 +1,143 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_SCHEDULE_H
+#define MUX_SCHEDULE_H
+
+/*
+  Fixed rate updates. Calling mux_update() from loop() gives an update
+  rate which depends on how big the topology is and on whatever else
+  the sketch does. The scheduler instead runs mux_update() once every
+  period, so the inputs are sampled at a steady rate.
+
+  With MUX_SCHEDULE_TIMER1 set to 1 in mux_config.h, AVR boards use
+  Timer1, and each update runs from the timer interrupt (with
+  interrupts turned back on, so millis(), Wire and the ADC keep
+  working). This means Timer1 can't be used by anything else, such as
+  the Servo library or PWM on its pins. Otherwise, and always on other
+  boards and the host build, mux_schedule_poll() has to be called
+  often from loop() -- it runs an update whenever one is due, just as
+  the timer would.
+
+  While the scheduler is running on Timer1, updates can happen in
+  between any two instructions of the sketch. Stop the scheduler, or wrap the call
+  in noInterrupts() / interrupts(), before changing the topology.
+ */
+
+
+/* Shortest period, in microseconds */
+#define MUX_MIN_PERIOD 50
+
+/* Longest period, in microseconds */
+#define MUX_MAX_PERIOD 4000000UL
+
+
+/*
+  Statistics for the scheduler.
+
+  Fields:
+      cycles: Number of updates that were run.
+
+      overruns: Number of updates which took longer than the period.
+
+      missed: Number of periods where no update was run, because the
+	      last one was still going (or mux_schedule_poll() wasn't
+	      called in time).
+
+      late: Number of updates which started more than half a period
+	    after they were due.
+
+      longest: Longest time an update has taken, in microseconds.
+ */
+
+typedef struct MuxScheduleStats {
+    unsigned long cycles;
+    unsigned long overruns;
+    unsigned long missed;
+    unsigned long late;
+    unsigned long longest;
+} MuxScheduleStats;
+
+
+/*
+  Arguments:
+      period: Time between updates, in microseconds, from
+	      MUX_MIN_PERIOD to MUX_MAX_PERIOD.
+
+  Starts running mux_update() every period, with the first update
+  one period from now. If the scheduler is already running the period
+  is changed. Returns 0 on success, or 1 if the period is out of
+  range. The statistics are reset.
+
+ */
+
+int mux_schedule_start(unsigned long period);
+
+
+/*
+  Stops running updates. Once this returns no update is in progress.
+
+ */
+
+void mux_schedule_stop();
+
+
+/*
+  Returns true if the scheduler is running.
+
+ */
+
+bool mux_schedule_running();
+
+
+/*
+  Runs an update if one is due. This does nothing when the Timer1
+  interrupt runs the updates (see MUX_SCHEDULE_TIMER1), so it is safe
+  to call it from loop() on any board.
+
+ */
+
+void mux_schedule_poll();
+
+
+/*
+  Arguments:
+      stats: Filled in with the statistics since the scheduler was
+	     started, or since they were last reset.
+
+ */
+
+void mux_schedule_stats(MuxScheduleStats *stats);
+
+
+/*
+  Resets the statistics to zero.
+
+ */
+
+void mux_schedule_reset_stats();
+
+#endif
@@ -0,0 +1,703 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+#include "mux_sim.h"
+
+#ifndef ARDUINO
+
+#include "muxduino.h"
+#include "mux_output.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+#include "mux_transform.h"
+#include "mem_alloc.h"
+
+#include "mux_platform.h"
+
+
+/*
+  A board in the simulation. The changed_at array holds the cycle each
+  pin last changed in, and first_net is the first of the nets that the
+  board drives, which are chained through their next fields.
+
+  A board can stop being updated once it has gone settle updates in a
+  row without anything changing, unless always_awake is set. queued
+  is one more than the cycle the board is waiting to be updated in,
+  so that it is never queued twice.
+ */
+
+typedef struct MuxSimBoard {
+    MuxContext context;
+    MuxHostPins pins;
+    long changed_at[MUX_HOST_PINS];
+
+    int first_net;
+
+    unsigned long settle;
+    bool always_awake;
+    unsigned long quiet;
+    bool touched;
+    unsigned long queued;
+} MuxSimBoard;
+
+
+typedef struct MuxSimNet {
+    int from_pin;
+    int to_board;
+    int to_pin;
+    unsigned int delay;
+
+    /* Next net driven by the same board, -1 at the end */
+    int next;
+} MuxSimNet;
+
+
+/* A pin change on its way along a net, or from mux_sim_set_input() */
+typedef struct MuxSimEvent {
+    unsigned long time;
+    unsigned long order;
+    int board;
+    int pin;
+    int level;
+} MuxSimEvent;
+
+
+static MuxSimBoard **boards = NULL;
+static int num_boards = 0;
+static int max_boards = 0;
+
+static MuxSimNet *nets = NULL;
+static int num_nets = 0;
+static int max_nets = 0;
+
+/* Heap of events, earliest (and then oldest) first */
+static MuxSimEvent *events = NULL;
+static unsigned long num_events = 0;
+static unsigned long max_events = 0;
+static unsigned long next_order = 0;
+
+/* Boards to update in this cycle, and in the next one */
+static int *awake = NULL;
+static int num_awake = 0;
+static int *next_awake = NULL;
+static int num_next_awake = 0;
+
+static unsigned long now = 0;
+static MuxSimStats stats = {0, 0, 0, 0};
+
+/* Selected board, and the program's own context while one is selected */
+static int selected = -1;
+static MuxContext home;
+
+
+static void free_if_used(void *ptr)
+{
+    if (ptr) {
+	free_memory(ptr);
+    }
+}
+
+
+/*
+  Grows an array to hold at least one more item, doubling its size.
+  Returns false if there isn't enough memory, leaving it as it was.
+ */
+static bool grow(void **array, unsigned long count, unsigned long *max, size_t size)
+{
+    if (count < *max) {
+	return true;
+    }
+
+    unsigned long new_max = *max ? 2 * *max : 16;
+    char *new_array = (char *) allocate_memory(new_max * size);
+
+    if (NULL == new_array) {
+	return false;
+    }
+
+    char *old_array = (char *) *array;
+    for (size_t i = 0; i < count * size; ++i) {
+	new_array[i] = old_array[i];
+    }
+
+    free_if_used(*array);
+
+    *array = new_array;
+    *max = new_max;
+
+    return true;
+}
+
+
+static bool valid_board(int board)
+{
+    return board >= 0 && board < num_boards;
+}
+
+
+static bool valid_pin(int pin)
+{
+    return pin >= 0 && pin < MUX_HOST_PINS;
+}
+
+
+static int pin_level(const MuxHostPins *pins, int pin)
+{
+    return (pins->levels[pin / MUX_HOST_PIN_WORD_BITS] >> (pin % MUX_HOST_PIN_WORD_BITS)) & 1 ? HIGH : LOW;
+}
+
+
+static void set_pin_level(MuxHostPins *pins, int pin, int level)
+{
+    unsigned long bit = 1UL << (pin % MUX_HOST_PIN_WORD_BITS);
+
+    if (LOW != level) {
+	pins->levels[pin / MUX_HOST_PIN_WORD_BITS] |= bit;
+    }
+    else {
+	pins->levels[pin / MUX_HOST_PIN_WORD_BITS] &= ~bit;
+    }
+}
+
+
+/* True if event a should happen before event b */
+static bool event_before(const MuxSimEvent *a, const MuxSimEvent *b)
+{
+    return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+
+static void swap_events(unsigned long a, unsigned long b)
+{
+    MuxSimEvent event = events[a];
+
+    events[a] = events[b];
+    events[b] = event;
+}
+
+
+static bool push_event(unsigned long time, int board, int pin, int level)
+{
+    if (!grow((void **) &events, num_events, &max_events, sizeof(MuxSimEvent))) {
+	return false;
+    }
+
+    unsigned long child = num_events++;
+
+    events[child].time = time;
+    events[child].order = next_order++;
+    events[child].board = board;
+    events[child].pin = pin;
+    events[child].level = level;
+
+    while (child > 0) {
+	unsigned long parent = (child - 1) / 2;
+
+	if (!event_before(&events[child], &events[parent])) {
+	    break;
+	}
+
+	swap_events(child, parent);
+	child = parent;
+    }
+
+    return true;
+}
+
+
+static void pop_event()
+{
+    events[0] = events[--num_events];
+
+    unsigned long parent = 0;
+
+    while (true) {
+	unsigned long first = parent;
+	unsigned long left = 2 * parent + 1;
+	unsigned long right = left + 1;
+
+	if (left < num_events && event_before(&events[left], &events[first])) {
+	    first = left;
+	}
+
+	if (right < num_events && event_before(&events[right], &events[first])) {
+	    first = right;
+	}
+
+	if (first == parent) {
+	    break;
+	}
+
+	swap_events(parent, first);
+	parent = first;
+    }
+}
+
+
+/* Queue a board for the cycle being simulated */
+static void wake(int board)
+{
+    MuxSimBoard *sim_board = boards[board];
+
+    if (now + 1 != sim_board->queued) {
+	sim_board->queued = now + 1;
+	awake[num_awake++] = board;
+    }
+}
+
+
+/* Queue a board for the cycle after the one being simulated */
+static void wake_next(int board)
+{
+    MuxSimBoard *sim_board = boards[board];
+
+    if (now + 2 != sim_board->queued) {
+	sim_board->queued = now + 2;
+	next_awake[num_next_awake++] = board;
+    }
+}
+
+
+/*
+  Works out how long the loaded board can keep changing after its
+  inputs stop. Each output is only evaluated every divider'th update,
+  and its transforms can hold a change for span evaluations.
+ */
+static void find_settle(MuxSimBoard *sim_board)
+{
+    sim_board->settle = 0;
+    sim_board->always_awake = false;
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	if (out_node->tdm) {
+	    sim_board->always_awake = true;
+	}
+
+	unsigned long divider = out_node->divider ? out_node->divider : 1;
+	unsigned long settle = (mux_transform_span(out_node) + 1) * divider - 1;
+
+	if (settle > sim_board->settle) {
+	    sim_board->settle = settle;
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+static void load_board(int board)
+{
+    mux_context_load(&boards[board]->context);
+    mux_host_use_pins(&boards[board]->pins);
+}
+
+
+/* Put the selected board (or the program's context) away */
+static void park()
+{
+    if (selected >= 0) {
+	MuxSimBoard *sim_board = boards[selected];
+
+	/* It may have been changed while selected */
+	find_settle(sim_board);
+	mux_context_save(&sim_board->context);
+	sim_board->quiet = 0;
+	wake(selected);
+    }
+    else {
+	mux_context_save(&home);
+    }
+}
+
+
+static void unpark()
+{
+    if (selected >= 0) {
+	load_board(selected);
+    }
+    else {
+	mux_context_load(&home);
+	mux_host_use_pins(NULL);
+    }
+}
+
+
+int mux_sim_add_board()
+{
+    unsigned long max = max_boards;
+
+    if (!grow((void **) &boards, num_boards, &max, sizeof(MuxSimBoard *))) {
+	return -1;
+    }
+
+    if (max != (unsigned long) max_boards) {
+	/* Every board could be awake at once, so the queues grow too */
+	int *new_awake = (int *) allocate_memory(max * sizeof(int));
+	int *new_next_awake = (int *) allocate_memory(max * sizeof(int));
+
+	if (NULL == new_awake || NULL == new_next_awake) {
+	    free_if_used(new_awake);
+	    free_if_used(new_next_awake);
+	    return -1;
+	}
+
+	for (int i = 0; i < num_awake; ++i) {
+	    new_awake[i] = awake[i];
+	}
+
+	free_if_used(awake);
+	free_if_used(next_awake);
+
+	awake = new_awake;
+	next_awake = new_next_awake;
+	max_boards = max;
+    }
+
+    MuxSimBoard *sim_board = (MuxSimBoard *) allocate_memory(sizeof(MuxSimBoard));
+
+    if (NULL == sim_board) {
+	return -1;
+    }
+
+    mux_context_init(&sim_board->context);
+
+    for (int w = 0; w < MUX_HOST_PIN_WORDS; ++w) {
+	sim_board->pins.levels[w] = 0;
+    }
+
+    for (int pin = 0; pin < MUX_HOST_PINS; ++pin) {
+	sim_board->pins.modes[pin] = INPUT;
+	sim_board->changed_at[pin] = -1;
+    }
+
+    sim_board->first_net = -1;
+    sim_board->settle = 0;
+    sim_board->always_awake = false;
+    sim_board->quiet = 0;
+    sim_board->touched = false;
+    sim_board->queued = 0;
+
+    boards[num_boards] = sim_board;
+    return num_boards++;
+}
+
+
+int mux_sim_num_boards()
+{
+    return num_boards;
+}
+
+
+int mux_sim_select(int board)
+{
+    if (-1 != board && !valid_board(board)) {
+	return 1;
+    }
+
+    park();
+    selected = board;
+    unpark();
+
+    return 0;
+}
+
+
+int mux_sim_connect(int from_board, int out_pin, int to_board, int in_pin,
+		    unsigned int delay)
+{
+    if (!valid_board(from_board) || !valid_board(to_board)) {
+	return 1;
+    }
+
+    if (!valid_pin(out_pin) || !valid_pin(in_pin)) {
+	return 2;
+    }
+
+    if (0 == delay) {
+	return 3;
+    }
+
+    unsigned long max = max_nets;
+
+    if (!grow((void **) &nets, num_nets, &max, sizeof(MuxSimNet))) {
+	return 4;
+    }
+
+    max_nets = max;
+
+    MuxSimBoard *from = boards[from_board];
+    MuxSimNet *net = &nets[num_nets];
+
+    net->from_pin = out_pin;
+    net->to_board = to_board;
+    net->to_pin = in_pin;
+    net->delay = delay;
+    net->next = from->first_net;
+
+    from->first_net = num_nets++;
+
+    /* The other end has to start out at the same level */
+    return push_event(now, to_board, in_pin, pin_level(&from->pins, out_pin)) ? 0 : 4;
+}
+
+
+int mux_sim_set_input(int board, int pin, int level)
+{
+    if (!valid_board(board)) {
+	return 1;
+    }
+
+    if (!valid_pin(pin)) {
+	return 2;
+    }
+
+    return push_event(now, board, pin, level) ? 0 : 3;
+}
+
+
+int mux_sim_get_level(int board, int pin)
+{
+    if (!valid_board(board) || !valid_pin(pin)) {
+	return -1;
+    }
+
+    return pin_level(&boards[board]->pins, pin);
+}
+
+
+long mux_sim_last_change(int board, int pin)
+{
+    if (!valid_board(board) || !valid_pin(pin)) {
+	return -1;
+    }
+
+    return boards[board]->changed_at[pin];
+}
+
+
+long mux_sim_delay(int from_board, int from_pin, int to_board, int to_pin)
+{
+    long from = mux_sim_last_change(from_board, from_pin);
+    long to = mux_sim_last_change(to_board, to_pin);
+
+    if (from < 0 || to < from) {
+	return -1;
+    }
+
+    return to - from;
+}
+
+
+/* Apply every event which is due in the cycle being simulated */
+static void deliver_events()
+{
+    while (num_events && now == events[0].time) {
+	MuxSimEvent event = events[0];
+	MuxSimBoard *sim_board = boards[event.board];
+
+	pop_event();
+
+	if (pin_level(&sim_board->pins, event.pin) != event.level) {
+	    set_pin_level(&sim_board->pins, event.pin, event.level);
+	    sim_board->changed_at[event.pin] = now;
+	    sim_board->touched = true;
+
+	    wake(event.board);
+	}
+    }
+}
+
+
+/* Send a change on one of the board's pins along every net it drives */
+static void drive_nets(MuxSimBoard *sim_board, int pin, int level)
+{
+    for (int n = sim_board->first_net; n >= 0; n = nets[n].next) {
+	MuxSimNet *net = &nets[n];
+
+	if (pin == net->from_pin) {
+	    push_event(now + net->delay, net->to_board, net->to_pin, level);
+	    ++stats.events;
+	}
+    }
+}
+
+
+static void update_board(int board)
+{
+    MuxSimBoard *sim_board = boards[board];
+    unsigned long before[MUX_HOST_PIN_WORDS];
+
+    for (int w = 0; w < MUX_HOST_PIN_WORDS; ++w) {
+	before[w] = sim_board->pins.levels[w];
+    }
+
+    load_board(board);
+    mux_update();
+
+    bool settled = mux_sample_settled();
+    mux_context_save(&sim_board->context);
+
+    ++stats.updates;
+
+    bool changed = false;
+
+    for (int w = 0; w < MUX_HOST_PIN_WORDS; ++w) {
+	unsigned long changes = before[w] ^ sim_board->pins.levels[w];
+
+	while (changes) {
+	    int pin = w * MUX_HOST_PIN_WORD_BITS + __builtin_ctzl(changes);
+
+	    sim_board->changed_at[pin] = now;
+	    drive_nets(sim_board, pin, pin_level(&sim_board->pins, pin));
+
+	    changed = true;
+	    changes &= changes - 1;
+	}
+    }
+
+    if (changed || sim_board->touched) {
+	sim_board->quiet = 0;
+    }
+    else {
+	++sim_board->quiet;
+    }
+
+    sim_board->touched = false;
+
+    if (sim_board->always_awake || !settled || sim_board->quiet < sim_board->settle) {
+	wake_next(board);
+    }
+}
+
+
+unsigned long mux_sim_run(unsigned long max_cycles)
+{
+    unsigned long start = now;
+    unsigned long end = (max_cycles > ~0UL - now) ? ~0UL : now + max_cycles;
+
+    park();
+
+    while (now < end) {
+	if (0 == num_awake) {
+	    if (0 == num_events) {
+		break;
+	    }
+
+	    /* Nothing happens until the next event, so skip ahead */
+	    unsigned long next = (events[0].time < end) ? events[0].time : end;
+
+	    stats.skipped += (next - now) * num_boards;
+	    now = next;
+
+	    if (now == end) {
+		break;
+	    }
+	}
+
+	deliver_events();
+
+	for (int i = 0; i < num_awake; ++i) {
+	    update_board(awake[i]);
+	}
+
+	stats.skipped += num_boards - num_awake;
+
+	int *swap = awake;
+	awake = next_awake;
+	next_awake = swap;
+
+	num_awake = num_next_awake;
+	num_next_awake = 0;
+
+	++now;
+    }
+
+    unpark();
+
+    stats.cycles = now;
+    return now - start;
+}
+
+
+unsigned long mux_sim_now()
+{
+    return now;
+}
+
+
+bool mux_sim_quiet()
+{
+    return 0 == num_awake && 0 == num_events;
+}
+
+
+void mux_sim_stats(MuxSimStats *out_stats)
+{
+    *out_stats = stats;
+    out_stats->cycles = now;
+}
+
+
+void mux_sim_clear()
+{
+    mux_sim_select(-1);
+
+    for (int board = 0; board < num_boards; ++board) {
+	mux_output_list_clear(&boards[board]->context.outs);
+	free_memory(boards[board]);
+    }
+
+    free_if_used(boards);
+    free_if_used(nets);
+    free_if_used(events);
+    free_if_used(awake);
+    free_if_used(next_awake);
+
+    boards = NULL;
+    num_boards = 0;
+    max_boards = 0;
+
+    nets = NULL;
+    num_nets = 0;
+    max_nets = 0;
+
+    events = NULL;
+    num_events = 0;
+    max_events = 0;
+    next_order = 0;
+
+    awake = NULL;
+    num_awake = 0;
+    next_awake = NULL;
+    num_next_awake = 0;
+
+    now = 0;
+    stats.cycles = 0;
+    stats.updates = 0;
+    stats.skipped = 0;
+    stats.events = 0;
+}
+
+#endif
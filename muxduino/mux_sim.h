@@ -0,0 +1,245 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_SIM_H
+#define MUX_SIM_H
+
+/*
+  Simulator for several MuxDuino boards wired together. Each board
+  has its own topology and its own set of host pins, and a netlist
+  joins the output pins of one board to the input pins of another.
+  Routing changes to a whole chain of boards can then be tried out on
+  a computer rather than on the bench.
+
+  Time moves in update cycles. On each cycle every board which might
+  do something runs one mux_update(), and any output pin which
+  changed is passed along its nets, to be seen by the boards on the
+  other end after the net's delay. Boards whose inputs didn't change
+  and which have nothing left to do (no filter counting, no transform
+  or rate divider holding a change) are skipped, and cycles where no
+  board has anything to do are jumped over, so large networks run
+  much faster than the boards would in real time.
+
+  Boards are set up with the usual functions from muxduino.h, after
+  picking the board with mux_sim_select(). Only what's kept in a
+  MuxContext (see mux_state.h) belongs to a board, so expanders,
+  analog pipes, scenes and the capture buffer are shared by every
+  board and shouldn't be used in a simulation. Boards with channel
+  schedules (mux_tdm.h) never sleep, since their channels change by
+  themselves.
+
+  This is only built for the host backend.
+ */
+
+#ifndef ARDUINO
+
+/*
+  Statistics for a simulation.
+
+  Fields:
+      cycles: Update cycles simulated so far.
+
+      updates: Board updates that were actually run.
+
+      skipped: Board updates that were skipped, because the board
+	       couldn't have changed.
+
+      events: Pin changes delivered along nets.
+ */
+
+typedef struct MuxSimStats {
+    unsigned long cycles;
+    unsigned long updates;
+    unsigned long skipped;
+    unsigned long events;
+} MuxSimStats;
+
+
+/*
+  Adds a board with no pipes and all of its pins LOW. Returns the
+  number of the new board, counting up from 0, or -1 if there isn't
+  enough memory.
+
+ */
+
+int mux_sim_add_board();
+
+
+/*
+  Returns the number of boards that have been added.
+
+ */
+
+int mux_sim_num_boards();
+
+
+/*
+  Arguments:
+      board: The board to set up, or -1 to go back to the program's
+	     own topology.
+
+  Makes the board's topology and pins the current ones, so that
+  register_pipe(), set_output_channel() and the rest of muxduino.h
+  act on it. Returns 0 on success, and 1 if there is no such board.
+
+ */
+
+int mux_sim_select(int board);
+
+
+/*
+  Arguments:
+      from_board: Board driving the net.
+
+      out_pin: Pin on from_board driving the net.
+
+      to_board: Board on the other end.
+
+      in_pin: Pin on to_board which follows out_pin.
+
+      delay: Update cycles between out_pin changing and to_board
+	     seeing it, at least 1.
+
+  Wires out_pin to in_pin. A pin may drive any number of nets.
+  Returns 0 on success, 1 if either board doesn't exist, 2 if either
+  pin is out of range, 3 if the delay is 0, and 4 if there isn't
+  enough memory.
+
+ */
+
+int mux_sim_connect(int from_board, int out_pin, int to_board, int in_pin,
+		    unsigned int delay);
+
+
+/*
+  Arguments:
+      board: The board to drive.
+
+      pin: The input pin to drive.
+
+      level: HIGH or LOW.
+
+  Drives a pin from outside of the network, as of the next cycle to
+  be simulated. Returns 0 on success, 1 if there is no such board, 2
+  if the pin is out of range, and 3 if there isn't enough memory.
+
+ */
+
+int mux_sim_set_input(int board, int pin, int level);
+
+
+/*
+  Arguments:
+      board: The board to look at.
+
+      pin: The pin to look at.
+
+  Returns the level of the pin, or -1 if there is no such board or
+  pin.
+
+ */
+
+int mux_sim_get_level(int board, int pin);
+
+
+/*
+  Arguments:
+      board: The board to look at.
+
+      pin: The pin to look at.
+
+  Returns the cycle in which the pin last changed, or -1 if it hasn't
+  changed (or there is no such board or pin).
+
+ */
+
+long mux_sim_last_change(int board, int pin);
+
+
+/*
+  Arguments:
+      from_board, from_pin: Where a change started.
+
+      to_board, to_pin: Where the change ended up.
+
+  Returns the number of cycles between the last changes of the two
+  pins, which is how long the change took to get through the boards
+  in between. -1 if either pin hasn't changed, or to_pin last changed
+  before from_pin did.
+
+ */
+
+long mux_sim_delay(int from_board, int from_pin, int to_board, int to_pin);
+
+
+/*
+  Arguments:
+      max_cycles: Most update cycles to simulate.
+
+  Runs the simulation until nothing is left to happen, or until
+  max_cycles have gone by. Returns the number of cycles simulated.
+
+ */
+
+unsigned long mux_sim_run(unsigned long max_cycles);
+
+
+/*
+  Returns the next cycle to be simulated, which starts at 0.
+
+ */
+
+unsigned long mux_sim_now();
+
+
+/*
+  Returns true if no board has anything left to do.
+
+ */
+
+bool mux_sim_quiet();
+
+
+/*
+  Arguments:
+      stats: Where to put the statistics.
+
+ */
+
+void mux_sim_stats(MuxSimStats *stats);
+
+
+/*
+  Removes every board and net, and goes back to the program's own
+  topology and pins.
+
+ */
+
+void mux_sim_clear();
+
+#endif
+
+#endif
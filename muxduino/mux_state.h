@@ -0,0 +1,141 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+#ifndef MUX_STATE_H
+#define MUX_STATE_H
+
+/*
+  Internal state shared between the parts of MuxDuino. This is not
+  part of the public interface -- sketches should go through the
+  functions in muxduino.h instead.
+ */
+
+#include "mux_output.h"
+#include "mux_sample.h"
+
+
+/* Main list for muxduino outputs, defined in muxduino.cpp */
+extern MuxOutputList mux_outs;
+
+
+/* Number of calls to mux_update() so far, defined in muxduino.cpp */
+extern unsigned long mux_update_count;
+
+
+/*
+  Must be called after anything is added to or removed from mux_outs,
+  to bring everything which is worked out from the topology (such as
+  the input slots) up to date.
+ */
+
+void mux_topology_changed();
+
+
+/*
+  Arguments:
+      pipe: The pipe to add.
+
+  Does everything that register_pipe() does except for calling
+  mux_topology_changed(), so that a batch of changes only has to
+  rebuild once at the end. The checks only look at mux_outs, so they
+  hold up while the rest is out of date. Returns the same values as
+  register_pipe().
+
+ */
+
+int mux_add_pipe(MuxPipe pipe);
+
+
+/*
+  Arguments:
+      out_node: The output to switch.
+
+      new_channel: The channel to switch to.
+
+      channel_node: The node for new_channel on the output, or NULL if
+		    it has no such channel.
+
+  Switches the output's channel, and records the switch in the
+  capture (see mux_capture.h) if the channel changed. Everything that
+  changes an output's channel goes through here, so that every switch
+  is seen by the capture and its channel trigger.
+
+ */
+
+void mux_select_channel(MuxOutputNode *out_node, int new_channel,
+			MuxChannelNode *channel_node);
+
+
+/*
+  Everything that one set of pipes needs to carry on routing: the
+  topology, the sampler's state and the update count. Saving the
+  context and loading another swaps the whole router over, which is
+  how the simulator in mux_sim.h runs many boards in one program.
+
+  The pins themselves, expanders, analog pipes, scenes, the capture
+  buffer and the scheduler aren't part of a context, and are shared
+  by every context.
+ */
+
+typedef struct MuxContext {
+    MuxOutputList outs;
+    unsigned long update_count;
+    bool cascade;
+    MuxSampleState sample;
+} MuxContext;
+
+
+/*
+  Arguments:
+      context: Context to set up with no pipes, as at startup.
+
+ */
+
+void mux_context_init(MuxContext *context);
+
+
+/*
+  Arguments:
+      context: Where to save the current context.
+
+  The topology now belongs to the saved context, so the current one
+  should be replaced with mux_context_load() before anything else is
+  done with it.
+
+ */
+
+void mux_context_save(MuxContext *context);
+
+
+/*
+  Arguments:
+      context: Context to carry on from, as saved by mux_context_save()
+	       or set up by mux_context_init().
+
+ */
+
+void mux_context_load(const MuxContext *context);
+
+#endif
@@ -0,0 +1,166 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_stats.h"
+
+#if MUX_STATS
+
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+
+#include "mux_platform.h"
+
+
+/* Move the cursor to the first input at or after its position that exists */
+static void settle_cursor(MuxStatsCursor *cursor)
+{
+    while (cursor->out_node) {
+	while (cursor->channel_node) {
+	    if (cursor->in_node) {
+		return;
+	    }
+
+	    cursor->channel_node = cursor->channel_node->next;
+	    cursor->in_node = cursor->channel_node ? cursor->channel_node->inputs.head : NULL;
+	}
+
+	cursor->out_node = cursor->out_node->next;
+	cursor->channel_node = cursor->out_node ? cursor->out_node->channels.head : NULL;
+	cursor->in_node = cursor->channel_node ? cursor->channel_node->inputs.head : NULL;
+    }
+}
+
+
+void mux_stats_begin(MuxStatsCursor *cursor)
+{
+    cursor->out_node = mux_outs.head;
+    cursor->channel_node = cursor->out_node ? cursor->out_node->channels.head : NULL;
+    cursor->in_node = cursor->channel_node ? cursor->channel_node->inputs.head : NULL;
+
+    settle_cursor(cursor);
+}
+
+
+bool mux_stats_next(MuxStatsCursor *cursor, MuxPipeStats *stats)
+{
+    if (NULL == cursor->out_node) {
+	return false;
+    }
+
+    MuxInputNode *in_node = cursor->in_node;
+
+    stats->pipe.in_pin = in_node->in_pin;
+    stats->pipe.out_pin = cursor->out_node->out_pin;
+    stats->pipe.channel = cursor->channel_node->channel;
+
+    stats->input_edges = mux_sample_edges(in_node->slot);
+    stats->wins = in_node->wins;
+    stats->output_toggles = cursor->out_node->toggles;
+    stats->selected = cursor->channel_node->selected;
+
+    cursor->in_node = in_node->next;
+    settle_cursor(cursor);
+
+    return true;
+}
+
+
+void mux_stats_reset()
+{
+    mux_sample_reset_edges();
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	out_node->toggles = 0;
+
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    channel_node->selected = 0;
+
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		in_node->wins = 0;
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+void mux_stats_output(MuxOutputNode *out_node, int level)
+{
+    MuxChannelNode *channel_node = out_node->current_channel;
+
+    MUX_STATS_INC(channel_node->selected);
+
+    if (out_node->level >= 0 && level != out_node->level) {
+	MUX_STATS_INC(out_node->toggles);
+    }
+
+    if (HIGH != level) {
+	return;
+    }
+
+    /* Find the inputs which are HIGH, as the channel saw them */
+    MuxWord active[MUX_SAMPLE_WORDS];
+    bool any = false;
+
+    for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	active[w] = ((mux_levels[w] & ~channel_node->transformed[w]) | channel_node->shaped[w])
+	    & channel_node->mask[w];
+
+	if (active[w]) {
+	    any = true;
+	}
+    }
+
+    if (!any) {
+	return;
+    }
+
+    MuxInputNode *in_node = channel_node->inputs.head;
+    while (in_node) {
+	if (in_node->slot >= 0 && MUX_BIT(active, in_node->slot)) {
+	    MUX_STATS_INC(in_node->wins);
+
+	    /* Only the first HIGH input in the channel's order wins */
+	    if (MUX_COMBINE_PRIORITY == channel_node->combine) {
+		break;
+	    }
+	}
+
+	in_node = in_node->next;
+    }
+}
+
+#endif
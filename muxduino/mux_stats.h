@@ -0,0 +1,158 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_STATS_H
+#define MUX_STATS_H
+
+/*
+  Activity counters, for finding out which parts of a topology are
+  actually used. These are only built when MUX_STATS is 1 (see
+  mux_config.h); otherwise none of this exists and the nodes carry no
+  counters at all.
+
+  The counters are:
+
+      input edges: Changes in the filtered level of an input pin.
+
+      wins: Updates where the pipe's input helped make its channel
+	    HIGH. Every HIGH input counts when a channel comes out
+	    HIGH, except for MUX_COMBINE_PRIORITY where only the
+	    winner does.
+
+      output toggles: Changes in the level written to an output.
+
+      selected: Updates where the channel was the one evaluated for
+		its output.
+
+  All of them are 32 bit, and stop at MUX_STATS_MAX instead of
+  wrapping around. A counter at MUX_STATS_MAX has stopped counting,
+  and only says that it got there at some point. selected and wins
+  can go up on every update, so at 10000 updates a second they get
+  there after about five days. Read them and call mux_stats_reset()
+  more often than that.
+ */
+
+#include "mux_config.h"
+
+#if MUX_STATS
+
+#include <stdint.h>
+
+#include "mux_pipe.h"
+#include "mux_output.h"
+
+
+/* Largest value of a counter, they are all 32 bit */
+#define MUX_STATS_MAX 0xFFFFFFFFUL
+
+
+/* Add one to a counter, unless it is already at the top */
+#define MUX_STATS_INC(counter) ((counter) += ((counter) != MUX_STATS_MAX))
+
+
+/*
+  Counters for a single pipe, along with the counters of the input,
+  channel and output it belongs to.
+
+  Fields:
+      pipe: The pipe.
+
+      input_edges: Edges on the pipe's input pin.
+
+      wins: Wins for the pipe.
+
+      output_toggles: Toggles on the pipe's output.
+
+      selected: Updates that the pipe's channel was selected.
+ */
+
+typedef struct MuxPipeStats {
+    MuxPipe pipe;
+    uint32_t input_edges;
+    uint32_t wins;
+    uint32_t output_toggles;
+    uint32_t selected;
+} MuxPipeStats;
+
+
+/*
+  Position of an iteration over the pipes. The fields are private.
+ */
+
+typedef struct MuxStatsCursor {
+    MuxOutputNode *out_node;
+    MuxChannelNode *channel_node;
+    MuxInputNode *in_node;
+} MuxStatsCursor;
+
+
+/*
+  Arguments:
+      cursor: The cursor to start.
+
+  Starts an iteration over every digital pipe. Nothing is allocated,
+  the cursor is all of the state. The topology must not change until
+  the iteration is finished.
+
+ */
+
+void mux_stats_begin(MuxStatsCursor *cursor);
+
+
+/*
+  Arguments:
+      cursor: A cursor started with mux_stats_begin().
+
+      stats: Filled in with the counters for the next pipe.
+
+  Returns true if there was another pipe, false once every pipe has
+  been seen.
+
+ */
+
+bool mux_stats_next(MuxStatsCursor *cursor, MuxPipeStats *stats);
+
+
+/*
+  Sets every counter back to 0.
+
+ */
+
+void mux_stats_reset();
+
+
+/*
+  Called by mux_update() just before an output is written, with the
+  level worked out from its current channel. Counts the toggle, the
+  selection, and the wins.
+
+ */
+
+void mux_stats_output(MuxOutputNode *out_node, int level);
+
+#endif
+
+#endif
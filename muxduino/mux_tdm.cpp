@@ -0,0 +1,156 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_tdm.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+
+#include "mux_platform.h"
+
+
+/* One slot of a schedule, with its channel looked up ahead of time */
+typedef struct MuxTdmSlot {
+    int channel;
+    MuxChannelNode *node;
+} MuxTdmSlot;
+
+
+/*
+  Schedule hung off of an output. The slots are allocated along with
+  the rest of the schedule.
+ */
+
+struct MuxTdmSchedule {
+    unsigned int dwell;
+
+    /* Updates left in the current slot, including the next one */
+    unsigned int countdown;
+
+    unsigned char length;
+    unsigned char index;
+
+    MuxTdmSlot slots[1];
+};
+
+
+/* Put the output on the channel of the schedule's current slot */
+static void enter_slot(MuxOutputNode *out_node)
+{
+    MuxTdmSlot *slot = &out_node->tdm->slots[out_node->tdm->index];
+
+    mux_select_channel(out_node, slot->channel, slot->node);
+}
+
+
+int set_output_schedule(int out_pin, const int *channels, int length, unsigned int dwell)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node) {
+	return 1;
+    }
+
+    if (NULL == channels || length < 1 || length > MUX_MAX_TDM_SLOTS || dwell < 1) {
+	return 2;
+    }
+
+    MuxTdmSchedule *tdm = (MuxTdmSchedule *)
+	allocate_memory(sizeof(MuxTdmSchedule) + (length - 1) * sizeof(MuxTdmSlot));
+
+    if (NULL == tdm) {
+	return 3;
+    }
+
+    for (int i = 0; i < length; ++i) {
+	tdm->slots[i].channel = channels[i];
+	tdm->slots[i].node = find_channel_node(&out_node->channels, channels[i]);
+    }
+
+    /* Line the slots up with the update counter */
+    tdm->dwell = dwell;
+    tdm->length = length;
+    tdm->index = (mux_update_count / dwell) % length;
+    tdm->countdown = dwell - mux_update_count % dwell;
+
+    if (out_node->tdm) {
+	free_memory(out_node->tdm);
+    }
+
+    out_node->tdm = tdm;
+    enter_slot(out_node);
+
+    return 0;
+}
+
+
+void clear_output_schedule(int out_pin)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node || NULL == out_node->tdm) {
+	return;
+    }
+
+    free_memory(out_node->tdm);
+    out_node->tdm = NULL;
+}
+
+
+void mux_tdm_rebuild()
+{
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	MuxTdmSchedule *tdm = out_node->tdm;
+
+	if (tdm) {
+	    for (int i = 0; i < tdm->length; ++i) {
+		tdm->slots[i].node = find_channel_node(&out_node->channels,
+						       tdm->slots[i].channel);
+	    }
+	}
+
+	out_node = out_node->next;
+    }
+}
+
+
+void mux_tdm_step(MuxOutputNode *out_node)
+{
+    MuxTdmSchedule *tdm = out_node->tdm;
+
+    if (0 == tdm->countdown) {
+	if (++tdm->index >= tdm->length) {
+	    tdm->index = 0;
+	}
+
+	tdm->countdown = tdm->dwell;
+	enter_slot(out_node);
+    }
+
+    --tdm->countdown;
+}
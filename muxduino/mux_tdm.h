@@ -0,0 +1,110 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_TDM_H
+#define MUX_TDM_H
+
+/*
+  Time-division channel cycling. An output with a schedule steps
+  through a list of channels by itself, staying on each one for a
+  fixed number of updates (the dwell). This is handy for outputs that
+  are shared buses, which would otherwise need set_output_channel()
+  calls from the sketch at just the right times.
+
+  Every schedule is lined up with the same update counter, which
+  counts every call to mux_update() since the board started. Slot n of
+  a schedule starts on an update that is a multiple of the dwell, so
+  outputs with the same dwell always switch on the same update, no
+  matter when their schedules were set.
+ */
+
+#include "mux_output.h"
+
+
+/* Most channels in a schedule */
+#define MUX_MAX_TDM_SLOTS 32
+
+
+/*
+  Arguments:
+      out_pin: The output to cycle.
+
+      channels: The channels to step through, in order. A channel may
+		appear more than once, and does not have to exist yet
+		(the output is off while on a channel with no inputs).
+
+      length: Number of channels, from 1 to MUX_MAX_TDM_SLOTS.
+
+      dwell: Number of updates to stay on each channel, at least 1.
+
+  Gives the output a schedule, replacing any it had before. The
+  output switches to the channel for the current slot straight away.
+  Calling set_output_channel() on the output only lasts until the
+  next slot starts.
+
+  Returns 0 on success, 1 if the output does not exist, 2 if the
+  length or dwell is out of range, and 3 if there was no memory for
+  the schedule.
+
+ */
+
+int set_output_schedule(int out_pin, const int *channels, int length, unsigned int dwell);
+
+
+/*
+  Arguments:
+      out_pin: The output to stop cycling.
+
+  Removes the output's schedule, leaving it on whatever channel it is
+  on. Schedules are also freed along with their output.
+
+ */
+
+void clear_output_schedule(int out_pin);
+
+
+/*
+  Looks the channels of every schedule up again. Called by
+  mux_topology_changed(), since channels come and go.
+
+ */
+
+void mux_tdm_rebuild();
+
+
+/*
+  Arguments:
+      out_node: An output with a schedule.
+
+  Steps the output's schedule for the update that is about to happen,
+  switching to the next channel at the end of a slot. Called by
+  mux_update() for every output with a schedule.
+
+ */
+
+void mux_tdm_step(MuxOutputNode *out_node);
+
+#endif
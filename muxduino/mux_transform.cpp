@@ -0,0 +1,244 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#include "mux_transform.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+
+#include "mux_platform.h"
+
+
+/*
+  Running state of a transform, hung off of the pipe's input node.
+  The delay line is allocated along with the rest of the state, so the
+  whole thing is freed with a single free_memory().
+ */
+
+struct MuxTransformState {
+    MuxTransform settings;
+
+    /* Next bit of the delay line, which holds the level from delay updates ago */
+    unsigned int position;
+
+    /* Level going into the edge step on the last update */
+    unsigned char last_level;
+
+    /* Updates left for the stretch step to hold HIGH */
+    unsigned int stretch_left;
+
+    MuxWord ring[1];
+};
+
+
+/* Find the input node for a registered pipe, NULL if it doesn't exist */
+static MuxInputNode * find_pipe_input(MuxPipe pipe)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, pipe.out_pin);
+
+    if (NULL == out_node) {
+	return NULL;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, pipe.channel);
+
+    if (NULL == channel_node) {
+	return NULL;
+    }
+
+    return find_input_node(&channel_node->inputs, pipe.in_pin);
+}
+
+
+/* Run one update's worth of the transform on the level */
+static int step_transform(MuxTransformState *state, int level)
+{
+    const MuxTransform *settings = &state->settings;
+
+    if (settings->delay) {
+	/* The bit we are about to overwrite went in delay updates ago */
+	unsigned int position = state->position;
+	MuxWord *word = &state->ring[position / MUX_WORD_BITS];
+	MuxWord bit = (MuxWord) 1 << (position % MUX_WORD_BITS);
+	int delayed = (*word & bit) ? HIGH : LOW;
+
+	*word = (HIGH == level) ? (*word | bit) : (*word & ~bit);
+
+	state->position = (position + 1 == settings->delay) ? 0 : position + 1;
+	level = delayed;
+    }
+
+    if (settings->edge) {
+	bool rising = (HIGH == level) && (LOW == state->last_level);
+	bool falling = (LOW == level) && (HIGH == state->last_level);
+
+	state->last_level = level;
+	level = ((rising && (settings->edge & MUX_EDGE_RISING))
+		 || (falling && (settings->edge & MUX_EDGE_FALLING))) ? HIGH : LOW;
+    }
+
+    if (settings->stretch > 1) {
+	if (HIGH == level) {
+	    state->stretch_left = settings->stretch - 1;
+	}
+	else if (state->stretch_left) {
+	    --state->stretch_left;
+	    level = HIGH;
+	}
+    }
+
+    if (settings->invert) {
+	level = (HIGH == level) ? LOW : HIGH;
+    }
+
+    return level;
+}
+
+
+int set_pipe_transform(MuxPipe pipe, MuxTransform transform)
+{
+    MuxInputNode *in_node = find_pipe_input(pipe);
+
+    if (NULL == in_node) {
+	return 1;
+    }
+
+    if (transform.delay > MUX_MAX_DELAY || transform.edge > MUX_EDGE_BOTH) {
+	return 2;
+    }
+
+    if (!transform.delay && !transform.edge && transform.stretch < 2 && !transform.invert) {
+	clear_pipe_transform(pipe);
+	return 0;
+    }
+
+    size_t words = (transform.delay + MUX_WORD_BITS - 1) / MUX_WORD_BITS;
+    size_t size = sizeof(MuxTransformState);
+
+    if (words > 1) {
+	size += (words - 1) * sizeof(MuxWord);
+    }
+
+    MuxTransformState *state = (MuxTransformState *) allocate_memory(size);
+
+    if (NULL == state) {
+	return 3;
+    }
+
+    state->settings = transform;
+    state->position = 0;
+    state->last_level = LOW;
+    state->stretch_left = 0;
+
+    for (size_t w = 0; w < words; ++w) {
+	state->ring[w] = 0;
+    }
+
+    if (in_node->transform) {
+	free_memory(in_node->transform);
+    }
+
+    in_node->transform = state;
+    mux_topology_changed();
+
+    return 0;
+}
+
+
+void clear_pipe_transform(MuxPipe pipe)
+{
+    MuxInputNode *in_node = find_pipe_input(pipe);
+
+    if (NULL == in_node || NULL == in_node->transform) {
+	return;
+    }
+
+    free_memory(in_node->transform);
+    in_node->transform = NULL;
+
+    mux_topology_changed();
+}
+
+
+void mux_transform_output(MuxOutputNode *out_node)
+{
+    MuxChannelNode *channel_node = out_node->channels.head;
+    while (channel_node) {
+	if (channel_node->num_transforms) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		int slot = in_node->slot;
+
+		if (in_node->transform && slot >= 0) {
+		    MuxWord bit = (MuxWord) 1 << (slot % MUX_WORD_BITS);
+		    MuxWord *shaped = &channel_node->shaped[slot / MUX_WORD_BITS];
+		    int level = MUX_BIT(mux_levels, slot) ? HIGH : LOW;
+
+		    if (HIGH == step_transform(in_node->transform, level)) {
+			*shaped |= bit;
+		    }
+		    else {
+			*shaped &= ~bit;
+		    }
+		}
+
+		in_node = in_node->next;
+	    }
+	}
+
+	channel_node = channel_node->next;
+    }
+}
+
+
+unsigned long mux_transform_span(const MuxOutputNode *out_node)
+{
+    unsigned long longest = 0;
+
+    MuxChannelNode *channel_node = out_node->channels.head;
+    while (channel_node) {
+	MuxInputNode *in_node = channel_node->inputs.head;
+	while (in_node) {
+	    if (in_node->transform) {
+		MuxTransform *settings = &in_node->transform->settings;
+		unsigned long span = (unsigned long) settings->delay + settings->stretch;
+
+		if (span > longest) {
+		    longest = span;
+		}
+	    }
+
+	    in_node = in_node->next;
+	}
+
+	channel_node = channel_node->next;
+    }
+
+    return longest;
+}
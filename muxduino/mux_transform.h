@@ -0,0 +1,161 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_TRANSFORM_H
+#define MUX_TRANSFORM_H
+
+/*
+  Per-pipe transforms. A transform sits between an input and the
+  channel it is on, and changes the input's level before the channel
+  combines it with the others. Since it belongs to the pipe, the same
+  input pin can be delayed on one channel and passed straight through
+  on another.
+
+  The steps of a transform are always done in this order:
+
+      delay: The level from this many updates ago is used. Each
+	     delay line is a ring of bits, one bit per update, so a
+	     delay of 256 updates takes 32 bytes.
+      edge: Only changes in level are passed on. The result is HIGH
+	    for the one update where the selected edge happened, and
+	    LOW otherwise.
+      stretch: Once the level goes HIGH it stays HIGH for at least
+	       this many updates.
+      invert: The level is flipped.
+
+  Any step which is 0 / false is skipped. Every transform is stepped
+  each time its output is evaluated, whether or not its channel is
+  selected, so switching channels never shows a stale delay line.
+  That is every mux_update(), unless the output has a rate divider
+  (see set_output_rate() in muxduino.h). Then the transforms are only
+  stepped on the updates where the output is evaluated, and the
+  delay and stretch counts are in those evaluations rather than in
+  updates.
+ */
+
+#include "mux_pipe.h"
+#include "mux_output.h"
+
+
+/* Longest delay line, in updates */
+#define MUX_MAX_DELAY 2048
+
+
+/*
+  Which changes in level are passed on by the edge step.
+ */
+
+typedef enum MuxEdge {
+    MUX_EDGE_NONE = 0,
+    MUX_EDGE_RISING = 1,
+    MUX_EDGE_FALLING = 2,
+    MUX_EDGE_BOTH = 3
+} MuxEdge;
+
+
+/*
+  Settings for a transform.
+
+  Fields:
+      delay: Number of updates to delay the input by, 0 for none, up
+	     to MUX_MAX_DELAY.
+
+      edge: Which edges to pass on, see MuxEdge.
+
+      stretch: Shortest number of updates that a HIGH lasts, 0 or 1
+	       for no stretching.
+
+      invert: True to flip the level at the end.
+ */
+
+typedef struct MuxTransform {
+    unsigned int delay;
+    unsigned char edge;
+    unsigned int stretch;
+    bool invert;
+} MuxTransform;
+
+
+/*
+  Arguments:
+      pipe: The registered pipe to transform.
+
+      transform: What to do to the pipe's input.
+
+  Attaches a transform to a pipe, replacing any transform it already
+  had. The delay line starts off LOW, and the edge step starts off as
+  if the level was LOW. A transform which does nothing is the same as
+  calling clear_pipe_transform().
+
+  Returns 0 on success, 1 if the pipe is not registered, 2 if the
+  delay is too long or the edge is not a MuxEdge, and 3 if there was
+  no memory for the delay line.
+
+ */
+
+int set_pipe_transform(MuxPipe pipe, MuxTransform transform);
+
+
+/*
+  Arguments:
+      pipe: The pipe to go back to passing its input straight through.
+
+  Removes the transform from a pipe, if it has one. Transforms are
+  also freed along with their pipe.
+
+ */
+
+void clear_pipe_transform(MuxPipe pipe);
+
+
+/*
+  Arguments:
+      out_node: The output whose transforms should be stepped.
+
+  Steps the transform of every pipe on the output from the levels in
+  mux_levels, leaving the results in each channel's shaped bits for
+  mux_channel_level(). Called by mux_update() just before the output
+  is evaluated, so transforms on cascaded inputs see the level from
+  the same update.
+
+ */
+
+void mux_transform_output(MuxOutputNode *out_node);
+
+
+/*
+  Arguments:
+      out_node: The output to look at.
+
+  Returns the longest that any transform on the output can hold on to
+  a change, in updates of the output (delay plus stretch). 0 if the
+  output has no transforms.
+
+ */
+
+unsigned long mux_transform_span(const MuxOutputNode *out_node);
+
+#endif
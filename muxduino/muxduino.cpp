@@ -26,33 +26,45 @@
 #include "mux_pipe.h"
 #include "mux_output.h"
 #include "mux_channel.h"
+#include "mux_state.h"
+#include "mux_pins.h"
+#include "mux_analog.h"
+#include "mux_sample.h"
+#include "mux_cascade.h"
+#include "mux_transform.h"
+#include "mux_tdm.h"
+#include "mux_capture.h"
+#include "mux_stats.h"
+#include "mux_lut.h"
 
-#include "Arduino.h"
+#include "mux_platform.h"
 
 
 /* Main list for muxduino outputs -- starts empty */
-static MuxOutputList mux_outs = {NULL, NULL};
+MuxOutputList mux_outs = {NULL, NULL};
 
+unsigned long mux_update_count = 0;
 
-int register_pipe(MuxPipe pipe)
-{
-    /* Check if input / output are the same */
-    if (pipe.in_pin == pipe.out_pin) {
-	return 1;
-    }
 
-    /* Check if our input was previously registered as an output */
-    if (find_output_node(&mux_outs, pipe.in_pin)) {
-	return 2;
-    }
+void mux_topology_changed()
+{
+    mux_sample_rebuild();
 
-    /* Check if our output is ever defined as an input */
+    /* Slots may have moved, so every channel's mask has to be redone */
     MuxOutputNode *out_node = mux_outs.head;
     while (out_node) {
+	out_node->transformed = false;
+
 	MuxChannelNode *channel_node = out_node->channels.head;
 	while (channel_node) {
-	    if (find_input_node(&channel_node->inputs, pipe.out_pin)) {
-		return 3;
+	    mux_channel_compile(channel_node);
+
+	    if (channel_node->num_transforms) {
+		out_node->transformed = true;
+	    }
+
+	    if (out_node->use_lut) {
+		mux_lut_compile(channel_node);
 	    }
 
 	    channel_node = channel_node->next;
@@ -61,19 +73,183 @@ int register_pipe(MuxPipe pipe)
 	out_node = out_node->next;
     }
 
+    mux_cascade_rebuild();
+    mux_tdm_rebuild();
+}
+
+
+void mux_context_init(MuxContext *context)
+{
+    /* Statics start out zeroed, which is how the sampler starts too */
+    static MuxSampleState empty_sample;
+
+    context->outs.head = NULL;
+    context->outs.tail = NULL;
+    context->update_count = 0;
+    context->cascade = false;
+    context->sample = empty_sample;
+}
+
+
+void mux_context_save(MuxContext *context)
+{
+    context->outs = mux_outs;
+    context->update_count = mux_update_count;
+    context->cascade = mux_cascade_enabled();
+    mux_sample_save(&context->sample);
+}
+
+
+void mux_context_load(const MuxContext *context)
+{
+    mux_outs = context->outs;
+    mux_update_count = context->update_count;
+    mux_cascade_restore(context->cascade);
+    mux_sample_load(&context->sample);
+}
+
+
+/* Write the level to the output, and to its slot if it is also an input */
+static void set_output_level(MuxOutputNode *out_node, int level)
+{
+#if MUX_STATS
+    mux_stats_output(out_node, level);
+#endif
+
+    mux_pin_write(out_node->out_pin, level);
+
+    if (level != out_node->level) {
+	mux_capture_output(out_node->out_pin, level);
+    }
+
+    out_node->level = level;
+
+    if (out_node->slot >= 0) {
+	MuxWord bit = (MuxWord) 1 << (out_node->slot % MUX_WORD_BITS);
+
+	if (HIGH == level) {
+	    mux_levels[out_node->slot / MUX_WORD_BITS] |= bit;
+	}
+	else {
+	    mux_levels[out_node->slot / MUX_WORD_BITS] &= ~bit;
+	}
+    }
+}
+
+
+int mux_add_pipe(MuxPipe pipe)
+{
+    /* Check if input / output are the same */
+    if (pipe.in_pin == pipe.out_pin) {
+	return 1;
+    }
+
+    if (mux_cascade_enabled()) {
+	/* Outputs may be inputs, as long as there are no loops */
+	if (mux_cascade_creates_cycle(pipe)) {
+	    return 5;
+	}
+    }
+    else {
+	/* Check if our input was previously registered as an output */
+	if (find_output_node(&mux_outs, pipe.in_pin)) {
+	    return 2;
+	}
+
+	/* Check if our output is ever defined as an input */
+	MuxOutputNode *out_node = mux_outs.head;
+	while (out_node) {
+	    MuxChannelNode *channel_node = out_node->channels.head;
+	    while (channel_node) {
+		if (find_input_node(&channel_node->inputs, pipe.out_pin)) {
+		    return 3;
+		}
+
+		channel_node = channel_node->next;
+	    }
+
+	    out_node = out_node->next;
+	}
+    }
+
+    /* Check if there is room to sample the input */
+    if (!mux_sample_has_room(pipe.in_pin)) {
+	return 4;
+    }
+
     /* Pipe is good and valid, add it to the outputs */
     mux_output_list_add(&mux_outs, pipe);
 
-    pinMode(pipe.in_pin, INPUT);
-    pinMode(pipe.out_pin, OUTPUT);
+    /* Internal signals stay outputs */
+    if (!find_output_node(&mux_outs, pipe.in_pin)) {
+	mux_pin_mode(pipe.in_pin, INPUT);
+    }
+
+    mux_pin_mode(pipe.out_pin, OUTPUT);
 
     return 0;
 }
 
 
+int register_pipe(MuxPipe pipe)
+{
+    int result = mux_add_pipe(pipe);
+
+    if (0 == result) {
+	mux_topology_changed();
+    }
+
+    return result;
+}
+
+
 void unregister_pipe(MuxPipe pipe)
 {
     mux_output_list_remove(&mux_outs, pipe);
+    mux_topology_changed();
+}
+
+
+void unregister_output(int out_pin)
+{
+    mux_output_list_remove_output(&mux_outs, out_pin);
+    mux_topology_changed();
+}
+
+
+void unregister_input(int in_pin)
+{
+    mux_output_list_remove_input(&mux_outs, in_pin);
+    mux_topology_changed();
+}
+
+
+void unregister_channel(int out_pin, int channel)
+{
+    mux_output_list_remove_channel(&mux_outs, out_pin, channel);
+    mux_topology_changed();
+}
+
+
+void mux_clear()
+{
+    mux_output_list_clear(&mux_outs);
+    mux_topology_changed();
+    mux_analog_clear();
+}
+
+
+void mux_select_channel(MuxOutputNode *out_node, int new_channel,
+			MuxChannelNode *channel_node)
+{
+    bool changed = (new_channel != out_node->channel_num);
+
+    out_node->channel_num = new_channel;
+    out_node->current_channel = channel_node;
+
+    if (changed) {
+	mux_capture_channel(out_node->out_pin, new_channel);
+    }
 }
 
 
@@ -81,38 +257,150 @@ void set_output_channel(int out_pin, int new_channel)
 {
     MuxOutputNode *node = find_output_node(&mux_outs, out_pin);
 
-    node->channel_num = new_channel;
+    if (NULL == node) {
+	return;
+    }
 
     /* Need to adjust the current channel */
-    node->current_channel = find_channel_node(&node->channels,
-					      node->channel_num);
+    mux_select_channel(node, new_channel,
+		       find_channel_node(&node->channels, new_channel));
+}
+
+
+int set_output_lut(int out_pin, bool enabled)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node) {
+	return 1;
+    }
+
+    out_node->use_lut = enabled;
+
+    MuxChannelNode *channel_node = out_node->channels.head;
+    while (channel_node) {
+	if (enabled) {
+	    mux_lut_compile(channel_node);
+	}
+	else {
+	    mux_lut_free(channel_node);
+	}
+
+	channel_node = channel_node->next;
+    }
+
+    return 0;
+}
+
+
+int set_output_rate(int out_pin, int divider)
+{
+    MuxOutputNode *node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == node || divider < 1 || divider > 255) {
+	return 1;
+    }
+
+    node->divider = divider;
+    node->countdown = 1;
+
+    return 0;
+}
+
+
+/* Counts down to the output's next evaluation, true if it is this update */
+static bool output_due(MuxOutputNode *out_node)
+{
+    if (out_node->countdown > 1) {
+	--out_node->countdown;
+	return false;
+    }
+
+    out_node->countdown = out_node->divider;
+    return true;
+}
+
+
+int set_channel_combine(int out_pin, int channel, MuxCombine combine)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node) {
+	return 1;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, channel);
+
+    if (NULL == channel_node) {
+	return 1;
+    }
+
+    channel_node->combine = combine;
+
+    if (out_node->use_lut) {
+	mux_lut_compile(channel_node);
+    }
+
+    return 0;
+}
+
+
+int set_channel_priority_bit(int out_pin, int channel, int bit)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node || bit < 0 || bit > 7) {
+	return 1;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, channel);
+
+    if (NULL == channel_node) {
+	return 1;
+    }
+
+    channel_node->priority_bit = bit;
+
+    if (out_node->use_lut) {
+	mux_lut_compile(channel_node);
+    }
+
+    return 0;
 }
 
 
 void mux_update()
 {
+    mux_pins_sample();
+    mux_sample_inputs();
+    mux_capture_inputs();
+
     MuxOutputNode *out_node = mux_outs.head;
     while (out_node) {
-	MuxChannelNode *current_channel = out_node->current_channel;
+	if (out_node->tdm) {
+	    mux_tdm_step(out_node);
+	}
 
-	if (out_node->current_channel) {
-	    MuxInputNode *in_node = current_channel->inputs.head;
+	if (!output_due(out_node)) {
+	    out_node = out_node->next;
+	    continue;
+	}
 
-	    while (in_node) {
-		if (HIGH == digitalRead(in_node->in_pin)) {
-		    digitalWrite(out_node->out_pin, HIGH);
-		    break;
-		}
-		else if (NULL == in_node->next) {
-		    digitalWrite(out_node->out_pin, LOW);
-		}
+	if (out_node->transformed) {
+	    mux_transform_output(out_node);
+	}
 
-		in_node = in_node->next;
-	    }
+	if (out_node->current_channel) {
+	    set_output_level(out_node, mux_channel_level(out_node->current_channel, mux_levels));
 	}
 
 	out_node = out_node->next;
     }
+
+    mux_pins_flush();
+    mux_analog_update();
+
+    ++mux_update_count;
 }
 
 
@@ -122,38 +410,59 @@ void mux_update()
 */
 void mux_update_serial_debug()
 {
+    mux_pins_sample();
+    mux_sample_inputs();
+    mux_capture_inputs();
+
     MuxOutputNode *out_node = mux_outs.head;
     while (out_node) {
+	if (out_node->tdm) {
+	    mux_tdm_step(out_node);
+	}
+
 	MuxChannelNode *current_channel = out_node->current_channel;
 
-	if (out_node->current_channel) {
-	    MuxInputNode *in_node = current_channel->inputs.head;
+	if (!output_due(out_node)) {
+	    out_node = out_node->next;
+	    continue;
+	}
 
-	    while (in_node) {
-		if (HIGH == digitalRead(in_node->in_pin)) {
-		    Serial.print("Writing HIGH from channel ");
-		    Serial.print(out_node->channel_num);
-		    Serial.print(": ");
-		    Serial.print(in_node->in_pin);
-		    Serial.print(" -> ");
-		    Serial.println(out_node->out_pin);
-
-		    digitalWrite(out_node->out_pin, HIGH);
-		    break;
-		}
-		else if (NULL == in_node->next) {
-		    Serial.print("Writing LOW from channel ");
-		    Serial.print(out_node->channel_num);
-		    Serial.print(": ");
-		    Serial.println(out_node->out_pin);
+	if (out_node->transformed) {
+	    mux_transform_output(out_node);
+	}
 
-		    digitalWrite(out_node->out_pin, LOW);
-		}
+	if (out_node->current_channel) {
+	    int level = mux_channel_level(current_channel, mux_levels);
 
+	    /* Report the first HIGH input, if there is one */
+	    MuxInputNode *in_node = current_channel->inputs.head;
+	    while (in_node && !(in_node->slot >= 0 && MUX_BIT(mux_levels, in_node->slot))) {
 		in_node = in_node->next;
 	    }
+
+	    if (HIGH == level) {
+		Serial.print("Writing HIGH from channel ");
+		Serial.print(out_node->channel_num);
+		Serial.print(": ");
+		Serial.print(in_node ? in_node->in_pin : -1);
+		Serial.print(" -> ");
+		Serial.println(out_node->out_pin);
+	    }
+	    else {
+		Serial.print("Writing LOW from channel ");
+		Serial.print(out_node->channel_num);
+		Serial.print(": ");
+		Serial.println(out_node->out_pin);
+	    }
+
+	    set_output_level(out_node, level);
 	}
 
 	out_node = out_node->next;
     }
+
+    mux_pins_flush();
+    mux_analog_update();
+
+    ++mux_update_count;
 }
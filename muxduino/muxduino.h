@@ -30,6 +30,7 @@
  */
 
 #include "mux_pipe.h"
+#include "mux_channel.h"
 
 
 /*
@@ -43,7 +44,11 @@
   Note that this will return 0 if things went successfully, and
   non-zero otherwise. The pin modes will not be set on failure. This
   function may fail if you try to register a pipe with an input that
-  was previously registered as an output, or vice versa.
+  was previously registered as an output, or vice versa, or if there
+  are already MUX_MAX_INPUTS different input pins (error 4). When
+  cascading is turned on (see mux_cascade.h) outputs may be used as
+  inputs, but the function fails with error 5 if the pipe would make
+  a loop.
 
  */
 
@@ -62,6 +67,55 @@ int register_pipe(MuxPipe pipe);
 void unregister_pipe(MuxPipe pipe);
 
 
+/*
+  Arguments:
+      out_pin: The output we want MuxDuino to forget about.
+
+  Removes every pipe leading to the output, freeing all of its
+  channels (does nothing if the output does not exist).
+
+ */
+
+void unregister_output(int out_pin);
+
+
+/*
+  Arguments:
+      in_pin: The input we want MuxDuino to forget about.
+
+  Removes every pipe with this input, across all outputs and channels,
+  in a single pass. Channels and outputs left without any inputs are
+  freed.
+
+ */
+
+void unregister_input(int in_pin);
+
+
+/*
+  Arguments:
+      out_pin: The output which owns the channel.
+
+      channel: The channel we want to remove.
+
+  Removes every pipe on the given channel of the output. The output
+  keeps its selected channel number, so if the channel is registered
+  again later it becomes active straight away.
+
+ */
+
+void unregister_channel(int out_pin, int channel);
+
+
+/*
+  Removes every registered pipe, digital and analog, and frees all of
+  the memory used by them.
+
+ */
+
+void mux_clear();
+
+
 /*
   Arguments:
       out_pin: The output that we want to change the channel of.
@@ -75,9 +129,84 @@ void unregister_pipe(MuxPipe pipe);
 void set_output_channel(int out_pin, int new_channel);
 
 
+/*
+  Arguments:
+      out_pin: The output to compile.
+
+      enabled: True to compile the output's channels into lookup
+	       tables, false to go back to evaluating them as usual.
+
+  Lookup tables make evaluating a channel one table load, no matter
+  what its combine function is, but only work for channels whose
+  inputs all sit within MUX_LUT_MAX_WIDTH neighbouring slots (see
+  mux_lut.h). Other channels are evaluated as usual. The tables are
+  kept up to date as the topology changes. Returns 0 on success, or 1
+  if the output does not exist.
+
+ */
+
+int set_output_lut(int out_pin, bool enabled);
+
+
+/*
+  Arguments:
+      out_pin: The output to change the rate of.
+
+      divider: The output is evaluated on every divider'th update,
+	       from 1 (every update, the default) to 255.
+
+  Lets slow outputs be evaluated less often, leaving more of each
+  update for the fast ones. In between, the output keeps its last
+  level and its transforms (see mux_transform.h) are not stepped. The
+  output is next evaluated on the following update. Returns 0 on
+  success, or 1 if the output does not exist or the divider is out of
+  range.
+
+ */
+
+int set_output_rate(int out_pin, int divider);
+
+
+/*
+  Arguments:
+      out_pin: The output which owns the channel.
+
+      channel: The channel to change.
+
+      combine: How the channel's inputs are combined, see MuxCombine
+	       in mux_channel.h.
+
+  Sets how the inputs of a channel are combined to produce the
+  output. New channels use MUX_COMBINE_OR. Returns 0 on success, or 1
+  if the output does not have the channel.
+
+ */
+
+int set_channel_combine(int out_pin, int channel, MuxCombine combine);
+
+
+/*
+  Arguments:
+      out_pin: The output which owns the channel.
+
+      channel: The channel to change.
+
+      bit: Which bit of the winning rank to output, from 0 to 7.
+
+  Sets the bit used by MUX_COMBINE_PRIORITY on the channel. The
+  inputs are ranked in the order they were added to the channel, the
+  first one registered being rank 1, however pipes on other outputs
+  were registered. Returns 0 on success, or 1 if the output does not
+  have the channel or the bit is out of range.
+
+ */
+
+int set_channel_priority_bit(int out_pin, int channel, int bit);
+
+
 /*
   This function loops through all of the pipes, and does the
-  appropriate reads and writes.
+  appropriate reads and writes. Analog pipes are updated as well.
 
  */
 
@@ -0,0 +1,71 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+#ifndef MUX_TEST_H
+#define MUX_TEST_H
+
+/*
+  Checks for the host test programs in this directory. Each program
+  is built along with every .cpp file in ../muxduino (see run_tests.sh)
+  and exits with 0 if every check passed. A failed check prints where
+  it was and carries on, so one run shows every failure.
+ */
+
+#include <stdio.h>
+
+
+static int mux_test_failures = 0;
+
+
+#define MUX_CHECK(cond)							\
+    do {								\
+	if (!(cond)) {							\
+	    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	    ++mux_test_failures;					\
+	}								\
+    } while (0)
+
+
+/*
+  Arguments:
+      name: Name of the test program, for the summary line.
+
+  Prints how the checks went, and returns the exit status for main().
+
+ */
+
+static int mux_test_finish(const char *name)
+{
+    if (mux_test_failures) {
+	printf("%s: %d checks failed\n", name, mux_test_failures);
+	return 1;
+    }
+
+    printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#!/bin/sh
+#
+# Builds every host test program in this directory against the host
+# backend and runs it. Extra compiler flags can be passed in CXXFLAGS,
+# for example:
+#
+#     CXXFLAGS="-fsanitize=address,undefined" ./run_tests.sh
+#
+# The tools some of the tests run are built first, and their paths
+# are passed on in the environment.
+#
+# A test which needs compile time options (see mux_config.h) names
+# them on a line of its own, such as
+#
+#     /* MUX_TEST_FLAGS: -DMUX_STATS=1 */
+#
+# and both the test and the library are built with them.
+#
+# Exits with the number of test programs that failed.
+
+cd "$(dirname "$0")" || exit 1
+
+build=${TMPDIR:-/tmp}/muxduino_tests
+mkdir -p "$build" || exit 1
+
+failed=0
+
+MUX_CAPTURE_VCD=$build/mux_capture_vcd
+export MUX_CAPTURE_VCD
+
+if ! ${CXX:-g++} -Wall -Wextra -g $CXXFLAGS -I ../muxduino -o "$MUX_CAPTURE_VCD" \
+     ../tools/mux_capture_vcd.cpp; then
+    echo "mux_capture_vcd: build failed"
+    failed=$((failed + 1))
+fi
+
+for test in test_*.cpp; do
+    name=${test%.cpp}
+    flags=$(sed -n 's|^/\* MUX_TEST_FLAGS: \(.*\) \*/$|\1|p' "$test")
+
+    if ! ${CXX:-g++} -Wall -Wextra -g $CXXFLAGS $flags -I ../muxduino -o "$build/$name" \
+	 "$test" ../muxduino/[a-z]*.cpp -lpthread; then
+	echo "$name: build failed"
+	failed=$((failed + 1))
+    elif ! "$build/$name"; then
+	failed=$((failed + 1))
+    fi
+done
+
+exit $failed
@@ -0,0 +1,312 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for analog pipes (mux_analog.h). Random values are put on
+  the analog inputs, and every output is checked against the combine
+  function of its current channel while channels are switched around.
+  Also checks the limit on analog inputs, that outputs are only
+  written when their value changes, and the conversion rates.
+ */
+
+#include "muxduino.h"
+#include "mux_analog.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Analog inputs IN_PIN.. */
+#define IN_PIN 60
+#define NUM_INS 5
+
+#define NUM_OUTS 2
+#define NUM_CHANNELS 3
+
+#define NUM_ROUNDS 300
+
+
+static const int out_pins[NUM_OUTS] = {3, 5};
+
+static const MuxAnalogCombine combines[NUM_CHANNELS] = {
+    MUX_ANALOG_MAX, MUX_ANALOG_SUM, MUX_ANALOG_FIRST_NONZERO
+};
+
+/* Inputs of each channel, in the order they are registered */
+static const int channel_ins[NUM_OUTS][NUM_CHANNELS][3] = {
+    {{0, 1, 2}, {1, 2, 3}, {3, 0, 2}},
+    {{4, 3, 0}, {2, 4, 1}, {1, 4, 3}},
+};
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 1023;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+/* Expected output, before scaling down for PWM */
+static unsigned int expected(MuxAnalogCombine combine, const int *ins, const int *values)
+{
+    unsigned int result = 0;
+
+    for (int i = 0; i < 3; ++i) {
+	unsigned int value = values[ins[i]];
+
+	switch (combine) {
+	case MUX_ANALOG_MAX:
+	    result = (value > result) ? value : result;
+	    break;
+
+	case MUX_ANALOG_SUM:
+	    result += value;
+	    result = (result > MUX_ANALOG_MAX_VALUE) ? MUX_ANALOG_MAX_VALUE : result;
+	    break;
+
+	case MUX_ANALOG_FIRST_NONZERO:
+	    if (0 == result) {
+		result = value;
+	    }
+	    break;
+	}
+    }
+
+    return result;
+}
+
+
+/* One conversion per update, so it takes an update per input to see them all */
+static void settle()
+{
+    for (int i = 0; i < NUM_INS; ++i) {
+	mux_update();
+    }
+}
+
+
+static void test_combines()
+{
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    for (int i = 0; i < 3; ++i) {
+		MuxPipe pipe = {IN_PIN + channel_ins[out][channel][i], out_pins[out], channel};
+		MUX_CHECK(0 == register_analog_pipe(pipe));
+	    }
+
+	    MUX_CHECK(0 == set_analog_channel_combine(out_pins[out], channel, combines[channel]));
+	}
+
+	MUX_CHECK(OUTPUT == mux_host_get_mode(out_pins[out]));
+    }
+
+    MUX_CHECK(NUM_OUTS * NUM_CHANNELS * 3 == mux_analog_num_pipes());
+
+    int selected[NUM_OUTS] = {0, 0};
+
+    for (int round = 0; round < NUM_ROUNDS; ++round) {
+	int values[NUM_INS];
+
+	/* Plenty of zeros for FIRST_NONZERO, and big values to fill up SUM */
+	for (int i = 0; i < NUM_INS; ++i) {
+	    switch (next_random() % 3) {
+	    case 0: values[i] = 0; break;
+	    case 1: values[i] = next_random() % (MUX_ANALOG_MAX_VALUE + 1); break;
+	    case 2: values[i] = MUX_ANALOG_MAX_VALUE - next_random() % 200; break;
+	    }
+
+	    mux_host_set_analog(IN_PIN + i, values[i]);
+	}
+
+	/* Channel NUM_CHANNELS has no inputs, so the output holds */
+	int before[NUM_OUTS];
+
+	for (int out = 0; out < NUM_OUTS; ++out) {
+	    before[out] = mux_host_get_analog(out_pins[out]);
+
+	    if (0 == next_random() % 3) {
+		selected[out] = next_random() % (NUM_CHANNELS + 1);
+		set_analog_output_channel(out_pins[out], selected[out]);
+	    }
+	}
+
+	settle();
+
+	for (int out = 0; out < NUM_OUTS; ++out) {
+	    int channel = selected[out];
+	    int level = before[out];
+
+	    if (channel < NUM_CHANNELS) {
+		level = expected(combines[channel], channel_ins[out][channel], values) >> 2;
+	    }
+
+	    MUX_CHECK(level == mux_host_get_analog(out_pins[out]));
+	}
+    }
+
+    MUX_CHECK(1 == set_analog_channel_combine(out_pins[0], NUM_CHANNELS, MUX_ANALOG_SUM));
+    MUX_CHECK(1 == set_analog_channel_combine(7, 0, MUX_ANALOG_SUM));
+
+    /* Digital teardown leaves the analog pipes alone, mux_clear() doesn't */
+    unregister_output(out_pins[0]);
+    MUX_CHECK(NUM_OUTS * NUM_CHANNELS * 3 == mux_analog_num_pipes());
+
+    mux_clear();
+    MUX_CHECK(0 == mux_analog_num_pipes());
+
+    for (int i = 0; i < NUM_INS; ++i) {
+	mux_host_set_analog(IN_PIN + i, 0);
+    }
+}
+
+
+static void test_limits()
+{
+    MuxPipe same = {IN_PIN, IN_PIN, 0};
+    MUX_CHECK(1 == register_analog_pipe(same));
+
+    for (int i = 0; i < MUX_MAX_ANALOG_INPUTS; ++i) {
+	MuxPipe pipe = {IN_PIN + i, out_pins[i % 2], i % 3};
+	MUX_CHECK(0 == register_analog_pipe(pipe));
+    }
+
+    /* Inputs already in use are fine, new ones are not */
+    MuxPipe old_pin = {IN_PIN + 1, 6, 0};
+    MuxPipe new_pin = {IN_PIN + MUX_MAX_ANALOG_INPUTS, 6, 0};
+
+    MUX_CHECK(0 == register_analog_pipe(old_pin));
+    MUX_CHECK(4 == register_analog_pipe(new_pin));
+    MUX_CHECK(MUX_MAX_ANALOG_INPUTS + 1 == mux_analog_num_pipes());
+
+    /* Removing a pipe only frees the input once nothing else uses it */
+    MuxPipe first = {IN_PIN + 1, out_pins[1], 1};
+    unregister_analog_pipe(first);
+    MUX_CHECK(4 == register_analog_pipe(new_pin));
+
+    unregister_analog_pipe(old_pin);
+    MUX_CHECK(0 == register_analog_pipe(new_pin));
+    MUX_CHECK(MUX_MAX_ANALOG_INPUTS == mux_analog_num_pipes());
+
+    /* Removing what isn't there does nothing */
+    unregister_analog_pipe(old_pin);
+    MUX_CHECK(MUX_MAX_ANALOG_INPUTS == mux_analog_num_pipes());
+
+    mux_analog_clear();
+    MUX_CHECK(0 == mux_analog_num_pipes());
+    MUX_CHECK(total_allocations() == total_frees());
+}
+
+
+static void test_writes()
+{
+    MuxPipe pipe = {IN_PIN, out_pins[0], 0};
+    MUX_CHECK(0 == register_analog_pipe(pipe));
+
+    mux_host_set_analog(IN_PIN, 400);
+    mux_update();
+    MUX_CHECK(100 == mux_host_get_analog(out_pins[0]));
+
+    /* Scribble over the output, which is only written again on a change */
+    analogWrite(out_pins[0], 7);
+    mux_update();
+    mux_update();
+    MUX_CHECK(7 == mux_host_get_analog(out_pins[0]));
+
+    /* Same value once scaled down is not a change either */
+    mux_host_set_analog(IN_PIN, 403);
+    mux_update();
+    MUX_CHECK(7 == mux_host_get_analog(out_pins[0]));
+
+    mux_host_set_analog(IN_PIN, 404);
+    mux_update();
+    MUX_CHECK(101 == mux_host_get_analog(out_pins[0]));
+
+    mux_host_set_analog(IN_PIN, 0);
+    mux_clear();
+}
+
+
+static void test_sample_rate()
+{
+    mux_host_set_clock(1000000);
+
+    for (int i = 0; i < 4; ++i) {
+	MuxPipe pipe = {IN_PIN + i, out_pins[0], 0};
+	MUX_CHECK(0 == register_analog_pipe(pipe));
+    }
+
+    /* Nothing has had any time yet */
+    mux_analog_reset_stats();
+    MUX_CHECK(0 == mux_analog_sample_rate(IN_PIN));
+
+    /* An update every millisecond shares 1000 conversions a second between 4 inputs */
+    for (int i = 0; i < 400; ++i) {
+	mux_update();
+	mux_host_advance_clock(1000);
+    }
+
+    for (int i = 0; i < 4; ++i) {
+	MUX_CHECK(250 == mux_analog_sample_rate(IN_PIN + i));
+    }
+
+    MUX_CHECK(0 == mux_analog_sample_rate(IN_PIN + 4));
+
+    /* Inputs which stay keep their counts, and then get a bigger share */
+    MuxPipe last = {IN_PIN + 3, out_pins[0], 0};
+    unregister_analog_pipe(last);
+
+    for (int i = 0; i < 600; ++i) {
+	mux_update();
+	mux_host_advance_clock(1000);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+	MUX_CHECK(300 == mux_analog_sample_rate(IN_PIN + i));
+    }
+
+    MUX_CHECK(0 == mux_analog_sample_rate(IN_PIN + 3));
+
+    mux_analog_reset_stats();
+    mux_host_advance_clock(1000);
+    MUX_CHECK(0 == mux_analog_sample_rate(IN_PIN));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_combines();
+    test_limits();
+    test_writes();
+    test_sample_rate();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_analog");
+}
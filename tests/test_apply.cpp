@@ -0,0 +1,244 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for switching topologies with mux_apply_topology()
+  (mux_apply.h): pipes in both the old and the new set keep their
+  nodes, transforms and filters, only the differences are allocated
+  and freed, and a set which fails its checks leaves the topology
+  exactly as it was.
+ */
+
+#include <string.h>
+
+#include "muxduino.h"
+#include "mux_apply.h"
+#include "mux_transform.h"
+#include "mux_cascade.h"
+#include "mux_image.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+static unsigned char before[1024];
+static unsigned char after[1024];
+
+
+/* Input node of a registered pipe, NULL if it isn't registered */
+static MuxInputNode * pipe_node(int in_pin, int out_pin, int channel)
+{
+    MuxOutputNode *out_node = find_output_node(&mux_outs, out_pin);
+
+    if (NULL == out_node) {
+	return NULL;
+    }
+
+    MuxChannelNode *channel_node = find_channel_node(&out_node->channels, channel);
+
+    if (NULL == channel_node) {
+	return NULL;
+    }
+
+    return find_input_node(&channel_node->inputs, in_pin);
+}
+
+
+/* Checks that the set is turned away, with nothing changed */
+static void check_rejected(const MuxPipe *pipes, int num_pipes, int error)
+{
+    unsigned int len = mux_image_size();
+    unsigned long in_use = total_allocations() - total_frees();
+
+    MUX_CHECK(len <= sizeof(before));
+    MUX_CHECK(0 == mux_save_image_buffer(before, sizeof(before)));
+
+    MUX_CHECK(error == mux_apply_topology(pipes, num_pipes, NULL, 0));
+
+    MUX_CHECK(len == mux_image_size());
+    MUX_CHECK(0 == mux_save_image_buffer(after, sizeof(after)));
+    MUX_CHECK(0 == memcmp(before, after, len));
+    MUX_CHECK(in_use == total_allocations() - total_frees());
+}
+
+
+static void test_keeps_pipes()
+{
+    MuxPipe kept = {10, 20, 0};
+    MuxPipe pipes[] = {kept, {11, 20, 0}, {12, 21, 1}, {13, 22, 0}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    MuxTransform delay = {2, MUX_EDGE_NONE, 0, false};
+    MUX_CHECK(0 == set_pipe_transform(kept, delay));
+    MUX_CHECK(0 == mux_set_input_filter(10, 2));
+    set_output_channel(21, 1);
+
+    mux_host_set_input(10, HIGH);
+
+    for (int i = 0; i < 5; ++i) {
+	mux_update();
+    }
+
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+
+    MuxInputNode *kept_node = pipe_node(10, 20, 0);
+    MUX_CHECK(NULL != kept_node);
+
+    /* Keep one pipe, drop two, add 12 on channel 0 of 21 and a new output */
+    MuxPipe next[] = {kept, {12, 21, 0}, {14, 23, 0}, {12, 21, 1}};
+    MuxChannelSelect map[] = {{21, 0}, {99, 3}};
+
+    unsigned long allocations = total_allocations();
+    unsigned long frees = total_frees();
+
+    MUX_CHECK(0 == mux_apply_topology(next, 4, map, 2));
+
+    MUX_CHECK(kept_node == pipe_node(10, 20, 0));
+    MUX_CHECK(NULL != kept_node->transform);
+    MUX_CHECK(!kept_node->marked);
+
+    MUX_CHECK(NULL == pipe_node(11, 20, 0));
+    MUX_CHECK(NULL == find_output_node(&mux_outs, 22));
+    MUX_CHECK(NULL != pipe_node(12, 21, 0));
+    MUX_CHECK(NULL != pipe_node(12, 21, 1));
+    MUX_CHECK(NULL != pipe_node(14, 23, 0));
+    MUX_CHECK(NULL == find_output_node(&mux_outs, 99));
+    MUX_CHECK(0 == find_output_node(&mux_outs, 21)->channel_num);
+
+    MUX_CHECK(INPUT == mux_host_get_mode(14));
+    MUX_CHECK(OUTPUT == mux_host_get_mode(23));
+
+    /*
+      Freed: 11's input node, and 22 with its channel and input.
+      Allocated: channel 0 of 21 and its input, and 23 with its channel
+      and input.
+     */
+    MUX_CHECK(4 == total_frees() - frees);
+    MUX_CHECK(5 == total_allocations() - allocations);
+
+    /* The kept pipe never stopped passing its signal */
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+
+    /* The same set again changes nothing at all */
+    allocations = total_allocations();
+    frees = total_frees();
+
+    MUX_CHECK(0 == mux_apply_topology(next, 4, NULL, 0));
+    MUX_CHECK(allocations == total_allocations());
+    MUX_CHECK(frees == total_frees());
+
+    /* An edge already in the kept pipe's delay and filter still comes out on time */
+    mux_host_set_input(10, LOW);
+    mux_update();
+    MUX_CHECK(0 == mux_apply_topology(next, 3, NULL, 0));
+    MUX_CHECK(NULL == pipe_node(12, 21, 1));
+
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+    mux_update();
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(20));
+
+    mux_clear();
+}
+
+
+static void test_rollback()
+{
+    MuxPipe pipes[] = {{10, 20, 0}, {11, 20, 1}, {12, 21, 0}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    set_output_channel(20, 1);
+    MuxInputNode *node = pipe_node(11, 20, 1);
+
+    MuxPipe same_pin[] = {{10, 20, 0}, {30, 30, 0}};
+    check_rejected(same_pin, 2, 1);
+
+    MuxPipe output_as_input[] = {{10, 20, 0}, {20, 31, 0}};
+    check_rejected(output_as_input, 2, 2);
+
+    MuxPipe too_many[MUX_MAX_INPUTS + 1];
+
+    for (int i = 0; i <= MUX_MAX_INPUTS; ++i) {
+	MuxPipe pipe = {i, 99, 0};
+	too_many[i] = pipe;
+    }
+
+    check_rejected(too_many, MUX_MAX_INPUTS + 1, 4);
+
+    MUX_CHECK(0 == mux_set_cascade(true));
+
+    MuxPipe loop[] = {{10, 20, 0}, {20, 31, 0}, {31, 32, 0}, {32, 20, 1}};
+    check_rejected(loop, 4, 5);
+
+    MUX_CHECK(node == pipe_node(11, 20, 1));
+    MUX_CHECK(1 == find_output_node(&mux_outs, 20)->channel_num);
+
+    /* Without the loop it goes through, cascaded */
+    MuxPipe chain[] = {{10, 20, 0}, {20, 31, 0}, {31, 32, 0}};
+    MUX_CHECK(0 == mux_apply_topology(chain, 3, NULL, 0));
+
+    /* 20 is left on its channel, which has gone */
+    MUX_CHECK(NULL == find_output_node(&mux_outs, 20)->current_channel);
+
+    MuxChannelSelect map[] = {{20, 0}};
+    MUX_CHECK(0 == mux_apply_topology(chain, 3, map, 1));
+    MUX_CHECK(OUTPUT == mux_host_get_mode(20));
+
+    mux_host_set_input(10, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(32));
+    mux_host_set_input(10, LOW);
+
+    /* Dropping the cascaded output makes its pin a plain input again */
+    MuxPipe flat[] = {{20, 31, 0}};
+    MUX_CHECK(0 == mux_apply_topology(flat, 1, NULL, 0));
+    MUX_CHECK(INPUT == mux_host_get_mode(20));
+
+    MUX_CHECK(0 == mux_apply_topology(NULL, 0, NULL, 0));
+    MUX_CHECK(NULL == mux_outs.head);
+    MUX_CHECK(0 == mux_set_cascade(false));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_keeps_pipes();
+    test_rollback();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_apply");
+}
@@ -0,0 +1,180 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the shared memory pin bus (mux_bus.h and
+  mux_host_attach_bus()). A client's inputs reach the router, its
+  batches are seen whole or not at all, and every output, native or
+  on an emulated expander, is published to the bus and never
+  overwritten by it.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "muxduino.h"
+#include "mux_bus.h"
+#include "mux_pins.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+static char bus_name[64];
+
+
+static void test_inputs()
+{
+    MuxPipe pipes[] = {{10, 20, 0}, {11, 20, 0}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    MUX_CHECK(NULL == mux_bus_open(bus_name));
+    MUX_CHECK(0 == mux_host_attach_bus(bus_name));
+    MUX_CHECK(1 == mux_host_attach_bus(bus_name));
+
+    MuxBus *client = mux_bus_open(bus_name);
+    MUX_CHECK(NULL != client);
+
+    if (NULL == client) {
+	mux_host_detach_bus();
+	mux_clear();
+	return;
+    }
+
+    mux_update();
+    MUX_CHECK(1 == mux_bus_updates(client));
+    MUX_CHECK(0 == mux_bus_get_level(client, 20));
+
+    mux_bus_set_input(client, 10, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+    MUX_CHECK(1 == mux_bus_get_level(client, 20));
+    MUX_CHECK(1 == mux_bus_get_level(client, 10));
+
+    /* The bus wins over the host's own inputs, but never touches outputs */
+    mux_host_set_input(10, LOW);
+    mux_bus_set_input(client, 20, LOW);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+
+    /* A batch in progress isn't seen */
+    mux_bus_begin_inputs(client);
+    mux_bus_put_input(client, 10, LOW);
+    mux_update();
+    MUX_CHECK(1 == mux_host_bus_torn());
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+
+    mux_bus_end_inputs(client);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(20));
+
+    uint32_t levels[MUX_BUS_WORDS];
+    MUX_CHECK(5 == mux_bus_snapshot(client, levels));
+    MUX_CHECK(0 == ((levels[0] >> 20) & 1));
+
+    mux_bus_close(client);
+    mux_host_detach_bus();
+    MUX_CHECK(NULL == mux_bus_open(bus_name));
+
+    mux_clear();
+}
+
+
+static void test_expander_outputs()
+{
+    int chain = mux_add_shift_out(11, 1);
+    int mcp = mux_add_mcp23017(0x20);
+
+    MUX_CHECK(chain >= 0 && mcp >= 0);
+
+    /* One input feeds a native output and an output bit on each chip */
+    MuxPipe pipes[] = {{10, 5, 0}, {10, chain, 0}, {10, mcp + 9, 0}, {mcp + 1, 6, 0}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    MUX_CHECK(0 == mux_host_attach_bus(bus_name));
+
+    MuxBus *client = mux_bus_open(bus_name);
+    MUX_CHECK(NULL != client);
+
+    if (NULL == client) {
+	mux_host_detach_bus();
+	mux_clear();
+	mux_clear_expanders();
+	return;
+    }
+
+    mux_bus_begin_inputs(client);
+    mux_bus_put_input(client, 10, HIGH);
+    mux_bus_put_input(client, mcp + 1, HIGH);
+    mux_bus_end_inputs(client);
+
+    /* The second update would overwrite the outputs if the bus took them */
+    for (int i = 0; i < 3; ++i) {
+	mux_update();
+
+	MUX_CHECK(HIGH == mux_host_get_level(5));
+	MUX_CHECK(HIGH == mux_host_get_level(chain));
+	MUX_CHECK(HIGH == mux_host_get_level(mcp + 9));
+	MUX_CHECK(HIGH == mux_host_get_level(6));
+
+	MUX_CHECK(1 == mux_bus_get_level(client, 5));
+	MUX_CHECK(1 == mux_bus_get_level(client, chain));
+	MUX_CHECK(1 == mux_bus_get_level(client, mcp + 9));
+    }
+
+    mux_bus_set_input(client, 10, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(chain));
+    MUX_CHECK(LOW == mux_host_get_level(mcp + 9));
+    MUX_CHECK(0 == mux_bus_get_level(client, chain));
+
+    mux_bus_close(client);
+    mux_host_detach_bus();
+
+    mux_clear();
+    mux_clear_expanders();
+
+    /* The emulated pins are plain host inputs again */
+    MUX_CHECK(INPUT == mux_host_get_mode(chain));
+}
+
+
+int main()
+{
+    snprintf(bus_name, sizeof(bus_name), "/mux_test_bus%d", (int) getpid());
+
+    test_inputs();
+    test_expander_outputs();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_bus");
+}
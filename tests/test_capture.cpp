@@ -0,0 +1,286 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for captures (mux_capture.h). A capture of known edges
+  and channel switches is exported, turned into a VCD file by
+  tools/mux_capture_vcd (run_tests.sh builds it and passes its path in
+  MUX_CAPTURE_VCD), and the VCD is read back to check that every
+  change came out at the right time. Also checks that switching
+  channels by recalling a scene fires a channel trigger.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "muxduino.h"
+#include "mux_capture.h"
+#include "mux_scene.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define CAPTURE_FILE "/tmp/mux_test_capture.bin"
+#define VCD_FILE "/tmp/mux_test_capture.vcd"
+
+#define MAX_CHANGES 64
+
+
+/* A value change read back from the VCD file */
+typedef struct Change {
+    unsigned long time;
+    char name[16];
+    char value[40];
+} Change;
+
+
+static unsigned char buffer[1024];
+
+static Change changes[MAX_CHANGES];
+static int num_changes = 0;
+
+
+/* Name of the VCD variable with the identifier, NULL if there isn't one */
+static const char * variable_name(char names[][2][16], int num_names, const char *id)
+{
+    for (int i = 0; i < num_names; ++i) {
+	if (0 == strcmp(names[i][0], id)) {
+	    return names[i][1];
+	}
+    }
+
+    return NULL;
+}
+
+
+/* Reads every value change after the initial dump, returns false on error */
+static bool read_vcd(const char *path)
+{
+    FILE *vcd = fopen(path, "r");
+
+    if (NULL == vcd) {
+	return false;
+    }
+
+    char names[16][2][16];
+    int num_names = 0;
+    bool dumping = false;
+    unsigned long time = 0;
+    char line[128];
+
+    num_changes = 0;
+
+    while (fgets(line, sizeof(line), vcd)) {
+	char kind[16];
+	char id[16];
+	char name[16];
+	char value[40];
+	int width;
+
+	line[strcspn(line, "\n")] = '\0';
+
+	if (4 == sscanf(line, "$var %15s %d %15s %15s", kind, &width, id, name)) {
+	    if (num_names < 16) {
+		strcpy(names[num_names][0], id);
+		strcpy(names[num_names][1], name);
+		++num_names;
+	    }
+	}
+	else if (0 == strcmp(line, "$dumpvars")) {
+	    dumping = true;
+	}
+	else if (0 == strcmp(line, "$end")) {
+	    dumping = false;
+	}
+	else if ('#' == line[0]) {
+	    time = strtoul(line + 1, NULL, 10);
+	}
+	else if (!dumping && ('b' == line[0] || '0' == line[0] || '1' == line[0])) {
+	    const char *variable;
+
+	    if ('b' == line[0]) {
+		MUX_CHECK(2 == sscanf(line, "b%39s %15s", value, id));
+	    }
+	    else {
+		value[0] = line[0];
+		value[1] = '\0';
+		strcpy(id, line + 1);
+	    }
+
+	    variable = variable_name(names, num_names, id);
+	    MUX_CHECK(NULL != variable);
+
+	    if (variable && num_changes < MAX_CHANGES) {
+		Change *change = &changes[num_changes++];
+
+		change->time = time;
+		strcpy(change->name, variable);
+		strcpy(change->value, value);
+	    }
+	}
+    }
+
+    fclose(vcd);
+    return true;
+}
+
+
+/* Exports the capture and runs it through mux_capture_vcd */
+static bool convert_capture()
+{
+    const char *tool = getenv("MUX_CAPTURE_VCD");
+
+    MUX_CHECK(NULL != tool);
+
+    if (NULL == tool) {
+	return false;
+    }
+
+    char command[512];
+    snprintf(command, sizeof(command), "%s %s %s", tool, CAPTURE_FILE, VCD_FILE);
+
+    MUX_CHECK(0 == mux_capture_export_file(CAPTURE_FILE));
+    MUX_CHECK(0 == system(command));
+
+    bool ok = read_vcd(VCD_FILE);
+    MUX_CHECK(ok);
+
+    return ok;
+}
+
+
+static void test_round_trip()
+{
+    mux_host_set_clock(1000);
+
+    MuxPipe pipes[] = {{10, 20, 0}, {11, 20, 1}, {11, 21, 0}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    mux_update();
+
+    MuxCaptureTrigger trigger = {MUX_TRIGGER_NOW, 0, 0, 0};
+    MUX_CHECK(0 == mux_capture_start(buffer, sizeof(buffer), trigger));
+
+    mux_host_advance_clock(100);
+    mux_host_set_input(10, HIGH);
+    mux_update();
+
+    mux_host_advance_clock(50);
+    set_output_channel(20, 1);
+    mux_update();
+
+    mux_host_advance_clock(200);
+    mux_host_set_input(11, HIGH);
+    mux_update();
+
+    /* A long quiet spell, then a negative channel */
+    mux_host_advance_clock(3600000000UL);
+    mux_update();
+    mux_host_advance_clock(25);
+    set_output_channel(20, -3);
+    mux_update();
+
+    mux_capture_stop();
+    MUX_CHECK(MUX_CAPTURE_DONE == mux_capture_state());
+
+    /* The trigger and the level of every pin at the start, then the changes */
+    const Change expected[] = {
+	{0, "trigger", "1"},
+	{0, "in_10", "0"},
+	{0, "in_11", "0"},
+	{0, "channel_20", "0"},
+	{0, "out_20", "0"},
+	{0, "channel_21", "0"},
+	{0, "out_21", "0"},
+	{100, "in_10", "1"},
+	{100, "out_20", "1"},
+	{150, "channel_20", "1"},
+	{150, "out_20", "0"},
+	{350, "in_11", "1"},
+	{350, "out_20", "1"},
+	{350, "out_21", "1"},
+	{3600000375UL, "channel_20", "11111111111111111111111111111101"},
+    };
+    int num_expected = sizeof(expected) / sizeof(expected[0]);
+
+    if (convert_capture()) {
+	MUX_CHECK(num_expected == num_changes);
+
+	for (int i = 0; i < num_expected && i < num_changes; ++i) {
+	    MUX_CHECK(expected[i].time == changes[i].time);
+	    MUX_CHECK(0 == strcmp(expected[i].name, changes[i].name));
+	    MUX_CHECK(0 == strcmp(expected[i].value, changes[i].value));
+	}
+    }
+
+    /* Too small a buffer for the export is turned away */
+    unsigned char header[MUX_CAPTURE_HEADER_SIZE + 1];
+    MUX_CHECK(1 == mux_capture_export_buffer(header, sizeof(header)));
+
+    mux_clear();
+}
+
+
+static void test_scene_trigger()
+{
+    MuxPipe pipes[] = {{10, 20, 0}, {11, 20, 1}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    set_output_channel(20, 1);
+    MUX_CHECK(0 == mux_scene_store(0));
+    set_output_channel(20, 0);
+
+    MuxCaptureTrigger trigger = {MUX_TRIGGER_CHANNEL, 20, 0, 0};
+    MUX_CHECK(0 == mux_capture_start(buffer, sizeof(buffer), trigger));
+
+    mux_update();
+    MUX_CHECK(MUX_CAPTURE_ARMED == mux_capture_state());
+
+    MUX_CHECK(0 == mux_scene_recall(0));
+    MUX_CHECK(MUX_CAPTURE_ARMED != mux_capture_state());
+
+    mux_capture_stop();
+    mux_scene_forget(0);
+    mux_clear();
+}
+
+
+int main()
+{
+    test_round_trip();
+    test_scene_trigger();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_capture");
+}
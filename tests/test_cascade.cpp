@@ -0,0 +1,224 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for cascaded routing (mux_cascade.h): outputs are run in
+  stage order however they were registered, so a signal goes through
+  every hop in one update, and pipes which would make a loop are
+  rejected.
+ */
+
+#include "muxduino.h"
+#include "mux_cascade.h"
+#include "mux_output.h"
+#include "mux_channel.h"
+#include "mux_input.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Position of the output in mux_outs, -1 if it is not there */
+static int output_position(int out_pin)
+{
+    int position = 0;
+
+    for (MuxOutputNode *out_node = mux_outs.head; out_node; out_node = out_node->next) {
+	if (out_pin == out_node->out_pin) {
+	    return position;
+	}
+
+	++position;
+    }
+
+    return -1;
+}
+
+
+/* Every output has to come after all of the outputs which feed it */
+static void check_stage_order()
+{
+    for (MuxOutputNode *out_node = mux_outs.head; out_node; out_node = out_node->next) {
+	int position = output_position(out_node->out_pin);
+
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		MUX_CHECK(output_position(in_node->in_pin) < position);
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+    }
+}
+
+
+static void test_disabled()
+{
+    MuxPipe first = {20, 21, 0};
+    MUX_CHECK(0 == register_pipe(first));
+
+    /* Output used as an input, and input used as an output */
+    MuxPipe from_output = {21, 22, 0};
+    MUX_CHECK(2 == register_pipe(from_output));
+
+    MuxPipe to_input = {19, 20, 0};
+    MUX_CHECK(3 == register_pipe(to_input));
+
+    mux_clear();
+}
+
+
+static void test_ordering()
+{
+    MUX_CHECK(0 == mux_set_cascade(true));
+    MUX_CHECK(mux_cascade_enabled());
+
+    /* Registered backwards: 20 -> 21 -> 22 -> 23 */
+    MuxPipe pipes[] = {
+	{22, 23, 0},
+	{21, 22, 0},
+	{20, 21, 0},
+	{5, 22, 0},		/* Second input on the middle hop */
+	{20, 23, 1},		/* Skips the chain on another channel */
+	{21, 24, 0},		/* Diamond: 24 and 22 both feed 25 */
+	{22, 25, 0},
+	{24, 25, 0},
+    };
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    check_stage_order();
+
+    MUX_CHECK(OUTPUT == mux_host_get_mode(21));
+    MUX_CHECK(OUTPUT == mux_host_get_mode(22));
+    MUX_CHECK(INPUT == mux_host_get_mode(20));
+
+    MUX_CHECK(0 == set_channel_combine(25, 0, MUX_COMBINE_AND));
+
+    /* One update carries the edge all the way through */
+    mux_host_set_input(20, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(23));
+    MUX_CHECK(HIGH == mux_host_get_level(25));
+
+    mux_host_set_input(20, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(23));
+    MUX_CHECK(LOW == mux_host_get_level(25));
+
+    /* 5 only reaches 25 through 22, so the AND stays LOW */
+    mux_host_set_input(5, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(23));
+    MUX_CHECK(LOW == mux_host_get_level(25));
+    mux_host_set_input(5, LOW);
+
+    set_output_channel(23, 1);
+    mux_host_set_input(20, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(23));
+    mux_host_set_input(20, LOW);
+    mux_update();
+
+    /* Adding a pipe to the front of the chain sorts it in again */
+    MuxPipe front = {6, 20, 0};
+    MUX_CHECK(0 == register_pipe(front));
+    MUX_CHECK(OUTPUT == mux_host_get_mode(20));
+    check_stage_order();
+
+    set_output_channel(23, 0);
+    mux_host_set_input(6, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(23));
+    MUX_CHECK(HIGH == mux_host_get_level(25));
+    mux_host_set_input(6, LOW);
+    mux_update();
+
+    mux_clear();
+    MUX_CHECK(0 == mux_set_cascade(false));
+}
+
+
+static void test_loops()
+{
+    MUX_CHECK(0 == mux_set_cascade(true));
+
+    MuxPipe chain[] = {{20, 21, 0}, {21, 22, 0}, {22, 23, 1}};
+
+    for (unsigned int i = 0; i < sizeof(chain) / sizeof(chain[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(chain[i]));
+    }
+
+    MuxPipe self = {23, 23, 0};
+    MUX_CHECK(1 == register_pipe(self));
+
+    MuxPipe back = {22, 21, 0};
+    MUX_CHECK(5 == register_pipe(back));
+
+    /* Around the whole chain, and through another channel */
+    MuxPipe around = {23, 20, 0};
+    MUX_CHECK(5 == register_pipe(around));
+
+    MuxPipe other_channel = {23, 21, 2};
+    MUX_CHECK(5 == register_pipe(other_channel));
+
+    /* Nothing was added by the failures */
+    MUX_CHECK(NULL == find_output_node(&mux_outs, 20));
+    check_stage_order();
+
+    mux_host_set_input(20, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(22));
+    mux_host_set_input(20, LOW);
+    mux_update();
+
+    /* Can't be turned off while outputs are used as inputs */
+    MUX_CHECK(1 == mux_set_cascade(false));
+    MUX_CHECK(mux_cascade_enabled());
+
+    unregister_output(21);
+    unregister_output(22);
+    MUX_CHECK(0 == mux_set_cascade(false));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_disabled();
+    test_ordering();
+    test_loops();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_cascade");
+}
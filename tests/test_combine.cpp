@@ -0,0 +1,287 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the ways a channel combines its inputs (MUX_COMBINE_*
+  in muxduino.h). Every mode is checked against every combination of
+  input levels, through the mask path and through the lookup table.
+  The same is done with the inputs sitting across the boundary between
+  two words of the sampler, so that PRIORITY has to carry the rank of
+  the inputs in the first word over into the second. PRIORITY ranks
+  by the channel's own order, so it is also checked with the slots in
+  a different order, and with pipes on other outputs coming and going.
+ */
+
+#include "muxduino.h"
+#include "mux_sample.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Output pins, one per way of combining */
+#define OR_PIN 2
+#define AND_PIN 3
+#define XOR_PIN 4
+#define MAJORITY_PIN 5
+#define PRIORITY_PIN 6		/* Through PRIORITY_PIN + 2, one per rank bit */
+
+/* Output fed by the inputs that only take up slots */
+#define FILLER_PIN 9
+
+#define NUM_INPUTS 4
+
+
+/* Expected level of an output for the levels of the inputs, in channel order */
+static int expected(MuxCombine combine, int bit, const int *levels, int num_inputs)
+{
+    int high = 0;
+    int rank = 0;
+
+    for (int i = 0; i < num_inputs; ++i) {
+	if (levels[i]) {
+	    ++high;
+
+	    if (0 == rank) {
+		rank = i + 1;
+	    }
+	}
+    }
+
+    switch (combine) {
+    case MUX_COMBINE_OR:
+	return high > 0;
+
+    case MUX_COMBINE_AND:
+	return high == num_inputs;
+
+    case MUX_COMBINE_XOR:
+	return high & 1;
+
+    case MUX_COMBINE_MAJORITY:
+	return 2 * high > num_inputs;
+
+    case MUX_COMBINE_PRIORITY:
+	return (rank >> bit) & 1;
+    }
+
+    return -1;
+}
+
+
+static void register_outputs(const int *in_pins, int num_inputs)
+{
+    for (int out_pin = OR_PIN; out_pin <= PRIORITY_PIN + 2; ++out_pin) {
+	for (int i = 0; i < num_inputs; ++i) {
+	    MuxPipe pipe = {in_pins[i], out_pin, 0};
+	    MUX_CHECK(0 == register_pipe(pipe));
+	}
+    }
+
+    MUX_CHECK(0 == set_channel_combine(AND_PIN, 0, MUX_COMBINE_AND));
+    MUX_CHECK(0 == set_channel_combine(XOR_PIN, 0, MUX_COMBINE_XOR));
+    MUX_CHECK(0 == set_channel_combine(MAJORITY_PIN, 0, MUX_COMBINE_MAJORITY));
+
+    for (int bit = 0; bit < 3; ++bit) {
+	MUX_CHECK(0 == set_channel_combine(PRIORITY_PIN + bit, 0, MUX_COMBINE_PRIORITY));
+	MUX_CHECK(0 == set_channel_priority_bit(PRIORITY_PIN + bit, 0, bit));
+    }
+
+    MUX_CHECK(1 == set_channel_priority_bit(PRIORITY_PIN, 0, 8));
+    MUX_CHECK(1 == set_channel_combine(PRIORITY_PIN, 1, MUX_COMBINE_AND));
+}
+
+
+static void set_lut(bool enabled)
+{
+    for (int out_pin = OR_PIN; out_pin <= PRIORITY_PIN + 2; ++out_pin) {
+	MUX_CHECK(0 == set_output_lut(out_pin, enabled));
+    }
+}
+
+
+/* Runs every combination of input levels and checks every output */
+static void check_outputs(const int *in_pins, int num_inputs)
+{
+    for (int pattern = 0; pattern < (1 << num_inputs); ++pattern) {
+	int levels[NUM_INPUTS];
+
+	for (int i = 0; i < num_inputs; ++i) {
+	    levels[i] = (pattern >> i) & 1;
+	    mux_host_set_input(in_pins[i], levels[i] ? HIGH : LOW);
+	}
+
+	mux_update();
+
+	MUX_CHECK(expected(MUX_COMBINE_OR, 0, levels, num_inputs)
+		  == mux_host_get_level(OR_PIN));
+	MUX_CHECK(expected(MUX_COMBINE_AND, 0, levels, num_inputs)
+		  == mux_host_get_level(AND_PIN));
+	MUX_CHECK(expected(MUX_COMBINE_XOR, 0, levels, num_inputs)
+		  == mux_host_get_level(XOR_PIN));
+	MUX_CHECK(expected(MUX_COMBINE_MAJORITY, 0, levels, num_inputs)
+		  == mux_host_get_level(MAJORITY_PIN));
+
+	for (int bit = 0; bit < 3; ++bit) {
+	    MUX_CHECK(expected(MUX_COMBINE_PRIORITY, bit, levels, num_inputs)
+		      == mux_host_get_level(PRIORITY_PIN + bit));
+	}
+    }
+}
+
+
+/* Checks the inputs through the masks and through the lookup tables */
+static void check_both_paths(const int *in_pins, int num_inputs)
+{
+    check_outputs(in_pins, num_inputs);
+
+    set_lut(true);
+    check_outputs(in_pins, num_inputs);
+
+    set_lut(false);
+    check_outputs(in_pins, num_inputs);
+}
+
+
+static void test_modes()
+{
+    const int in_pins[NUM_INPUTS] = {20, 21, 22, 23};
+
+    register_outputs(in_pins, NUM_INPUTS);
+
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+	MUX_CHECK(i == mux_sample_slot(in_pins[i]));
+    }
+
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    /* Fewer inputs, so a smaller majority and fewer ranks */
+    unregister_input(in_pins[3]);
+    check_both_paths(in_pins, NUM_INPUTS - 1);
+
+    mux_clear();
+}
+
+
+static void test_channel_order()
+{
+    /* Another output takes the slots in the opposite order */
+    for (int pin = 23; pin >= 20; --pin) {
+	MuxPipe pipe = {pin, FILLER_PIN, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    const int in_pins[NUM_INPUTS] = {20, 21, 22, 23};
+
+    register_outputs(in_pins, NUM_INPUTS);
+    MUX_CHECK(mux_sample_slot(23) < mux_sample_slot(20));
+
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    /* Pipes on other outputs coming and going change no ranks */
+    unregister_output(FILLER_PIN);
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    MuxPipe other = {22, FILLER_PIN, 0};
+    MUX_CHECK(0 == register_pipe(other));
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    /* Registering an input again puts it at the back */
+    for (int bit = 0; bit < 3; ++bit) {
+	MuxPipe first = {20, PRIORITY_PIN + bit, 0};
+	unregister_pipe(first);
+	MUX_CHECK(0 == register_pipe(first));
+    }
+
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+	mux_host_set_input(in_pins[i], LOW);
+    }
+
+    mux_host_set_input(20, HIGH);
+    mux_host_set_input(23, HIGH);
+    mux_update();
+
+    /* 23 is now rank 3 and 20 rank 4, so 23 wins */
+    MUX_CHECK(HIGH == mux_host_get_level(PRIORITY_PIN));
+    MUX_CHECK(HIGH == mux_host_get_level(PRIORITY_PIN + 1));
+    MUX_CHECK(LOW == mux_host_get_level(PRIORITY_PIN + 2));
+
+    mux_host_set_input(23, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(PRIORITY_PIN));
+    MUX_CHECK(LOW == mux_host_get_level(PRIORITY_PIN + 1));
+    MUX_CHECK(HIGH == mux_host_get_level(PRIORITY_PIN + 2));
+
+    mux_host_set_input(20, LOW);
+    mux_clear();
+}
+
+
+#if MUX_MAX_INPUTS > MUX_WORD_BITS
+
+static void test_across_words()
+{
+    /* Take up all but two slots of the first word */
+    for (int i = 0; i < MUX_WORD_BITS - 2; ++i) {
+	MuxPipe pipe = {30 + i, FILLER_PIN, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    const int in_pins[NUM_INPUTS] = {20, 21, 22, 23};
+
+    register_outputs(in_pins, NUM_INPUTS);
+
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+	MUX_CHECK(MUX_WORD_BITS - 2 + i == mux_sample_slot(in_pins[i]));
+    }
+
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    /* The fillers are not part of the channels, so they change nothing */
+    for (int i = 0; i < MUX_WORD_BITS - 2; ++i) {
+	mux_host_set_input(30 + i, HIGH);
+    }
+
+    check_both_paths(in_pins, NUM_INPUTS);
+
+    mux_clear();
+}
+
+#endif
+
+
+int main()
+{
+    test_modes();
+    test_channel_order();
+
+#if MUX_MAX_INPUTS > MUX_WORD_BITS
+    test_across_words();
+#endif
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_combine");
+}
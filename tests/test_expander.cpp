@@ -0,0 +1,244 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the expander pin backends (mux_pins.h). The emulated
+  74HC165, 74HC595 and MCP23017 chips are given virtual pins, pipes
+  are routed between them and the Arduino's own pins, and random input
+  levels are checked to come out on the right outputs. The number of
+  chip transfers shows that inputs are read once per update and
+  outputs are only written when they change.
+ */
+
+#include "muxduino.h"
+#include "mux_pins.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define LOAD_PIN 10
+#define LATCH_PIN 11
+#define MCP_ADDRESS 0x20
+
+/* Native pins, inputs NATIVE_IN.. and outputs NATIVE_OUT.. */
+#define NATIVE_IN 2
+#define NATIVE_OUT 20
+#define NUM_NATIVE 4
+
+#define NUM_UPDATES 500
+
+
+static int shift_in_pin;
+static int shift_out_pin;
+static int mcp_pin;
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 2017;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+static void add_chips()
+{
+    shift_in_pin = mux_add_shift_in(LOAD_PIN, 2);
+    shift_out_pin = mux_add_shift_out(LATCH_PIN, 1);
+    mcp_pin = mux_add_mcp23017(MCP_ADDRESS);
+}
+
+
+static void test_numbering()
+{
+    add_chips();
+
+    /* Pins are handed out one chip after another */
+    MUX_CHECK(MUX_EXPANDER_PIN_BASE == shift_in_pin);
+    MUX_CHECK(shift_in_pin + 16 == shift_out_pin);
+    MUX_CHECK(shift_out_pin + 8 == mcp_pin);
+
+    MUX_CHECK(OUTPUT == mux_host_get_mode(LOAD_PIN));
+    MUX_CHECK(OUTPUT == mux_host_get_mode(LATCH_PIN));
+
+    /* Every 74HC595 bit is an output, MCP23017 bits start off as inputs */
+    for (int i = 0; i < 8; ++i) {
+	MUX_CHECK(INPUT == mux_host_get_mode(shift_in_pin + i));
+	MUX_CHECK(OUTPUT == mux_host_get_mode(shift_out_pin + i));
+    }
+
+    for (int i = 0; i < 16; ++i) {
+	MUX_CHECK(INPUT == mux_host_get_mode(mcp_pin + i));
+    }
+
+    MUX_CHECK(-1 == mux_add_shift_in(12, 0));
+    MUX_CHECK(-1 == mux_add_shift_out(12, MUX_MAX_CHAIN_LENGTH + 1));
+
+    /* Runs out of chips before it runs out of host pins */
+    for (int i = 3; i < MUX_MAX_EXPANDERS; ++i) {
+	MUX_CHECK(mcp_pin + 16 * (i - 2) == mux_add_mcp23017(MCP_ADDRESS + i - 2));
+    }
+
+    MUX_CHECK(-1 == mux_add_mcp23017(MCP_ADDRESS + 7));
+    MUX_CHECK(-1 == mux_add_shift_in(12, 1));
+
+    /* Clearing hands every pin back to the host as an input */
+    mux_clear_expanders();
+
+    for (int pin = MUX_EXPANDER_PIN_BASE; pin < MUX_HOST_PINS; ++pin) {
+	MUX_CHECK(INPUT == mux_host_get_mode(pin));
+    }
+
+    /* ...and the numbering starts over, this time running out of host pins */
+    MUX_CHECK(MUX_EXPANDER_PIN_BASE == mux_add_shift_in(LOAD_PIN, MUX_MAX_CHAIN_LENGTH));
+    MUX_CHECK(MUX_EXPANDER_PIN_BASE + 64 == mux_add_shift_in(12, MUX_MAX_CHAIN_LENGTH));
+    MUX_CHECK(-1 == mux_add_shift_in(13, MUX_MAX_CHAIN_LENGTH));
+
+    mux_clear_expanders();
+}
+
+
+/* The input which feeds each output */
+typedef struct Route {
+    int in_pin;
+    int out_pin;
+} Route;
+
+
+static void test_routing()
+{
+    add_chips();
+
+    /* Inputs: both 74HC165s, GPA of the MCP23017 and a few native pins */
+    int in_pins[16 + 8 + NUM_NATIVE];
+    int num_ins = 0;
+
+    for (int i = 0; i < 16; ++i) in_pins[num_ins++] = shift_in_pin + i;
+    for (int i = 0; i < 8; ++i) in_pins[num_ins++] = mcp_pin + i;
+    for (int i = 0; i < NUM_NATIVE; ++i) in_pins[num_ins++] = NATIVE_IN + i;
+
+    /* Outputs: the 74HC595, GPB of the MCP23017 and a few native pins */
+    Route routes[8 + 8 + NUM_NATIVE];
+    int num_routes = 0;
+
+    for (int i = 0; i < 8; ++i) routes[num_routes++].out_pin = shift_out_pin + i;
+    for (int i = 0; i < 8; ++i) routes[num_routes++].out_pin = mcp_pin + 8 + i;
+    for (int i = 0; i < NUM_NATIVE; ++i) routes[num_routes++].out_pin = NATIVE_OUT + i;
+
+    for (int i = 0; i < num_routes; ++i) {
+	routes[i].in_pin = in_pins[(7 * i) % num_ins];
+
+	MuxPipe pipe = {routes[i].in_pin, routes[i].out_pin, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    /* Registering made GPB outputs and left GPA as inputs */
+    for (int i = 0; i < 8; ++i) {
+	MUX_CHECK(INPUT == mux_host_get_mode(mcp_pin + i));
+	MUX_CHECK(OUTPUT == mux_host_get_mode(mcp_pin + 8 + i));
+    }
+
+    /* Both input chips are read, and both output chips written the first time */
+    unsigned long transfers = mux_expander_transfers();
+    mux_update();
+    MUX_CHECK(transfers + 4 == mux_expander_transfers());
+
+    /* Then nothing is written while nothing changes */
+    transfers = mux_expander_transfers();
+    mux_update();
+    MUX_CHECK(transfers + 2 == mux_expander_transfers());
+
+    for (int update = 0; update < NUM_UPDATES; ++update) {
+	int levels[16 + 8 + NUM_NATIVE];
+
+	for (int i = 0; i < num_ins; ++i) {
+	    levels[i] = (0 == next_random() % 4) ? HIGH : LOW;
+	    mux_host_set_input(in_pins[i], levels[i]);
+	}
+
+	/* The chips which should be written, worked out from the old levels */
+	bool shift_out_changes = false;
+	bool mcp_changes = false;
+
+	for (int i = 0; i < num_routes; ++i) {
+	    int level = levels[(7 * i) % num_ins];
+
+	    if (level != mux_host_get_level(routes[i].out_pin)) {
+		shift_out_changes |= (i < 8);
+		mcp_changes |= (i >= 8 && i < 16);
+	    }
+	}
+
+	transfers = mux_expander_transfers();
+	mux_update();
+
+	MUX_CHECK(transfers + 2 + shift_out_changes + mcp_changes == mux_expander_transfers());
+
+	for (int i = 0; i < num_routes; ++i) {
+	    MUX_CHECK(levels[(7 * i) % num_ins] == mux_host_get_level(routes[i].out_pin));
+	}
+    }
+
+    /* Virtual inputs hold what was read until the next sample */
+    mux_host_set_input(shift_in_pin + 3, LOW);
+    mux_host_set_input(mcp_pin + 3, LOW);
+    mux_update();
+    mux_host_set_input(shift_in_pin + 3, HIGH);
+    mux_host_set_input(mcp_pin + 3, HIGH);
+    MUX_CHECK(LOW == mux_pin_read(shift_in_pin + 3));
+    MUX_CHECK(LOW == mux_pin_read(mcp_pin + 3));
+    mux_pins_sample();
+    MUX_CHECK(HIGH == mux_pin_read(shift_in_pin + 3));
+    MUX_CHECK(HIGH == mux_pin_read(mcp_pin + 3));
+
+    /* Writes to inputs, and to pins without a chip, go nowhere */
+    mux_pin_write(shift_in_pin + 3, LOW);
+    mux_pin_write(MUX_HOST_PINS - 1, HIGH);
+    mux_pins_flush();
+    MUX_CHECK(HIGH == mux_host_get_level(shift_in_pin + 3));
+    MUX_CHECK(LOW == mux_host_get_level(MUX_HOST_PINS - 1));
+    MUX_CHECK(LOW == mux_pin_read(MUX_HOST_PINS - 1));
+
+    for (int i = 0; i < num_ins; ++i) {
+	mux_host_set_input(in_pins[i], LOW);
+    }
+
+    mux_clear();
+    mux_clear_expanders();
+}
+
+
+int main()
+{
+    test_numbering();
+    test_routing();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_expander");
+}
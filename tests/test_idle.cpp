@@ -0,0 +1,110 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for sleeping while idle (mux_idle.h). On the host a
+  sleep blocks until an input is set or the timeout runs out, so these
+  check when mux_idle_update() sleeps and when it refuses to.
+ */
+
+#include "muxduino.h"
+#include "mux_idle.h"
+#include "mux_analog.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+static void test_sleeps()
+{
+    MuxPipe pipe = {10, 20, 0};
+    MUX_CHECK(0 == register_pipe(pipe));
+    mux_update();
+
+    mux_idle_reset_stats();
+
+    /* Nothing changes, so the timeout runs out */
+    MUX_CHECK(1 == mux_idle_update(20));
+
+    /* A change since the last update wakes us straight away */
+    mux_host_set_input(10, HIGH);
+    MUX_CHECK(0 == mux_idle_update(1000));
+    MUX_CHECK(HIGH == mux_host_get_level(20));
+
+    MuxIdleStats stats;
+    mux_idle_stats(&stats);
+    MUX_CHECK(1 == stats.wakes);
+    MUX_CHECK(1 == stats.timeouts);
+
+    /* Not while a filter is still counting */
+    MUX_CHECK(0 == mux_set_input_filter(10, 3));
+    mux_host_set_input(10, LOW);
+    mux_update();
+    MUX_CHECK(2 == mux_idle_update(1000));
+    MUX_CHECK(2 == mux_idle_update(1000));
+    MUX_CHECK(LOW == mux_host_get_level(20));
+    MUX_CHECK(1 == mux_idle_update(20));
+
+    mux_clear();
+}
+
+
+static void test_analog()
+{
+    MuxPipe pipe = {10, 20, 0};
+    MUX_CHECK(0 == register_pipe(pipe));
+
+    MuxPipe analog = {60, 9, 0};
+    MUX_CHECK(0 == register_analog_pipe(analog));
+    MUX_CHECK(1 == mux_analog_num_pipes());
+
+    /* Analog inputs can't wake us, so every call just updates */
+    unsigned long updates = mux_update_count;
+
+    MUX_CHECK(2 == mux_idle_update(50));
+    MUX_CHECK(updates + 1 == mux_update_count);
+
+    mux_host_set_analog(60, 400);
+    mux_idle_update(50);
+    MUX_CHECK(400 / 4 == mux_host_get_analog(9));
+
+    unregister_analog_pipe(analog);
+    MUX_CHECK(0 == mux_analog_num_pipes());
+    MUX_CHECK(1 == mux_idle_update(20));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_sleeps();
+    test_analog();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_idle");
+}
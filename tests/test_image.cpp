@@ -0,0 +1,242 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for topology images (mux_image.h): a topology survives a
+  round trip through a buffer and a file, damaged images are turned
+  away without touching what is registered, analog pipes are left
+  alone by a load, and images with more inputs than the sampler has
+  slots for are rejected.
+ */
+
+#include <string.h>
+
+#include "muxduino.h"
+#include "mux_image.h"
+#include "mux_analog.h"
+#include "mux_sample.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define IMAGE_FILE "/tmp/mux_test_image.bin"
+
+
+static unsigned char image[2048];
+static unsigned char again[2048];
+
+
+static void build_topology()
+{
+    for (int out_pin = 20; out_pin < 26; ++out_pin) {
+	for (int channel = 0; channel < 3; ++channel) {
+	    for (int in_pin = 2; in_pin < 6; ++in_pin) {
+		MuxPipe pipe = {in_pin, out_pin, channel};
+		MUX_CHECK(0 == register_pipe(pipe));
+	    }
+	}
+    }
+
+    MUX_CHECK(0 == set_channel_combine(21, 1, MUX_COMBINE_AND));
+    MUX_CHECK(0 == set_channel_priority_bit(23, 2, 3));
+    set_output_channel(22, 2);
+    set_output_channel(21, 1);
+}
+
+
+static void test_round_trip()
+{
+    build_topology();
+
+    unsigned int len = mux_image_size();
+    MUX_CHECK(len <= sizeof(image));
+    MUX_CHECK(0 == mux_save_image_buffer(image, sizeof(image)));
+    MUX_CHECK(1 == mux_save_image_buffer(image, len - 1));
+
+    mux_clear();
+    MUX_CHECK(0 == mux_load_image_buffer(image, len));
+    MUX_CHECK(len == mux_image_size());
+    MUX_CHECK(0 == mux_save_image_buffer(again, sizeof(again)));
+    MUX_CHECK(0 == memcmp(image, again, len));
+
+    MUX_CHECK(0 == mux_save_file(IMAGE_FILE));
+    mux_clear();
+    MUX_CHECK(0 == mux_load_file(IMAGE_FILE));
+    MUX_CHECK(0 == mux_save_image_buffer(again, sizeof(again)));
+    MUX_CHECK(0 == memcmp(image, again, len));
+    remove(IMAGE_FILE);
+
+    /* Selected channels and combine functions came back too */
+    mux_host_set_input(3, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(22));
+    MUX_CHECK(LOW == mux_host_get_level(21));
+    mux_host_set_input(3, LOW);
+    mux_update();
+
+    mux_clear();
+}
+
+
+static void test_damaged()
+{
+    build_topology();
+
+    unsigned int len = mux_image_size();
+    MUX_CHECK(0 == mux_save_image_buffer(image, sizeof(image)));
+
+    image[20] ^= 1;
+    MUX_CHECK(5 == mux_load_image_buffer(image, len));
+    image[20] ^= 1;
+
+    image[0] = 'X';
+    MUX_CHECK(1 == mux_load_image_buffer(image, len));
+    image[0] = 'M';
+
+    image[4] = MUX_IMAGE_VERSION + 1;
+    MUX_CHECK(2 == mux_load_image_buffer(image, len));
+    image[4] = MUX_IMAGE_VERSION;
+
+    MUX_CHECK(3 == mux_load_image_buffer(image, len - 1));
+
+    /* One more output in the header than in the body */
+    ++image[6];
+    MUX_CHECK(4 == mux_load_image_buffer(image, len));
+    --image[6];
+
+    /* Nothing above should have touched the topology */
+    MUX_CHECK(len == mux_image_size());
+    MUX_CHECK(0 == mux_save_image_buffer(again, sizeof(again)));
+    MUX_CHECK(0 == memcmp(image, again, len));
+
+    MUX_CHECK(6 == mux_load_file("/nonexistent/mux_test_image.bin"));
+
+    mux_clear();
+}
+
+
+static void test_keeps_analog()
+{
+    MuxPipe analog = {60, 9, 0};
+    MUX_CHECK(0 == register_analog_pipe(analog));
+
+    build_topology();
+    MUX_CHECK(0 == mux_save_image_buffer(image, sizeof(image)));
+    MUX_CHECK(0 == mux_load_image_buffer(image, mux_image_size()));
+
+    mux_host_set_analog(60, 300);
+    for (int i = 0; i < 4; ++i) {
+	mux_update();
+    }
+
+    MUX_CHECK(300 / 4 == mux_host_get_analog(9));
+
+    mux_clear();
+}
+
+
+/* Appends a 16 bit little endian value */
+static unsigned int put_u16(unsigned char *buffer, unsigned int at, unsigned int value)
+{
+    buffer[at] = value & 0xFF;
+    buffer[at + 1] = (value >> 8) & 0xFF;
+
+    return at + 2;
+}
+
+
+/* Writes an image of one output with one channel fed by num_inputs pins */
+static unsigned int wide_image(unsigned char *buffer, unsigned int num_inputs)
+{
+    unsigned int at = 0;
+
+    buffer[at++] = 'M';
+    buffer[at++] = 'X';
+    buffer[at++] = 'I';
+    buffer[at++] = 'M';
+    buffer[at++] = MUX_IMAGE_VERSION;
+    buffer[at++] = 0;
+
+    at = put_u16(buffer, at, 1);
+    at = put_u16(buffer, at, 1);
+    at = put_u16(buffer, at, num_inputs);
+    at = put_u16(buffer, at, 6 + 6 + 2 * num_inputs);
+
+    at = put_u16(buffer, at, 5);
+    at = put_u16(buffer, at, 0);
+    at = put_u16(buffer, at, 1);
+
+    at = put_u16(buffer, at, 0);
+    at = put_u16(buffer, at, num_inputs);
+    at = put_u16(buffer, at, MUX_COMBINE_OR);
+
+    for (unsigned int i = 0; i < num_inputs; ++i) {
+	at = put_u16(buffer, at, 10 + i);
+    }
+
+    unsigned int sum1 = 0;
+    unsigned int sum2 = 0;
+
+    for (unsigned int i = 0; i < at; ++i) {
+	sum1 = (sum1 + buffer[i]) % 255;
+	sum2 = (sum2 + sum1) % 255;
+    }
+
+    return put_u16(buffer, at, (sum2 << 8) | sum1);
+}
+
+
+static void test_too_many_inputs()
+{
+    unsigned int len = wide_image(image, MUX_MAX_INPUTS);
+    MUX_CHECK(0 == mux_load_image_buffer(image, len));
+
+    mux_host_set_input(10 + MUX_MAX_INPUTS - 1, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(5));
+    mux_host_set_input(10 + MUX_MAX_INPUTS - 1, LOW);
+
+    len = wide_image(image, MUX_MAX_INPUTS + 1);
+    MUX_CHECK(4 == mux_load_image_buffer(image, len));
+
+    /* The last good image is still loaded */
+    MUX_CHECK(14 + 6 + 6 + 2 * MUX_MAX_INPUTS + 2 == mux_image_size());
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_round_trip();
+    test_damaged();
+    test_keeps_analog();
+    test_too_many_inputs();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_image");
+}
@@ -0,0 +1,357 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for compiling channels into lookup tables (mux_lut.h).
+  Channels with every way of combining, and every PRIORITY rank bit,
+  are put on windows of slots which are contiguous, have gaps, fill
+  MUX_LUT_MAX_WIDTH or cross a word boundary. Every combination of
+  their inputs is then evaluated both through the table and the usual
+  way, with random levels on the slots around them, and the two have
+  to agree with each other and with a model. Also checks the channels
+  which can't be compiled: ones that are too wide and ones with
+  transforms.
+ */
+
+#include "muxduino.h"
+#include "mux_lut.h"
+#include "mux_transform.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Pin FILL_PIN + n takes slot n */
+#define FILL_PIN 10
+#define FILL_OUT 90
+#define NUM_FILL 48
+
+/* Outputs under test, one per window */
+#define OUT_PIN 91
+
+#define MAX_WINDOW_INPUTS 6
+
+
+/* Slots of a channel's inputs, in the order the channel lists them */
+typedef struct Window {
+    int num_inputs;
+    int slots[MAX_WINDOW_INPUTS];
+    int width;
+} Window;
+
+
+static const Window windows[] = {
+    {4, {0, 1, 2, 3}, 4},
+    {4, {3, 0, 2, 1}, 4},			/* Channel order isn't slot order */
+    {3, {12, 9, 14}, 6},			/* Slots in between belong to others */
+    {3, {20, 27, 23}, 8},			/* As wide as a table gets */
+    {5, {29, 31, 30, 32, 34}, 6},		/* Across a word boundary */
+    {6, {35, 28, 33, 31, 30, 29}, 8},	/* Both */
+    {1, {47}, 1},
+};
+
+#define NUM_WINDOWS ((int) (sizeof(windows) / sizeof(windows[0])))
+
+
+/* Channel n of each output: the first four combines, then PRIORITY with each bit */
+#define NUM_PRIORITY_BITS 4
+#define NUM_CHANNELS (4 + NUM_PRIORITY_BITS)
+
+static const MuxCombine channel_combines[4] = {
+    MUX_COMBINE_OR, MUX_COMBINE_AND, MUX_COMBINE_XOR, MUX_COMBINE_MAJORITY
+};
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 8191;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+/* Expected level of a channel for the levels of its inputs, in channel order */
+static int expected(MuxCombine combine, int bit, const int *levels, int num_inputs)
+{
+    int high = 0;
+    int rank = 0;
+
+    for (int i = 0; i < num_inputs; ++i) {
+	if (levels[i]) {
+	    ++high;
+
+	    if (0 == rank) {
+		rank = i + 1;
+	    }
+	}
+    }
+
+    switch (combine) {
+    case MUX_COMBINE_OR:
+	return high > 0;
+
+    case MUX_COMBINE_AND:
+	return high == num_inputs;
+
+    case MUX_COMBINE_XOR:
+	return high & 1;
+
+    case MUX_COMBINE_MAJORITY:
+	return 2 * high > num_inputs;
+
+    case MUX_COMBINE_PRIORITY:
+	return (rank >> bit) & 1;
+    }
+
+    return -1;
+}
+
+
+static void set_slot(MuxWord *levels, int slot, int level)
+{
+    MuxWord bit = (MuxWord) 1 << (slot % MUX_WORD_BITS);
+
+    if (level) {
+	levels[slot / MUX_WORD_BITS] |= bit;
+    }
+    else {
+	levels[slot / MUX_WORD_BITS] &= ~bit;
+    }
+}
+
+
+/* The usual way, with the table out of the way for a moment */
+static int level_without_lut(MuxChannelNode *node, const MuxWord *levels)
+{
+    MuxLut *lut = node->lut;
+
+    node->lut = NULL;
+    int level = mux_channel_level(node, levels);
+    node->lut = lut;
+
+    return level;
+}
+
+
+/* Every combination of the channel's inputs, through the table and without it */
+static void check_channel(MuxChannelNode *node, const Window *window, MuxCombine combine, int bit)
+{
+    MUX_CHECK(NULL != node->lut);
+
+    if (NULL == node->lut) {
+	return;
+    }
+
+    MUX_CHECK(window->width == node->lut->width);
+
+    for (int pattern = 0; pattern < (1 << window->num_inputs); ++pattern) {
+	MuxWord levels[MUX_SAMPLE_WORDS];
+	int in_levels[MAX_WINDOW_INPUTS];
+
+	/* Whatever else is going on mustn't matter */
+	for (int w = 0; w < MUX_SAMPLE_WORDS; ++w) {
+	    levels[w] = ((MuxWord) next_random() << 17) ^ ((MuxWord) next_random() << 2) ^ next_random();
+	}
+
+	for (int i = 0; i < window->num_inputs; ++i) {
+	    in_levels[i] = (pattern >> i) & 1;
+	    set_slot(levels, window->slots[i], in_levels[i]);
+	}
+
+	int level = mux_lut_level(node->lut, levels);
+
+	MUX_CHECK(level_without_lut(node, levels) == level);
+	MUX_CHECK((expected(combine, bit, in_levels, window->num_inputs) ? HIGH : LOW) == level);
+    }
+}
+
+
+static void register_fill()
+{
+    for (int i = 0; i < NUM_FILL; ++i) {
+	MuxPipe pipe = {FILL_PIN + i, FILL_OUT, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+	MUX_CHECK(i == mux_sample_slot(FILL_PIN + i));
+    }
+}
+
+
+static void register_window(int out_pin, const Window *window, int channel)
+{
+    for (int i = 0; i < window->num_inputs; ++i) {
+	MuxPipe pipe = {FILL_PIN + window->slots[i], out_pin, channel};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+}
+
+
+static void test_windows()
+{
+    register_fill();
+
+    for (int w = 0; w < NUM_WINDOWS; ++w) {
+	int out_pin = OUT_PIN + w;
+
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    register_window(out_pin, &windows[w], channel);
+
+	    if (channel < 4) {
+		MUX_CHECK(0 == set_channel_combine(out_pin, channel, channel_combines[channel]));
+	    }
+	    else {
+		MUX_CHECK(0 == set_channel_combine(out_pin, channel, MUX_COMBINE_PRIORITY));
+		MUX_CHECK(0 == set_channel_priority_bit(out_pin, channel, channel - 4));
+	    }
+	}
+
+	MUX_CHECK(0 == set_output_lut(out_pin, true));
+    }
+
+    for (int w = 0; w < NUM_WINDOWS; ++w) {
+	MuxOutputNode *out_node = find_output_node(&mux_outs, OUT_PIN + w);
+
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    MuxChannelNode *node = find_channel_node(&out_node->channels, channel);
+	    MuxCombine combine = (channel < 4) ? channel_combines[channel] : MUX_COMBINE_PRIORITY;
+	    int bit = (channel < 4) ? 0 : channel - 4;
+
+	    check_channel(node, &windows[w], combine, bit);
+	}
+    }
+
+    /* Turning the tables off frees them */
+    for (int w = 0; w < NUM_WINDOWS; ++w) {
+	MUX_CHECK(0 == set_output_lut(OUT_PIN + w, false));
+
+	MuxChannelNode *node = find_output_node(&mux_outs, OUT_PIN + w)->channels.head;
+	MUX_CHECK(NULL == node->lut);
+    }
+
+    MUX_CHECK(1 == set_output_lut(OUT_PIN + NUM_WINDOWS, true));
+
+    mux_clear();
+    MUX_CHECK(total_allocations() == total_frees());
+}
+
+
+/* Output level through the pins, for a pattern on the channel's inputs */
+static int routed_level(int out_pin, const int *slots, int num_inputs, int pattern)
+{
+    for (int i = 0; i < num_inputs; ++i) {
+	mux_host_set_input(FILL_PIN + slots[i], ((pattern >> i) & 1) ? HIGH : LOW);
+    }
+
+    mux_update();
+
+    return mux_host_get_level(out_pin);
+}
+
+
+static void test_fallbacks()
+{
+    register_fill();
+
+    /* One slot too wide, and just wide enough */
+    const int wide[] = {8, 0};
+    const int widest[] = {9, 2};
+
+    for (int i = 0; i < 2; ++i) {
+	MuxPipe pipe = {FILL_PIN + wide[i], OUT_PIN, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+	pipe.channel = 1;
+	pipe.in_pin = FILL_PIN + widest[i];
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    MUX_CHECK(0 == set_channel_combine(OUT_PIN, 0, MUX_COMBINE_PRIORITY));
+    MUX_CHECK(0 == set_output_lut(OUT_PIN, true));
+
+    MuxOutputNode *out_node = find_output_node(&mux_outs, OUT_PIN);
+    MuxChannelNode *too_wide = find_channel_node(&out_node->channels, 0);
+    MuxChannelNode *fits = find_channel_node(&out_node->channels, 1);
+
+    MUX_CHECK(NULL == too_wide->lut);
+    MUX_CHECK(NULL != fits->lut && MUX_LUT_MAX_WIDTH == fits->lut->width);
+
+    /* The wide channel still works, the usual way */
+    for (int pattern = 0; pattern < 4; ++pattern) {
+	int levels[2] = {pattern & 1, (pattern >> 1) & 1};
+	MUX_CHECK(expected(MUX_COMBINE_PRIORITY, 0, levels, 2)
+		  == routed_level(OUT_PIN, wide, 2, pattern));
+    }
+
+    /* Tables follow the topology: narrowing the channel compiles it */
+    MuxPipe far = {FILL_PIN + wide[1], OUT_PIN, 0};
+    unregister_pipe(far);
+    MUX_CHECK(NULL != too_wide->lut && 1 == too_wide->lut->width);
+
+    far.in_pin = FILL_PIN + 5;
+    MUX_CHECK(0 == register_pipe(far));
+    MUX_CHECK(NULL != too_wide->lut && 4 == too_wide->lut->width);
+
+    /* A transform on any input stops the channel from being compiled */
+    set_output_channel(OUT_PIN, 1);
+
+    MuxPipe shaped = {FILL_PIN + widest[1], OUT_PIN, 1};
+    MuxTransform invert = {0, MUX_EDGE_NONE, 0, true};
+    MUX_CHECK(0 == set_pipe_transform(shaped, invert));
+    MUX_CHECK(NULL == fits->lut);
+    MUX_CHECK(NULL != too_wide->lut);
+
+    for (int pattern = 0; pattern < 4; ++pattern) {
+	int levels[2] = {pattern & 1, !((pattern >> 1) & 1)};
+	MUX_CHECK(expected(MUX_COMBINE_OR, 0, levels, 2)
+		  == routed_level(OUT_PIN, widest, 2, pattern));
+    }
+
+    clear_pipe_transform(shaped);
+    MUX_CHECK(NULL != fits->lut);
+
+    for (int pattern = 0; pattern < 4; ++pattern) {
+	int levels[2] = {pattern & 1, (pattern >> 1) & 1};
+	MUX_CHECK(expected(MUX_COMBINE_OR, 0, levels, 2)
+		  == routed_level(OUT_PIN, widest, 2, pattern));
+    }
+
+    for (int i = 0; i < NUM_FILL; ++i) {
+	mux_host_set_input(FILL_PIN + i, LOW);
+    }
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_windows();
+    test_fallbacks();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_lut");
+}
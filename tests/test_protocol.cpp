@@ -0,0 +1,355 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the control protocol (mux_protocol.h): frames split
+  across polls, acknowledgements for every kind of failure, batches
+  whose checks depend on earlier operations in the same frame, and
+  acknowledgements queued while the other end isn't reading.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include "muxduino.h"
+#include "mux_protocol.h"
+#include "mux_image.h"
+#include "mux_cascade.h"
+#include "mux_sample.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Our end of the socket, and the protocol's end */
+static int peer;
+static MuxFdStream fd_stream;
+static MuxProtocol protocol;
+
+
+static unsigned char crc8(unsigned char crc, unsigned char value)
+{
+    crc ^= value;
+
+    for (int i = 0; i < 8; ++i) {
+	crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+
+    return crc;
+}
+
+
+static void send_raw(const unsigned char *data, unsigned int len)
+{
+    MUX_CHECK((ssize_t) len == write(peer, data, len));
+}
+
+
+static void send_frame(unsigned char sequence, const unsigned char *payload, unsigned int length)
+{
+    unsigned char frame[4 + MUX_PROTOCOL_MAX_PAYLOAD];
+    unsigned char crc = crc8(crc8(0, sequence), length);
+
+    frame[0] = MUX_PROTOCOL_SYNC;
+    frame[1] = sequence;
+    frame[2] = length;
+
+    for (unsigned int i = 0; i < length; ++i) {
+	frame[3 + i] = payload[i];
+	crc = crc8(crc, payload[i]);
+    }
+
+    frame[3 + length] = crc;
+    send_raw(frame, 4 + length);
+}
+
+
+/* Polls a few bytes at a time until a frame is done */
+static void poll_frame()
+{
+    int frames = 0;
+
+    for (int i = 0; i < 1000 && 0 == frames; ++i) {
+	frames = mux_protocol_poll(&protocol, 3);
+    }
+
+    MUX_CHECK(1 == frames);
+}
+
+
+/* Reads an acknowledgement and checks that it is well formed and has the right fields */
+static void check_ack(unsigned char sequence, unsigned char status, unsigned char ops_run,
+		      unsigned char failed_op, unsigned char error)
+{
+    unsigned char ack[8];
+
+    MUX_CHECK(8 == read(peer, ack, sizeof(ack)));
+    MUX_CHECK(MUX_PROTOCOL_SYNC == ack[0]);
+    MUX_CHECK(sequence == ack[1]);
+    MUX_CHECK(4 == ack[2]);
+
+    unsigned char crc = 0;
+    for (int i = 1; i < 7; ++i) {
+	crc = crc8(crc, ack[i]);
+    }
+
+    MUX_CHECK(crc == ack[7]);
+    MUX_CHECK(status == ack[3]);
+    MUX_CHECK(ops_run == ack[4]);
+    MUX_CHECK(failed_op == ack[5]);
+    MUX_CHECK(error == ack[6]);
+}
+
+
+/* Appends an opcode and its 16 bit arguments */
+static unsigned int put_op(unsigned char *payload, unsigned int at, unsigned char op,
+			   int num_args, int a = 0, int b = 0, int c = 0)
+{
+    int args[3] = {a, b, c};
+
+    payload[at++] = op;
+
+    for (int i = 0; i < num_args; ++i) {
+	payload[at++] = args[i] & 0xFF;
+	payload[at++] = (args[i] >> 8) & 0xFF;
+    }
+
+    return at;
+}
+
+
+static void test_batch()
+{
+    unsigned char payload[MUX_PROTOCOL_MAX_PAYLOAD];
+    unsigned int length = 0;
+
+    length = put_op(payload, length, MUX_OP_ADD, 3, 5, 9, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 6, 9, 1);
+    length = put_op(payload, length, MUX_OP_SET_CHANNEL, 2, 9, 1);
+    length = put_op(payload, length, MUX_OP_SCENE_STORE, 1, 0);
+    length = put_op(payload, length, MUX_OP_SET_CHANNEL, 2, 9, 0);
+
+    /* Junk before the sync byte is skipped */
+    unsigned char junk[] = {0x00, 0x13, 0x37};
+    send_raw(junk, sizeof(junk));
+
+    send_frame(7, payload, length);
+    poll_frame();
+    check_ack(7, MUX_STATUS_OK, 5, 0, 0);
+    MUX_CHECK(1 == protocol.frames_ok);
+
+    mux_host_set_input(6, HIGH);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(9));
+
+    length = put_op(payload, 0, MUX_OP_SCENE_RECALL, 1, 0);
+    send_frame(8, payload, length);
+    poll_frame();
+    check_ack(8, MUX_STATUS_OK, 1, 0, 0);
+
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(9));
+    mux_host_set_input(6, LOW);
+    mux_update();
+
+    /* A failed op stops the frame, but what ran before it stays */
+    length = put_op(payload, 0, MUX_OP_REMOVE, 3, 6, 9, 1);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 9, 9, 0);
+    length = put_op(payload, length, MUX_OP_CLEAR, 0);
+    send_frame(9, payload, length);
+    poll_frame();
+    check_ack(9, MUX_STATUS_OP_FAILED, 1, 1, 1);
+    MUX_CHECK(1 == protocol.frames_failed);
+
+    mux_host_set_input(6, HIGH);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(9));
+    mux_host_set_input(6, LOW);
+
+    length = put_op(payload, 0, MUX_OP_SET_CHANNEL, 2, 99, 0);
+    send_frame(10, payload, length);
+    poll_frame();
+    check_ack(10, MUX_STATUS_OP_FAILED, 0, 0, 1);
+
+    length = put_op(payload, 0, MUX_OP_CLEAR, 0);
+    send_frame(11, payload, length);
+    poll_frame();
+    check_ack(11, MUX_STATUS_OK, 1, 0, 0);
+}
+
+
+static void test_rejected_frames()
+{
+    unsigned char payload[MUX_PROTOCOL_MAX_PAYLOAD];
+    unsigned int length = put_op(payload, 0, MUX_OP_ADD, 3, 5, 9, 0);
+
+    /* Bad crc, nothing runs */
+    unsigned char frame[] = {MUX_PROTOCOL_SYNC, 20, 0, 0};
+    frame[3] = crc8(crc8(0, 20), 0) ^ 0xFF;
+    send_raw(frame, sizeof(frame));
+    poll_frame();
+    check_ack(20, MUX_STATUS_BAD_CRC, 0, 0, 0);
+
+    /* Unknown opcode after a good one, nothing runs */
+    payload[length++] = 0x7F;
+    send_frame(21, payload, length);
+    poll_frame();
+    check_ack(21, MUX_STATUS_MALFORMED, 0, 0, 0);
+
+    /* Arguments cut short */
+    send_frame(22, payload, 4);
+    poll_frame();
+    check_ack(22, MUX_STATUS_MALFORMED, 0, 0, 0);
+
+    /* An image of nothing is just the header and trailer */
+    MUX_CHECK(16 == mux_image_size());
+
+    /* Too long, answered as soon as the length arrives */
+    unsigned char too_long[] = {MUX_PROTOCOL_SYNC, 23, MUX_PROTOCOL_MAX_PAYLOAD + 1};
+    send_raw(too_long, sizeof(too_long));
+    poll_frame();
+    check_ack(23, MUX_STATUS_TOO_LONG, 0, 0, 0);
+}
+
+
+static void test_checks_within_batch()
+{
+    unsigned char payload[MUX_PROTOCOL_MAX_PAYLOAD];
+    unsigned int length;
+
+    /* Room for one more input, and the frame tries to add two */
+    for (int i = 0; i < MUX_MAX_INPUTS - 1; ++i) {
+	MuxPipe pipe = {20 + i, 9, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    length = put_op(payload, 0, MUX_OP_ADD, 3, 5, 9, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 5, 8, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 6, 9, 0);
+    send_frame(30, payload, length);
+    poll_frame();
+    check_ack(30, MUX_STATUS_OP_FAILED, 2, 2, 4);
+
+    length = put_op(payload, 0, MUX_OP_CLEAR, 0);
+    send_frame(31, payload, length);
+    poll_frame();
+    check_ack(31, MUX_STATUS_OK, 1, 0, 0);
+
+    /* A loop made out of pipes from the same frame */
+    MUX_CHECK(0 == mux_set_cascade(true));
+
+    length = put_op(payload, 0, MUX_OP_ADD, 3, 5, 10, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 10, 11, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 11, 12, 0);
+    length = put_op(payload, length, MUX_OP_ADD, 3, 12, 10, 0);
+    send_frame(32, payload, length);
+    poll_frame();
+    check_ack(32, MUX_STATUS_OP_FAILED, 3, 3, 5);
+
+    mux_host_set_input(5, HIGH);
+    for (int i = 0; i < 3; ++i) {
+	mux_update();
+    }
+
+    MUX_CHECK(HIGH == mux_host_get_level(12));
+    mux_host_set_input(5, LOW);
+
+    mux_clear();
+    MUX_CHECK(0 == mux_set_cascade(false));
+}
+
+
+static void test_slow_reader()
+{
+    unsigned char payload[MUX_PROTOCOL_MAX_PAYLOAD];
+    unsigned int length = put_op(payload, 0, MUX_OP_CLEAR, 0);
+
+    /* Fill the socket so the other end can't take anything */
+    unsigned char filler[256];
+    memset(filler, 0, sizeof(filler));
+
+    unsigned long filled = 0;
+    ssize_t written;
+
+    while ((written = write(fd_stream.fd, filler, sizeof(filler))) > 0) {
+	filled += written;
+    }
+
+    MUX_CHECK(EAGAIN == errno || EWOULDBLOCK == errno);
+
+    /* Polling has to come back with the acks queued, not wait for us */
+    for (int i = 0; i < 3; ++i) {
+	send_frame(40 + i, payload, length);
+	poll_frame();
+    }
+
+    MUX_CHECK(24 == fd_stream.queued);
+    MUX_CHECK(0 == fd_stream.dropped);
+
+    /* Once we read, the next poll sends them on */
+    unsigned char drain[256];
+    while (filled > 0) {
+	ssize_t got = read(peer, drain, (filled < sizeof(drain)) ? filled : sizeof(drain));
+
+	if (got <= 0) {
+	    break;
+	}
+
+	filled -= got;
+    }
+
+    mux_protocol_poll(&protocol, 1);
+    MUX_CHECK(0 == fd_stream.queued);
+
+    for (int i = 0; i < 3; ++i) {
+	check_ack(40 + i, MUX_STATUS_OK, 1, 0, 0);
+    }
+}
+
+
+int main()
+{
+    int fds[2];
+
+    if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+	perror("socketpair");
+	return 1;
+    }
+
+    peer = fds[1];
+    mux_protocol_begin(&protocol, mux_stream_fd(&fd_stream, fds[0]));
+
+    test_batch();
+    test_rejected_frames();
+    test_checks_within_batch();
+    test_slow_reader();
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return mux_test_finish("test_protocol");
+}
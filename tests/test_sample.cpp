@@ -0,0 +1,272 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the input filter (mux_sample.h). Pulses shorter and
+  longer than the filter depth are run through every depth, one
+  update per tick of the manual clock, checking the output levels and
+  the glitch counts. Then many inputs with different depths are
+  driven with random levels and compared against a simple model of
+  one counter per pin, which checks the bit-parallel counters slot by
+  slot, across words, along with mux_sample_settled().
+ */
+
+#include "muxduino.h"
+#include "mux_sample.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define IN_PIN 10
+#define OUT_PIN 20
+
+/* Microseconds between updates */
+#define PERIOD 1000
+
+/* Inputs for the model test, pins 0 up */
+#if MUX_MAX_INPUTS < 40
+#define NUM_MODEL_INPUTS MUX_MAX_INPUTS
+#else
+#define NUM_MODEL_INPUTS 40
+#endif
+
+#define MODEL_OUT_PIN 99
+#define MODEL_UPDATES 5000
+
+
+static void tick()
+{
+    mux_update();
+    mux_host_advance_clock(PERIOD);
+}
+
+
+/*
+  Holds the input at level for length updates and then puts it back,
+  checking the output on every update until the filter has settled.
+ */
+static void check_pulse(int depth, int level, int length)
+{
+    int rest = (HIGH == level) ? LOW : HIGH;
+    bool passes = length >= depth;
+    unsigned int glitches = mux_input_glitches(IN_PIN);
+
+    mux_host_set_input(IN_PIN, level);
+
+    for (int i = 1; i <= length; ++i) {
+	tick();
+
+	/* The new level comes out on the depth'th update */
+	MUX_CHECK(((i >= depth) ? level : rest) == mux_host_get_level(OUT_PIN));
+	MUX_CHECK((1 == depth || i >= depth) == mux_sample_settled());
+    }
+
+    mux_host_set_input(IN_PIN, rest);
+
+    if (passes) {
+	/* And going back takes depth updates too */
+	for (int i = 1; i <= depth; ++i) {
+	    tick();
+	    MUX_CHECK(((i >= depth) ? rest : level) == mux_host_get_level(OUT_PIN));
+	}
+
+	MUX_CHECK(glitches == mux_input_glitches(IN_PIN));
+    }
+    else {
+	tick();
+	MUX_CHECK(rest == mux_host_get_level(OUT_PIN));
+	MUX_CHECK(glitches + 1 == mux_input_glitches(IN_PIN));
+    }
+
+    MUX_CHECK(mux_sample_settled());
+}
+
+
+static void test_pulses()
+{
+    mux_host_set_clock(0);
+
+    MuxPipe pipe = {IN_PIN, OUT_PIN, 0};
+    MUX_CHECK(0 == register_pipe(pipe));
+
+    MUX_CHECK(1 == mux_set_input_filter(IN_PIN, 0));
+    MUX_CHECK(1 == mux_set_input_filter(IN_PIN, MUX_MAX_FILTER_DEPTH + 1));
+    MUX_CHECK(1 == mux_set_input_filter(IN_PIN + 1, 2));
+
+    unsigned long total = mux_total_glitches();
+
+    for (int depth = 1; depth <= MUX_MAX_FILTER_DEPTH; ++depth) {
+	MUX_CHECK(0 == mux_set_input_filter(IN_PIN, depth));
+	tick();
+	MUX_CHECK(LOW == mux_host_get_level(OUT_PIN));
+
+	for (int length = 1; length <= depth + 1; ++length) {
+	    check_pulse(depth, HIGH, length);
+	}
+
+	/* Dips in a HIGH input are filtered the same way */
+	mux_host_set_input(IN_PIN, HIGH);
+
+	for (int i = 0; i < depth; ++i) {
+	    tick();
+	}
+
+	MUX_CHECK(HIGH == mux_host_get_level(OUT_PIN));
+
+	for (int length = 1; length <= depth + 1; ++length) {
+	    check_pulse(depth, LOW, length);
+	}
+
+	mux_host_set_input(IN_PIN, LOW);
+
+	for (int i = 0; i < depth; ++i) {
+	    tick();
+	}
+    }
+
+    /* Every pulse shorter than its depth was one glitch */
+    unsigned long expected = 0;
+
+    for (int depth = 1; depth <= MUX_MAX_FILTER_DEPTH; ++depth) {
+	expected += 2 * (depth - 1);
+    }
+
+    MUX_CHECK(expected == mux_input_glitches(IN_PIN));
+    MUX_CHECK(total + expected == mux_total_glitches());
+
+    /* A channel filter sets the depth of each of its inputs */
+    MuxPipe second = {IN_PIN + 1, OUT_PIN, 0};
+    MUX_CHECK(0 == register_pipe(second));
+    MUX_CHECK(0 == mux_set_channel_filter(OUT_PIN, 0, 2));
+    MUX_CHECK(1 == mux_set_channel_filter(OUT_PIN, 1, 2));
+
+    mux_host_set_input(IN_PIN + 1, HIGH);
+    tick();
+    MUX_CHECK(LOW == mux_host_get_level(OUT_PIN));
+    tick();
+    MUX_CHECK(HIGH == mux_host_get_level(OUT_PIN));
+    mux_host_set_input(IN_PIN + 1, LOW);
+
+    /* Glitches are forgotten along with the pin */
+    mux_clear();
+    MUX_CHECK(0 == mux_input_glitches(IN_PIN));
+}
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 12345;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+static void test_model()
+{
+    int depths[NUM_MODEL_INPUTS];
+    int raw[NUM_MODEL_INPUTS];
+    int filtered[NUM_MODEL_INPUTS];
+    int counts[NUM_MODEL_INPUTS];
+    unsigned int glitches[NUM_MODEL_INPUTS];
+    unsigned long total = mux_total_glitches();
+
+    for (int pin = 0; pin < NUM_MODEL_INPUTS; ++pin) {
+	MuxPipe pipe = {pin, MODEL_OUT_PIN, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    /* Every depth, spread over both words */
+    for (int pin = 0; pin < NUM_MODEL_INPUTS; ++pin) {
+	depths[pin] = 1 + pin % MUX_MAX_FILTER_DEPTH;
+	raw[pin] = LOW;
+	filtered[pin] = LOW;
+	counts[pin] = 0;
+	glitches[pin] = 0;
+
+	MUX_CHECK(0 == mux_set_input_filter(pin, depths[pin]));
+	mux_host_set_input(pin, LOW);
+    }
+
+    tick();
+
+    for (int update = 0; update < MODEL_UPDATES; ++update) {
+	/* Mostly short pulses, with the odd long one */
+	for (int pin = 0; pin < NUM_MODEL_INPUTS; ++pin) {
+	    if (next_random() % 8 < ((update / 500) % 2 ? 1 : 3)) {
+		raw[pin] = (HIGH == raw[pin]) ? LOW : HIGH;
+		mux_host_set_input(pin, raw[pin]);
+	    }
+	}
+
+	tick();
+
+	bool settled = true;
+
+	for (int pin = 0; pin < NUM_MODEL_INPUTS; ++pin) {
+	    if (raw[pin] != filtered[pin]) {
+		if (++counts[pin] >= depths[pin]) {
+		    filtered[pin] = raw[pin];
+		    counts[pin] = 0;
+		}
+	    }
+	    else if (counts[pin]) {
+		++glitches[pin];
+		++total;
+		counts[pin] = 0;
+	    }
+
+	    if (counts[pin]) {
+		settled = false;
+	    }
+
+	    int slot = mux_sample_slot(pin);
+	    MUX_CHECK(filtered[pin] == (MUX_BIT(mux_levels, slot) ? HIGH : LOW));
+	}
+
+	MUX_CHECK(settled == mux_sample_settled());
+    }
+
+    for (int pin = 0; pin < NUM_MODEL_INPUTS; ++pin) {
+	MUX_CHECK(glitches[pin] == mux_input_glitches(pin));
+    }
+
+    MUX_CHECK(total == mux_total_glitches());
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_pulses();
+    test_model();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_sample");
+}
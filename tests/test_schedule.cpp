@@ -0,0 +1,183 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for the fixed rate scheduler (mux_schedule.h) and output
+  rate dividers (set_output_rate() in muxduino.h). The manual clock
+  stands in for the timer: the clock is moved along and
+  mux_schedule_poll() runs the updates that are due, which should
+  come exactly once a period. Outputs with a divider should only
+  change on every divider'th of those updates.
+ */
+
+#include "muxduino.h"
+#include "mux_schedule.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define IN_PIN 10
+
+/* Output n has a divider of n - OUT_PIN + 1 */
+#define OUT_PIN 20
+#define MAX_DIVIDER 5
+
+#define PERIOD 1000
+#define NUM_PERIODS 60
+
+
+static unsigned long cycles()
+{
+    MuxScheduleStats stats;
+
+    mux_schedule_stats(&stats);
+    return stats.cycles;
+}
+
+
+static void test_dividers()
+{
+    mux_host_set_clock(1000);
+
+    for (int divider = 1; divider <= MAX_DIVIDER; ++divider) {
+	MuxPipe pipe = {IN_PIN, OUT_PIN + divider - 1, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+	MUX_CHECK(0 == set_output_rate(OUT_PIN + divider - 1, divider));
+    }
+
+    MUX_CHECK(1 == set_output_rate(OUT_PIN, 0));
+    MUX_CHECK(1 == set_output_rate(OUT_PIN, 256));
+    MUX_CHECK(1 == set_output_rate(99, 2));
+
+    MUX_CHECK(1 == mux_schedule_start(MUX_MIN_PERIOD - 1));
+    MUX_CHECK(1 == mux_schedule_start(MUX_MAX_PERIOD + 1));
+    MUX_CHECK(!mux_schedule_running());
+    MUX_CHECK(0 == mux_schedule_start(PERIOD));
+    MUX_CHECK(mux_schedule_running());
+
+    int held[MAX_DIVIDER];
+
+    for (int divider = 1; divider <= MAX_DIVIDER; ++divider) {
+	held[divider - 1] = LOW;
+    }
+
+    for (int n = 0; n < NUM_PERIODS; ++n) {
+	/* A different level on every update */
+	int level = (n % 2) ? HIGH : LOW;
+	mux_host_set_input(IN_PIN, level);
+
+	/* Nothing runs before the period is up */
+	mux_host_advance_clock(PERIOD - 1);
+	mux_schedule_poll();
+	MUX_CHECK((unsigned long) n == cycles());
+
+	mux_host_advance_clock(1);
+	mux_schedule_poll();
+	mux_schedule_poll();
+	MUX_CHECK((unsigned long) n + 1 == cycles());
+
+	/* The first update after setting a divider evaluates the output */
+	for (int divider = 1; divider <= MAX_DIVIDER; ++divider) {
+	    if (0 == n % divider) {
+		held[divider - 1] = level;
+	    }
+
+	    MUX_CHECK(held[divider - 1] == mux_host_get_level(OUT_PIN + divider - 1));
+	}
+    }
+
+    /* Setting a divider again evaluates on the next update */
+    MUX_CHECK(0 == set_output_rate(OUT_PIN + MAX_DIVIDER - 1, MAX_DIVIDER));
+    mux_host_set_input(IN_PIN, HIGH);
+    mux_host_advance_clock(PERIOD);
+    mux_schedule_poll();
+    MUX_CHECK(HIGH == mux_host_get_level(OUT_PIN + MAX_DIVIDER - 1));
+
+    mux_schedule_stop();
+    MUX_CHECK(!mux_schedule_running());
+
+    mux_clear();
+}
+
+
+static void test_timing()
+{
+    mux_host_set_clock(1000);
+
+    MuxPipe pipe = {IN_PIN, OUT_PIN, 0};
+    MUX_CHECK(0 == register_pipe(pipe));
+    MUX_CHECK(0 == mux_schedule_start(PERIOD));
+
+    MuxScheduleStats stats;
+
+    mux_host_advance_clock(PERIOD);
+    mux_schedule_poll();
+    mux_schedule_stats(&stats);
+    MUX_CHECK(1 == stats.cycles && 0 == stats.missed && 0 == stats.late);
+
+    /* 3.7 periods on, two were missed and the one that runs is late */
+    mux_host_advance_clock(3700);
+    mux_schedule_poll();
+    mux_schedule_stats(&stats);
+    MUX_CHECK(2 == stats.cycles && 2 == stats.missed && 1 == stats.late);
+
+    /* And then it is back on the original beat */
+    mux_host_advance_clock(300);
+    mux_schedule_poll();
+    mux_schedule_stats(&stats);
+    MUX_CHECK(3 == stats.cycles && 1 == stats.late);
+
+    /* An update that takes longer than the period is an overrun */
+    mux_host_set_clock_step(1200);
+    mux_host_advance_clock(PERIOD);
+    mux_schedule_poll();
+    mux_host_set_clock_step(0);
+    mux_schedule_stats(&stats);
+    MUX_CHECK(4 == stats.cycles && 1 == stats.overruns && stats.longest >= 1200);
+
+    /* Nothing runs once stopped */
+    mux_schedule_stop();
+    mux_host_advance_clock(5 * PERIOD);
+    mux_schedule_poll();
+    MUX_CHECK(4 == cycles());
+
+    mux_schedule_reset_stats();
+    mux_schedule_stats(&stats);
+    MUX_CHECK(0 == stats.cycles && 0 == stats.overruns && 0 == stats.longest);
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_dividers();
+    test_timing();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_schedule");
+}
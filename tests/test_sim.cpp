@@ -0,0 +1,223 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for router contexts (MuxContext in mux_state.h) and the
+  board simulator built on them (mux_sim.h). Two contexts with their
+  own topologies, cascade settings and filter state are swapped back
+  and forth without disturbing each other, and a chain of simulated
+  boards passes an edge along with the expected delay while leaving
+  the program's own topology alone.
+ */
+
+#include "muxduino.h"
+#include "mux_cascade.h"
+#include "mux_transform.h"
+#include "mux_sim.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define NUM_BOARDS 50
+
+
+static void test_contexts()
+{
+    MuxContext first;
+    MuxContext second;
+
+    /* The first context filters its input over three updates */
+    MuxPipe home = {5, 6, 0};
+    MUX_CHECK(0 == register_pipe(home));
+    MUX_CHECK(0 == mux_set_input_filter(5, 3));
+
+    mux_host_set_input(5, HIGH);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(6));
+
+    mux_context_save(&first);
+    mux_context_init(&second);
+    mux_context_load(&second);
+
+    MUX_CHECK(NULL == mux_outs.head);
+    MUX_CHECK(0 == mux_update_count);
+    MUX_CHECK(!mux_cascade_enabled());
+    MUX_CHECK(-1 == mux_sample_slot(5));
+
+    /* The second context cascades, and has its slots in another order */
+    MUX_CHECK(0 == mux_set_cascade(true));
+
+    MuxPipe pipes[] = {{9, 7, 0}, {5, 8, 0}, {8, 7, 1}};
+
+    for (unsigned int i = 0; i < sizeof(pipes) / sizeof(pipes[0]); ++i) {
+	MUX_CHECK(0 == register_pipe(pipes[i]));
+    }
+
+    set_output_channel(7, 1);
+    MUX_CHECK(1 == mux_sample_slot(5));
+
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(8));
+    MUX_CHECK(HIGH == mux_host_get_level(7));
+    MUX_CHECK(LOW == mux_host_get_level(6));
+
+    mux_context_save(&second);
+    mux_context_load(&first);
+
+    MUX_CHECK(1 == mux_update_count);
+    MUX_CHECK(!mux_cascade_enabled());
+    MUX_CHECK(0 == mux_sample_slot(5));
+    MUX_CHECK(NULL == find_output_node(&mux_outs, 7));
+
+    /* The filter carries on from where it was */
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(6));
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(6));
+    MUX_CHECK(3 == mux_update_count);
+
+    mux_context_save(&first);
+    mux_context_load(&second);
+
+    MUX_CHECK(1 == mux_update_count);
+    MUX_CHECK(mux_cascade_enabled());
+
+    mux_host_set_input(5, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(7));
+    MUX_CHECK(HIGH == mux_host_get_level(6));
+
+    mux_clear();
+    MUX_CHECK(0 == mux_set_cascade(false));
+    mux_context_load(&first);
+
+    /* Took three updates to come through, so takes three to go */
+    mux_update();
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(6));
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(6));
+
+    mux_clear();
+}
+
+
+static void test_sim()
+{
+    /* The program's own topology has to survive the simulation */
+    MuxPipe home = {5, 6, 0};
+    MUX_CHECK(0 == register_pipe(home));
+
+    mux_host_set_input(5, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(6));
+
+    MuxPipe pipe = {2, 3, 0};
+
+    for (int board = 0; board < NUM_BOARDS; ++board) {
+	MUX_CHECK(board == mux_sim_add_board());
+	MUX_CHECK(0 == mux_sim_select(board));
+	MUX_CHECK(0 == register_pipe(pipe));
+
+	if (board > 0) {
+	    MUX_CHECK(0 == mux_sim_connect(board - 1, 3, board, 2, 1));
+	}
+    }
+
+    MUX_CHECK(1 == mux_sim_select(NUM_BOARDS));
+    MUX_CHECK(1 == mux_sim_connect(0, 3, NUM_BOARDS, 2, 1));
+    MUX_CHECK(2 == mux_sim_connect(0, 300, 1, 2, 1));
+    MUX_CHECK(3 == mux_sim_connect(0, 3, 1, 2, 0));
+
+    MUX_CHECK(0 == mux_sim_select(-1));
+    MUX_CHECK(mux_outs.head && 6 == mux_outs.head->out_pin);
+    MUX_CHECK(NUM_BOARDS == mux_sim_num_boards());
+
+    mux_sim_run(10);
+    MUX_CHECK(mux_sim_quiet());
+
+    MuxSimStats stats;
+    mux_sim_stats(&stats);
+    unsigned long updates = stats.updates;
+    unsigned long start = mux_sim_now();
+
+    MUX_CHECK(0 == mux_sim_set_input(0, 2, HIGH));
+    mux_sim_run(100000);
+
+    MUX_CHECK(HIGH == mux_sim_get_level(NUM_BOARDS - 1, 3));
+    MUX_CHECK((long) start == mux_sim_last_change(0, 2));
+    MUX_CHECK(NUM_BOARDS - 1 == mux_sim_delay(0, 2, NUM_BOARDS - 1, 3));
+
+    /* Only the boards the edge went through were updated */
+    mux_sim_stats(&stats);
+    MUX_CHECK(NUM_BOARDS == stats.updates - updates);
+    MUX_CHECK(stats.skipped > 0);
+
+    /* A board which delays its output stays awake until it comes out */
+    int delayed = mux_sim_add_board();
+    MUX_CHECK(0 == mux_sim_select(delayed));
+    MUX_CHECK(0 == register_pipe(pipe));
+
+    MuxTransform transform = {4, MUX_EDGE_NONE, 0, false};
+    MUX_CHECK(0 == set_pipe_transform(pipe, transform));
+
+    MUX_CHECK(0 == mux_sim_select(-1));
+    MUX_CHECK(0 == mux_sim_connect(NUM_BOARDS - 1, 3, delayed, 2, 2));
+
+    mux_sim_run(1000);
+    MUX_CHECK(HIGH == mux_sim_get_level(delayed, 3));
+    MUX_CHECK(4 == mux_sim_delay(delayed, 2, delayed, 3));
+
+    mux_sim_set_input(0, 2, LOW);
+    mux_sim_run(100000);
+    MUX_CHECK(NUM_BOARDS - 1 + 2 + 4 == mux_sim_delay(0, 2, delayed, 3));
+
+    /* None of it touched the program's pins */
+    MUX_CHECK(HIGH == mux_host_get_level(6));
+    MUX_CHECK(LOW == mux_host_get_level(3));
+
+    mux_sim_clear();
+    MUX_CHECK(0 == mux_sim_num_boards());
+    MUX_CHECK(0 == mux_sim_now());
+
+    mux_host_set_input(5, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(6));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_contexts();
+    test_sim();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_sim");
+}
@@ -0,0 +1,334 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/* MUX_TEST_FLAGS: -DMUX_STATS=1 */
+
+/*
+  Host tests for the activity counters (mux_stats.h). Channels with
+  every way of combining are fed random levels, and a model counts
+  the input edges, wins, output toggles and selections each pipe
+  should have. PRIORITY channels list their inputs in a different
+  order to the slots, so only the first HIGH input in the channel's
+  own order may win. Also checks mux_stats_reset() and that counters
+  stop at MUX_STATS_MAX.
+ */
+
+#include "muxduino.h"
+#include "mux_stats.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+#if !MUX_STATS
+#error "test_stats needs MUX_STATS, build it with -DMUX_STATS=1"
+#endif
+
+
+#define NUM_INS 6
+#define IN_PIN 2
+
+#define NUM_OUTS 3
+#define OUT_PIN 20
+#define NUM_CHANNELS 2
+#define CHANNEL_INPUTS 3
+
+#define NUM_UPDATES 2000
+
+
+typedef struct ChannelSetup {
+    MuxCombine combine;
+    int priority_bit;
+    int ins[CHANNEL_INPUTS];
+} ChannelSetup;
+
+
+/*
+  The first channel registers the inputs in slot order, the PRIORITY
+  ones list later slots first.
+ */
+static const ChannelSetup setups[NUM_OUTS][NUM_CHANNELS] = {
+    {{MUX_COMBINE_OR, 0, {0, 1, 2}}, {MUX_COMBINE_AND, 0, {3, 4, 5}}},
+    {{MUX_COMBINE_XOR, 0, {1, 3, 5}}, {MUX_COMBINE_MAJORITY, 0, {0, 2, 4}}},
+    {{MUX_COMBINE_PRIORITY, 0, {5, 2, 0}}, {MUX_COMBINE_PRIORITY, 1, {4, 3, 1}}},
+};
+
+
+/* What the counters should be, by input, and by output and channel */
+static uint32_t edges[NUM_INS];
+static uint32_t wins[NUM_OUTS][NUM_CHANNELS][CHANNEL_INPUTS];
+static uint32_t toggles[NUM_OUTS];
+static uint32_t selected[NUM_OUTS][NUM_CHANNELS];
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 31337;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+/* Level of a channel, and the index of the input that decided it for PRIORITY */
+static int channel_level(const ChannelSetup *setup, const int *levels, int *first)
+{
+    int high = 0;
+
+    *first = -1;
+
+    for (int i = 0; i < CHANNEL_INPUTS; ++i) {
+	if (levels[setup->ins[i]]) {
+	    ++high;
+
+	    if (*first < 0) {
+		*first = i;
+	    }
+	}
+    }
+
+    switch (setup->combine) {
+    case MUX_COMBINE_OR:
+	return high > 0;
+
+    case MUX_COMBINE_AND:
+	return high == CHANNEL_INPUTS;
+
+    case MUX_COMBINE_XOR:
+	return high & 1;
+
+    case MUX_COMBINE_MAJORITY:
+	return 2 * high > CHANNEL_INPUTS;
+
+    case MUX_COMBINE_PRIORITY:
+	return ((*first + 1) >> setup->priority_bit) & 1;
+    }
+
+    return -1;
+}
+
+
+static void clear_model()
+{
+    for (int in = 0; in < NUM_INS; ++in) {
+	edges[in] = 0;
+    }
+
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	toggles[out] = 0;
+
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    selected[out][channel] = 0;
+
+	    for (int i = 0; i < CHANNEL_INPUTS; ++i) {
+		wins[out][channel][i] = 0;
+	    }
+	}
+    }
+}
+
+
+/* Every pipe turns up exactly once, with the counters from the model */
+static void check_stats()
+{
+    bool seen[NUM_OUTS][NUM_CHANNELS][CHANNEL_INPUTS] = {};
+    int num_pipes = 0;
+
+    MuxStatsCursor cursor;
+    MuxPipeStats stats;
+
+    mux_stats_begin(&cursor);
+    while (mux_stats_next(&cursor, &stats)) {
+	int out = stats.pipe.out_pin - OUT_PIN;
+	int channel = stats.pipe.channel;
+	int in = stats.pipe.in_pin - IN_PIN;
+	int i = 0;
+
+	while (i < CHANNEL_INPUTS && setups[out][channel].ins[i] != in) {
+	    ++i;
+	}
+
+	MUX_CHECK(i < CHANNEL_INPUTS);
+	MUX_CHECK(!seen[out][channel][i]);
+	seen[out][channel][i] = true;
+	++num_pipes;
+
+	MUX_CHECK(edges[in] == stats.input_edges);
+	MUX_CHECK(wins[out][channel][i] == stats.wins);
+	MUX_CHECK(toggles[out] == stats.output_toggles);
+	MUX_CHECK(selected[out][channel] == stats.selected);
+    }
+
+    MUX_CHECK(NUM_OUTS * NUM_CHANNELS * CHANNEL_INPUTS == num_pipes);
+}
+
+
+static void test_counters()
+{
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    const ChannelSetup *setup = &setups[out][channel];
+
+	    for (int i = 0; i < CHANNEL_INPUTS; ++i) {
+		MuxPipe pipe = {IN_PIN + setup->ins[i], OUT_PIN + out, channel};
+		MUX_CHECK(0 == register_pipe(pipe));
+	    }
+
+	    MUX_CHECK(0 == set_channel_combine(OUT_PIN + out, channel, setup->combine));
+	    MUX_CHECK(0 == set_channel_priority_bit(OUT_PIN + out, channel, setup->priority_bit));
+	}
+    }
+
+    /* Get every output written once, so that the next change is a toggle */
+    int levels[NUM_INS] = {};
+    int out_levels[NUM_OUTS];
+    int channels[NUM_OUTS] = {0, 0, 0};
+
+    mux_update();
+    mux_stats_reset();
+
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	out_levels[out] = mux_host_get_level(OUT_PIN + out);
+    }
+
+    clear_model();
+    check_stats();
+
+    for (int update = 0; update < NUM_UPDATES; ++update) {
+	for (int in = 0; in < NUM_INS; ++in) {
+	    if (0 == next_random() % 3) {
+		levels[in] = !levels[in];
+		mux_host_set_input(IN_PIN + in, levels[in] ? HIGH : LOW);
+		++edges[in];
+	    }
+	}
+
+	for (int out = 0; out < NUM_OUTS; ++out) {
+	    if (0 == next_random() % 16) {
+		channels[out] = next_random() % NUM_CHANNELS;
+		set_output_channel(OUT_PIN + out, channels[out]);
+	    }
+
+	    const ChannelSetup *setup = &setups[out][channels[out]];
+	    int first;
+	    int level = channel_level(setup, levels, &first);
+
+	    ++selected[out][channels[out]];
+
+	    if (level != out_levels[out]) {
+		++toggles[out];
+		out_levels[out] = level;
+	    }
+
+	    for (int i = 0; level && i < CHANNEL_INPUTS; ++i) {
+		if (MUX_COMBINE_PRIORITY == setup->combine ? i == first : levels[setup->ins[i]]) {
+		    ++wins[out][channels[out]][i];
+		}
+	    }
+	}
+
+	mux_update();
+
+	for (int out = 0; out < NUM_OUTS; ++out) {
+	    MUX_CHECK((out_levels[out] ? HIGH : LOW) == mux_host_get_level(OUT_PIN + out));
+	}
+
+	if (0 == update % 100) {
+	    check_stats();
+	}
+    }
+
+    check_stats();
+
+    /* Counting starts over, for every pipe */
+    mux_stats_reset();
+    clear_model();
+    check_stats();
+
+    for (int in = 0; in < NUM_INS; ++in) {
+	mux_host_set_input(IN_PIN + in, LOW);
+    }
+
+    mux_clear();
+
+    /* Nothing left to go over */
+    MuxStatsCursor cursor;
+    MuxPipeStats stats;
+
+    mux_stats_begin(&cursor);
+    MUX_CHECK(!mux_stats_next(&cursor, &stats));
+}
+
+
+static void test_saturation()
+{
+    MuxPipe pipe = {IN_PIN, OUT_PIN, 0};
+    MUX_CHECK(0 == register_pipe(pipe));
+
+    mux_update();
+
+    MuxOutputNode *out_node = find_output_node(&mux_outs, OUT_PIN);
+    MuxChannelNode *channel_node = out_node->channels.head;
+    MuxInputNode *in_node = channel_node->inputs.head;
+
+    channel_node->selected = MUX_STATS_MAX - 2;
+    in_node->wins = MUX_STATS_MAX - 1;
+    out_node->toggles = MUX_STATS_MAX - 1;
+
+    for (int i = 0; i < 4; ++i) {
+	mux_host_set_input(IN_PIN, (i % 2) ? LOW : HIGH);
+	mux_update();
+    }
+
+    MuxStatsCursor cursor;
+    MuxPipeStats stats;
+
+    mux_stats_begin(&cursor);
+    MUX_CHECK(mux_stats_next(&cursor, &stats));
+    MUX_CHECK(MUX_STATS_MAX == stats.selected);
+    MUX_CHECK(MUX_STATS_MAX == stats.wins);
+    MUX_CHECK(MUX_STATS_MAX == stats.output_toggles);
+    MUX_CHECK(4 == stats.input_edges);
+    MUX_CHECK(!mux_stats_next(&cursor, &stats));
+
+    mux_stats_reset();
+    mux_stats_begin(&cursor);
+    MUX_CHECK(mux_stats_next(&cursor, &stats));
+    MUX_CHECK(0 == stats.selected && 0 == stats.wins && 0 == stats.output_toggles);
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_counters();
+    test_saturation();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_stats");
+}
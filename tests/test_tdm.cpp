@@ -0,0 +1,216 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for time-division channel cycling (mux_tdm.h). Outputs
+  with different dwells and schedules are stepped for many updates,
+  checking after each one that every output is on the channel for its
+  slot and passing that channel's input. Slots are lined up with the
+  update counter, so the channel for an update is always
+  channels[(count / dwell) % length], where count is the number of
+  updates before it.
+ */
+
+#include "muxduino.h"
+#include "mux_tdm.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Channel c of every output has input pin IN_PIN + c */
+#define IN_PIN 30
+#define NUM_CHANNELS 6
+
+#define NUM_UPDATES 200
+
+
+typedef struct Schedule {
+    int out_pin;
+    int channels[5];
+    int length;
+    unsigned int dwell;
+} Schedule;
+
+
+static const Schedule schedules[] = {
+    {20, {0, 1, 2}, 3, 1},
+    {21, {3, 0, 3, 5}, 4, 3},	/* A channel can come up twice */
+    {22, {4, 1}, 2, 5},
+    {23, {2, 5, 0, 1, 4}, 5, 3},	/* Same dwell as 21 */
+};
+
+#define NUM_SCHEDULES ((int) (sizeof(schedules) / sizeof(schedules[0])))
+
+
+static int channel_now(const Schedule *schedule, unsigned long count)
+{
+    return schedule->channels[(count / schedule->dwell) % schedule->length];
+}
+
+
+static int current_channel(int out_pin)
+{
+    return find_output_node(&mux_outs, out_pin)->channel_num;
+}
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 777;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+static void test_rotation()
+{
+    for (int i = 0; i < NUM_SCHEDULES; ++i) {
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    MuxPipe pipe = {IN_PIN + channel, schedules[i].out_pin, channel};
+	    MUX_CHECK(0 == register_pipe(pipe));
+	}
+    }
+
+    const int channels[] = {0, 1};
+    MUX_CHECK(1 == set_output_schedule(99, channels, 2, 1));
+    MUX_CHECK(2 == set_output_schedule(20, channels, 0, 1));
+    MUX_CHECK(2 == set_output_schedule(20, channels, MUX_MAX_TDM_SLOTS + 1, 1));
+    MUX_CHECK(2 == set_output_schedule(20, channels, 2, 0));
+
+    /* Start part way into a slot, so the schedules don't all start together */
+    for (int i = 0; i < 7; ++i) {
+	mux_update();
+    }
+
+    for (int i = 0; i < NUM_SCHEDULES; ++i) {
+	const Schedule *schedule = &schedules[i];
+	MUX_CHECK(0 == set_output_schedule(schedule->out_pin, schedule->channels,
+					    schedule->length, schedule->dwell));
+
+	/* Straight onto the channel for the current slot */
+	MUX_CHECK(channel_now(schedule, mux_update_count) == current_channel(schedule->out_pin));
+
+	/* Set one more update in, the next one lines up all the same */
+	mux_update();
+    }
+
+    for (int update = 0; update < NUM_UPDATES; ++update) {
+	int levels[NUM_CHANNELS];
+
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    levels[channel] = (next_random() % 2) ? HIGH : LOW;
+	    mux_host_set_input(IN_PIN + channel, levels[channel]);
+	}
+
+	unsigned long count = mux_update_count;
+	mux_update();
+
+	for (int i = 0; i < NUM_SCHEDULES; ++i) {
+	    const Schedule *schedule = &schedules[i];
+	    int channel = channel_now(schedule, count);
+
+	    MUX_CHECK(channel == current_channel(schedule->out_pin));
+	    MUX_CHECK(levels[channel] == mux_host_get_level(schedule->out_pin));
+	}
+
+	/* Outputs with the same dwell switch on the same update */
+	MUX_CHECK((channel_now(&schedules[1], count) != channel_now(&schedules[1], count - 1))
+		  == (channel_now(&schedules[3], count) != channel_now(&schedules[3], count - 1)));
+    }
+
+    mux_clear();
+}
+
+
+static void test_overrides()
+{
+    for (int channel = 0; channel < 3; ++channel) {
+	MuxPipe pipe = {IN_PIN + channel, 20, channel};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    const Schedule schedule = {20, {0, 1}, 2, 4};
+
+    /* Line up with the start of a slot */
+    while (0 != mux_update_count % (2 * schedule.dwell)) {
+	mux_update();
+    }
+
+    MUX_CHECK(0 == set_output_schedule(20, schedule.channels, schedule.length, schedule.dwell));
+
+    mux_update();
+    MUX_CHECK(0 == current_channel(20));
+
+    /* Switching by hand only lasts until the next slot starts */
+    set_output_channel(20, 2);
+    mux_update();
+    MUX_CHECK(2 == current_channel(20));
+    mux_update();
+    mux_update();
+    MUX_CHECK(2 == current_channel(20));
+    mux_update();
+    MUX_CHECK(1 == current_channel(20));
+
+    /* Once cleared the output stays where it is */
+    clear_output_schedule(20);
+
+    for (int i = 0; i < 3 * (int) schedule.dwell; ++i) {
+	mux_update();
+	MUX_CHECK(1 == current_channel(20));
+    }
+
+    /* Replacing a schedule, and channels that come later */
+    const int later[] = {7, 0};
+    MUX_CHECK(0 == set_output_schedule(20, later, 2, 1));
+
+    MuxPipe pipe = {IN_PIN, 20, 7};
+    MUX_CHECK(0 == register_pipe(pipe));
+    mux_host_set_input(IN_PIN, HIGH);
+
+    for (int i = 0; i < 4; ++i) {
+	unsigned long count = mux_update_count;
+	mux_update();
+	MUX_CHECK(later[count % 2] == current_channel(20));
+	MUX_CHECK(HIGH == mux_host_get_level(20));
+    }
+
+    mux_host_set_input(IN_PIN, LOW);
+    mux_clear();
+}
+
+
+int main()
+{
+    test_rotation();
+    test_overrides();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_tdm");
+}
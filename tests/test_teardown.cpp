@@ -0,0 +1,328 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for tearing the topology down (unregister_pipe(),
+  unregister_output(), unregister_input(), unregister_channel() and
+  mux_clear()). Random pipes are added and removed while a model keeps
+  track of which should be left, and after every change the output
+  list, the input slots and the levels driven onto the outputs are
+  checked against it. Outputs which have been removed must not be
+  driven any more, and all of the memory must come back.
+ */
+
+#include "muxduino.h"
+#include "mux_sample.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+/* Outputs OUT_PIN.., inputs IN_PIN.. */
+#define OUT_PIN 20
+#define NUM_OUTS 6
+#define NUM_CHANNELS 3
+#define IN_PIN 2
+#define NUM_INS 8
+
+#define NUM_STEPS 3000
+
+
+/* Which pipes should be registered, and the channel each output is on */
+static bool present[NUM_OUTS][NUM_CHANNELS][NUM_INS];
+static int selected[NUM_OUTS];
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 4242;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+static bool output_present(int out)
+{
+    for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	for (int in = 0; in < NUM_INS; ++in) {
+	    if (present[out][channel][in]) return true;
+	}
+    }
+
+    return false;
+}
+
+
+static bool input_present(int in)
+{
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    if (present[out][channel][in]) return true;
+	}
+    }
+
+    return false;
+}
+
+
+/* The output list holds exactly the pipes in the model, with no empty nodes */
+static void check_list()
+{
+    int num_pipes = 0;
+
+    MuxOutputNode *out_node = mux_outs.head;
+    while (out_node) {
+	int out = out_node->out_pin - OUT_PIN;
+
+	MUX_CHECK(out >= 0 && out < NUM_OUTS);
+	MUX_CHECK(NULL != out_node->channels.head);
+	MUX_CHECK(selected[out] == out_node->channel_num);
+	MUX_CHECK(out_node->current_channel
+		  == find_channel_node(&out_node->channels, out_node->channel_num));
+
+	MuxChannelNode *channel_node = out_node->channels.head;
+	while (channel_node) {
+	    MUX_CHECK(NULL != channel_node->inputs.head);
+
+	    MuxInputNode *in_node = channel_node->inputs.head;
+	    while (in_node) {
+		MUX_CHECK(present[out][channel_node->channel][in_node->in_pin - IN_PIN]);
+		MUX_CHECK(in_node->slot == mux_sample_slot(in_node->in_pin));
+		++num_pipes;
+
+		in_node = in_node->next;
+	    }
+
+	    channel_node = channel_node->next;
+	}
+
+	out_node = out_node->next;
+    }
+
+    int expected_pipes = 0;
+
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	MUX_CHECK(output_present(out) == (NULL != find_output_node(&mux_outs, OUT_PIN + out)));
+
+	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
+	    for (int in = 0; in < NUM_INS; ++in) {
+		expected_pipes += present[out][channel][in];
+	    }
+	}
+    }
+
+    MUX_CHECK(expected_pipes == num_pipes);
+
+    /* Inputs which have gone away give up their slots */
+    for (int in = 0; in < NUM_INS; ++in) {
+	MUX_CHECK(input_present(in) == (mux_sample_slot(IN_PIN + in) >= 0));
+    }
+}
+
+
+/* Random input levels, then every output is either the OR of its channel or left alone */
+static void check_levels()
+{
+    int levels[NUM_INS];
+    int before[NUM_OUTS];
+
+    for (int in = 0; in < NUM_INS; ++in) {
+	levels[in] = (next_random() % 2) ? HIGH : LOW;
+	mux_host_set_input(IN_PIN + in, levels[in]);
+    }
+
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	before[out] = mux_host_get_level(OUT_PIN + out);
+    }
+
+    mux_update();
+
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	int expected = before[out];
+
+	if (output_present(out) && selected[out] >= 0 && selected[out] < NUM_CHANNELS) {
+	    bool any = false;
+	    int high = LOW;
+
+	    for (int in = 0; in < NUM_INS; ++in) {
+		if (present[out][selected[out]][in]) {
+		    any = true;
+		    high = (HIGH == levels[in]) ? HIGH : high;
+		}
+	    }
+
+	    expected = any ? high : expected;
+	}
+
+	MUX_CHECK(expected == mux_host_get_level(OUT_PIN + out));
+    }
+}
+
+
+static void test_random()
+{
+    for (int step = 0; step < NUM_STEPS; ++step) {
+	int out = next_random() % NUM_OUTS;
+	int channel = next_random() % NUM_CHANNELS;
+	int in = next_random() % NUM_INS;
+	MuxPipe pipe = {IN_PIN + in, OUT_PIN + out, channel};
+
+	switch (next_random() % 8) {
+	case 0:
+	case 1:
+	case 2:
+	    if (!output_present(out)) {
+		selected[out] = channel;
+	    }
+
+	    MUX_CHECK(0 == register_pipe(pipe));
+	    present[out][channel][in] = true;
+	    break;
+
+	case 3:
+	    unregister_pipe(pipe);
+	    present[out][channel][in] = false;
+	    break;
+
+	case 4:
+	    unregister_output(OUT_PIN + out);
+
+	    for (int c = 0; c < NUM_CHANNELS; ++c) {
+		for (int i = 0; i < NUM_INS; ++i) {
+		    present[out][c][i] = false;
+		}
+	    }
+	    break;
+
+	case 5:
+	    unregister_input(IN_PIN + in);
+
+	    for (int o = 0; o < NUM_OUTS; ++o) {
+		for (int c = 0; c < NUM_CHANNELS; ++c) {
+		    present[o][c][in] = false;
+		}
+	    }
+	    break;
+
+	case 6:
+	    /* The output keeps its channel number, even with the channel gone */
+	    unregister_channel(OUT_PIN + out, channel);
+
+	    for (int i = 0; i < NUM_INS; ++i) {
+		present[out][channel][i] = false;
+	    }
+	    break;
+
+	case 7:
+	    /* One past the last channel, which never has any inputs */
+	    channel = next_random() % (NUM_CHANNELS + 1);
+	    set_output_channel(OUT_PIN + out, channel);
+
+	    if (output_present(out)) {
+		selected[out] = channel;
+	    }
+	    break;
+	}
+
+	check_list();
+	check_levels();
+    }
+
+    /* Removing the last output hands back every allocation */
+    for (int out = 0; out < NUM_OUTS; ++out) {
+	unregister_output(OUT_PIN + out);
+    }
+
+    MUX_CHECK(NULL == mux_outs.head);
+    MUX_CHECK(total_allocations() == total_frees());
+}
+
+
+/* Freed slots can be taken by other pins */
+static void test_slots()
+{
+    for (int i = 0; i < MUX_MAX_INPUTS; ++i) {
+	MuxPipe pipe = {30 + i, 10, i % 4};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    MuxPipe extra = {29, 11, 0};
+    MUX_CHECK(4 == register_pipe(extra));
+
+    unregister_input(30);
+    MUX_CHECK(mux_sample_slot(30) < 0);
+    MUX_CHECK(0 == register_pipe(extra));
+
+    MuxPipe moved = {30, 11, 0};
+    MUX_CHECK(4 == register_pipe(moved));
+
+    unregister_channel(10, 1);
+    MUX_CHECK(0 == register_pipe(moved));
+
+    /* Outputs left behind are no longer driven, and can be inputs again */
+    mux_host_set_input(29, LOW);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(11));
+
+    unregister_output(11);
+    mux_host_set_input(29, HIGH);
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(11));
+    MUX_CHECK(mux_sample_slot(29) < 0);
+
+    mux_clear();
+    MUX_CHECK(NULL == mux_outs.head);
+    MUX_CHECK(total_allocations() == total_frees());
+
+    for (int i = 0; i < MUX_MAX_INPUTS; ++i) {
+	MUX_CHECK(mux_sample_slot(30 + i) < 0);
+    }
+
+    for (int i = 0; i < MUX_MAX_INPUTS; ++i) {
+	MuxPipe pipe = {11 + i, 10 + MUX_MAX_INPUTS + 1 + i % 2, 0};
+	MUX_CHECK(0 == register_pipe(pipe));
+    }
+
+    mux_update();
+    mux_clear();
+
+    /* Clearing an empty topology is fine too */
+    mux_clear();
+    mux_update();
+}
+
+
+int main()
+{
+    test_random();
+    test_slots();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_teardown");
+}
@@ -0,0 +1,246 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+/*
+  Host tests for pipe transforms (mux_transform.h). Every output gets
+  the same input through a different mix of delay, edge, stretch and
+  invert, and a random pattern is stepped through them, checking every
+  output after each update against a model of the steps. The same
+  transforms are run again behind rate dividers, where they only step
+  on the updates where their output is evaluated.
+ */
+
+#include "muxduino.h"
+#include "mux_transform.h"
+#include "mux_state.h"
+#include "mem_alloc.h"
+#include "mux_platform.h"
+
+#include "mux_test.h"
+
+
+#define IN_PIN 10
+
+/* Outputs without and with a rate divider */
+#define PLAIN_PIN 20
+#define DIVIDED_PIN 50
+
+#define NUM_UPDATES 600
+#define MAX_MODEL_DELAY 100
+
+
+static const MuxTransform transforms[] = {
+    {3, MUX_EDGE_NONE, 0, false},
+    {0, MUX_EDGE_RISING, 0, false},
+    {0, MUX_EDGE_FALLING, 2, false},
+    {0, MUX_EDGE_BOTH, 0, true},
+    {5, MUX_EDGE_RISING, 4, true},
+    {70, MUX_EDGE_NONE, 0, false},	/* Over a word of delay line */
+    {2, MUX_EDGE_BOTH, 3, false},
+    {0, MUX_EDGE_NONE, 3, false},
+    {0, MUX_EDGE_NONE, 0, true},
+    {1, MUX_EDGE_NONE, 1, false},
+};
+
+#define NUM_TRANSFORMS ((int) (sizeof(transforms) / sizeof(transforms[0])))
+
+
+/* What a transform should be doing, stepped alongside the real one */
+typedef struct Model {
+    MuxTransform transform;
+    int history[MAX_MODEL_DELAY + 1];
+    int last;
+    unsigned int stretching;
+    int divider;
+    int countdown;
+    int level;
+} Model;
+
+
+static Model models[2 * NUM_TRANSFORMS];
+
+
+static int step_model(Model *model, int level)
+{
+    const MuxTransform *transform = &model->transform;
+
+    /* history[0] is this update, history[n] is n updates ago */
+    for (int i = MAX_MODEL_DELAY; i > 0; --i) {
+	model->history[i] = model->history[i - 1];
+    }
+
+    model->history[0] = level;
+    level = model->history[transform->delay];
+
+    if (MUX_EDGE_NONE != transform->edge) {
+	bool rising = level && !model->last;
+	bool falling = !level && model->last;
+
+	model->last = level;
+
+	level = ((transform->edge & MUX_EDGE_RISING) && rising)
+	    || ((transform->edge & MUX_EDGE_FALLING) && falling);
+    }
+
+    if (transform->stretch > 1) {
+	if (level) {
+	    model->stretching = transform->stretch - 1;
+	}
+	else if (model->stretching) {
+	    --model->stretching;
+	    level = 1;
+	}
+    }
+
+    return transform->invert ? !level : level;
+}
+
+
+static void set_up(int index, int out_pin, int divider)
+{
+    Model *model = &models[index];
+    MuxPipe pipe = {IN_PIN, out_pin, 0};
+
+    MUX_CHECK(0 == register_pipe(pipe));
+    MUX_CHECK(0 == set_pipe_transform(pipe, transforms[index % NUM_TRANSFORMS]));
+
+    if (divider > 1) {
+	MUX_CHECK(0 == set_output_rate(out_pin, divider));
+    }
+
+    model->transform = transforms[index % NUM_TRANSFORMS];
+
+    for (int i = 0; i <= MAX_MODEL_DELAY; ++i) {
+	model->history[i] = 0;
+    }
+
+    model->last = 0;
+    model->stretching = 0;
+    model->divider = divider;
+    model->countdown = 1;
+    model->level = LOW;
+}
+
+
+/* Small deterministic generator, so a failure can be run again */
+static unsigned long random_state = 4321;
+
+static unsigned long next_random()
+{
+    random_state = random_state * 1103515245UL + 12345UL;
+    return (random_state >> 16) & 0x7FFF;
+}
+
+
+static void test_patterns()
+{
+    for (int i = 0; i < NUM_TRANSFORMS; ++i) {
+	set_up(i, PLAIN_PIN + i, 1);
+	set_up(NUM_TRANSFORMS + i, DIVIDED_PIN + i, 2 + i % 3);
+    }
+
+    int level = LOW;
+
+    for (int update = 0; update < NUM_UPDATES; ++update) {
+	/* Runs of a few updates, with some single update blips */
+	if (next_random() % 4 == 0) {
+	    level = (HIGH == level) ? LOW : HIGH;
+	}
+
+	mux_host_set_input(IN_PIN, level);
+	mux_update();
+
+	for (int i = 0; i < 2 * NUM_TRANSFORMS; ++i) {
+	    Model *model = &models[i];
+	    int out_pin = (i < NUM_TRANSFORMS) ? PLAIN_PIN + i : DIVIDED_PIN + i - NUM_TRANSFORMS;
+
+	    /* Divided outputs only step and change on every divider'th update */
+	    if (--model->countdown == 0) {
+		model->countdown = model->divider;
+		model->level = step_model(model, HIGH == level) ? HIGH : LOW;
+	    }
+
+	    MUX_CHECK(model->level == mux_host_get_level(out_pin));
+	}
+    }
+
+    mux_clear();
+}
+
+
+static void test_settings()
+{
+    MuxPipe pipe = {IN_PIN, PLAIN_PIN, 0};
+    MuxPipe missing = {IN_PIN + 1, PLAIN_PIN, 0};
+    MuxTransform delay = {3, MUX_EDGE_NONE, 0, false};
+    MuxTransform too_long = {MUX_MAX_DELAY + 1, MUX_EDGE_NONE, 0, false};
+    MuxTransform bad_edge = {0, 4, 0, false};
+
+    MUX_CHECK(0 == register_pipe(pipe));
+    MUX_CHECK(1 == set_pipe_transform(missing, delay));
+    MUX_CHECK(2 == set_pipe_transform(pipe, too_long));
+    MUX_CHECK(2 == set_pipe_transform(pipe, bad_edge));
+
+    /* Transforms keep stepping while their channel isn't selected */
+    MuxPipe other = {IN_PIN + 2, PLAIN_PIN, 1};
+    MUX_CHECK(0 == register_pipe(other));
+    MUX_CHECK(0 == set_pipe_transform(pipe, delay));
+    set_output_channel(PLAIN_PIN, 1);
+
+    mux_host_set_input(IN_PIN, HIGH);
+    mux_update();
+    mux_host_set_input(IN_PIN, LOW);
+    mux_update();
+    mux_update();
+
+    set_output_channel(PLAIN_PIN, 0);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(PLAIN_PIN));
+    mux_update();
+    MUX_CHECK(LOW == mux_host_get_level(PLAIN_PIN));
+
+    /* Back to passing straight through */
+    clear_pipe_transform(pipe);
+    mux_host_set_input(IN_PIN, HIGH);
+    mux_update();
+    MUX_CHECK(HIGH == mux_host_get_level(PLAIN_PIN));
+
+    /* The span is the longest delay plus stretch on the output */
+    MuxTransform long_one = {10, MUX_EDGE_RISING, 5, false};
+    MUX_CHECK(0 == set_pipe_transform(pipe, long_one));
+    MUX_CHECK(15 == mux_transform_span(find_output_node(&mux_outs, PLAIN_PIN)));
+
+    mux_clear();
+}
+
+
+int main()
+{
+    test_patterns();
+    test_settings();
+
+    MUX_CHECK(total_allocations() == total_frees());
+
+    return mux_test_finish("test_transform");
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+/*
+  Measures the shared memory pin bus (see mux_bus.h). A router process
+  is forked which passes pins 0 to n-1 through to pins 50 to 50+n-1
+  and runs mux_update() as fast as it can, while this process drives
+  the inputs through the bus. This is a host program, built along with
+  every .cpp file in ../muxduino:
+
+      g++ -O2 -I ../muxduino -o mux_bus_bench mux_bus_bench.cpp \
+	  $(ls ../muxduino/[a-z]*.cpp) -lpthread
+
+  Usage:
+
+      mux_bus_bench [pins] [seconds]
+
+  pins is the number of pass-through pins (32 by default, at most
+  50, since pins from MUX_EXPANDER_PIN_BASE up are virtual) and seconds is how long to run each test for (1).
+
+  Prints how fast the router updates, how many batches of inputs the
+  client can write, and the round trip time from writing an input to
+  seeing the output follow it. Both processes spin, so on a single
+  core the round trip is mostly the scheduler's time slice.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "muxduino.h"
+#include "mux_bus.h"
+#include "mux_platform.h"
+
+
+/* Outputs are this far above their inputs */
+#define OUT_OFFSET 50
+
+/* Most round trips to keep the times of, for the percentiles */
+#define MAX_TRIPS 1000000
+
+
+static double wall_seconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+static void run_router(const char *name, int num_pins)
+{
+    for (int pin = 0; pin < num_pins; ++pin) {
+	MuxPipe pipe = {pin, pin + OUT_OFFSET, 0};
+	register_pipe(pipe);
+    }
+
+    if (0 != mux_host_attach_bus(name)) {
+	_exit(1);
+    }
+
+    while (true) {
+	mux_update();
+    }
+}
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+int main(int argc, char **argv)
+{
+    int num_pins = (argc > 1) ? atoi(argv[1]) : 32;
+    double seconds = (argc > 2) ? atof(argv[2]) : 1.0;
+
+    if (argc > 3 || num_pins < 1 || num_pins > OUT_OFFSET || seconds <= 0) {
+	fprintf(stderr, "Usage: %s [pins] [seconds]\n", argv[0]);
+	return 1;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/mux_bus_bench.%d", (int) getpid());
+
+    pid_t router = fork();
+
+    if (0 == router) {
+	run_router(name, num_pins);
+    }
+
+    MuxBus *bus = NULL;
+    double start = wall_seconds();
+
+    while (NULL == (bus = mux_bus_open(name))) {
+	if (wall_seconds() - start > 5.0) {
+	    fprintf(stderr, "The router didn't start\n");
+	    kill(router, SIGTERM);
+	    return 1;
+	}
+
+	usleep(1000);
+    }
+
+    /* How fast the router goes with nobody writing */
+    uint32_t first = mux_bus_updates(bus);
+    usleep((useconds_t) (seconds * 1e6));
+    uint32_t updates = mux_bus_updates(bus) - first;
+
+    printf("pins:            %d\n", num_pins);
+    printf("router updates:  %.0f per second\n", updates / seconds);
+
+    /* Batches of every input, as fast as they can be written */
+    unsigned long batches = 0;
+    start = wall_seconds();
+
+    while (wall_seconds() - start < seconds) {
+	for (int i = 0; i < 1000; ++i, ++batches) {
+	    mux_bus_begin_inputs(bus);
+
+	    for (int pin = 0; pin < num_pins; ++pin) {
+		mux_bus_put_input(bus, pin, (batches + pin) & 1);
+	    }
+
+	    mux_bus_end_inputs(bus);
+	}
+    }
+
+    double elapsed = wall_seconds() - start;
+    printf("input batches:   %.0f per second (%.0f pin writes per second)\n",
+	   batches / elapsed, batches * num_pins / elapsed);
+
+    /* Round trips through the router on the first pin */
+    double *trips = (double *) malloc(MAX_TRIPS * sizeof(double));
+    int num_trips = 0;
+    int level = mux_bus_get_level(bus, OUT_OFFSET);
+
+    start = wall_seconds();
+
+    while (num_trips < MAX_TRIPS && wall_seconds() - start < seconds) {
+	level = !level;
+
+	double sent = wall_seconds();
+	mux_bus_set_input(bus, 0, level);
+
+	while (mux_bus_get_level(bus, OUT_OFFSET) != level) {
+	}
+
+	trips[num_trips++] = wall_seconds() - sent;
+    }
+
+    qsort(trips, num_trips, sizeof(double), compare_doubles);
+
+    printf("round trips:     %.0f per second\n", num_trips / (wall_seconds() - start));
+    printf("round trip time: p50 %.2f us, p99 %.2f us, max %.2f us\n",
+	   trips[num_trips / 2] * 1e6, trips[num_trips * 99 / 100] * 1e6,
+	   trips[num_trips - 1] * 1e6);
+
+    free(trips);
+    mux_bus_close(bus);
+
+    kill(router, SIGTERM);
+    waitpid(router, NULL, 0);
+    mux_bus_remove(name);
+
+    return 0;
+}
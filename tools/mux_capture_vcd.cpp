@@ -0,0 +1,307 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+/*
+  Converts a capture exported by mux_capture_export() into a VCD file,
+  which can be opened in most waveform viewers (GTKWave, PulseView...).
+  This is a host program, built with something like:
+
+      g++ -I ../muxduino -o mux_capture_vcd mux_capture_vcd.cpp
+
+  Usage:
+
+      mux_capture_vcd capture.bin capture.vcd
+
+  Each input and output pin becomes a wire, each output's channel
+  becomes an integer, and the trigger becomes an event. Times are in
+  microseconds from the first record. Signals are unknown (x) until
+  their first record.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mux_capture.h"
+
+
+/* A pin's wire (or an output's channel) in the VCD file */
+typedef struct Signal {
+    unsigned char kind;
+    unsigned long pin;
+    char id[4];
+} Signal;
+
+
+typedef struct Record {
+    unsigned long long time;
+    unsigned char kind;
+    int level;
+    unsigned long pin;
+    long channel;
+} Record;
+
+
+static Signal *signals = NULL;
+static int num_signals = 0;
+
+
+static unsigned long read_u32(const unsigned char *bytes)
+{
+    return bytes[0] | (bytes[1] << 8) | ((unsigned long) bytes[2] << 16)
+	| ((unsigned long) bytes[3] << 24);
+}
+
+
+/* Read a varint, returns false if it runs off the end */
+static bool read_varint(const unsigned char *data, unsigned long len,
+			unsigned long *position, unsigned long *value)
+{
+    unsigned char shift = 0;
+    *value = 0;
+
+    while (*position < len && shift < 35) {
+	unsigned char byte = data[(*position)++];
+
+	*value |= (unsigned long) (byte & 0x7F) << shift;
+	shift += 7;
+
+	if (!(byte & 0x80)) {
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+
+/* Find the signal, adding it if it is new */
+static Signal * find_signal(unsigned char kind, unsigned long pin)
+{
+    for (int i = 0; i < num_signals; ++i) {
+	if (signals[i].kind == kind && signals[i].pin == pin) {
+	    return &signals[i];
+	}
+    }
+
+    signals = (Signal *) realloc(signals, (num_signals + 1) * sizeof(Signal));
+
+    if (NULL == signals) {
+	fprintf(stderr, "Out of memory\n");
+	exit(1);
+    }
+
+    Signal *signal = &signals[num_signals];
+    int n = num_signals++;
+
+    /* Identifiers are made of the printable characters '!' to '~' */
+    signal->kind = kind;
+    signal->pin = pin;
+    signal->id[0] = '!' + n % 94;
+    signal->id[1] = (n >= 94) ? '!' + (n / 94) % 94 : '\0';
+    signal->id[2] = (n >= 94 * 94) ? '!' + n / (94 * 94) : '\0';
+    signal->id[3] = '\0';
+
+    return signal;
+}
+
+
+static void write_binary(FILE *out, long value)
+{
+    unsigned long bits = (unsigned long) value;
+    int top = 31;
+
+    while (top > 0 && !((bits >> top) & 1)) {
+	--top;
+    }
+
+    fputc('b', out);
+
+    for (int i = top; i >= 0; --i) {
+	fputc(((bits >> i) & 1) ? '1' : '0', out);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s capture.bin capture.vcd\n", argv[0]);
+	return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+
+    if (NULL == in) {
+	perror(argv[1]);
+	return 1;
+    }
+
+    unsigned char header[MUX_CAPTURE_HEADER_SIZE];
+
+    if (fread(header, 1, sizeof(header), in) != sizeof(header)
+	|| memcmp(header, "MXCP", 4) != 0) {
+	fprintf(stderr, "%s: not a capture\n", argv[1]);
+	return 1;
+    }
+
+    if (MUX_CAPTURE_VERSION != header[4]) {
+	fprintf(stderr, "%s: capture format version %d is not supported\n", argv[1], header[4]);
+	return 1;
+    }
+
+    unsigned long len = read_u32(header + 9);
+    unsigned char *data = (unsigned char *) malloc(len ? len : 1);
+
+    if (NULL == data || fread(data, 1, len, in) != len) {
+	fprintf(stderr, "%s: capture is truncated\n", argv[1]);
+	return 1;
+    }
+
+    fclose(in);
+
+    /* Decode every record up front, so all the signals are known for the header */
+    Record *records = (Record *) malloc((len ? len : 1) * sizeof(Record));
+    int num_records = 0;
+    unsigned long long time = 0;
+    unsigned long position = 0;
+
+    while (position < len) {
+	Record *record = &records[num_records];
+	unsigned char byte = data[position++];
+	unsigned long delta;
+	unsigned long value = 0;
+
+	record->kind = byte >> 1;
+	record->level = byte & 1;
+	record->pin = 0;
+	record->channel = 0;
+
+	bool ok = record->kind <= MUX_CAPTURE_MARK && read_varint(data, len, &position, &delta);
+
+	if (ok && MUX_CAPTURE_MARK != record->kind) {
+	    ok = read_varint(data, len, &position, &record->pin);
+	}
+
+	if (ok && MUX_CAPTURE_CHANNEL == record->kind) {
+	    ok = read_varint(data, len, &position, &value);
+	    record->channel = (value & 1) ? -(long) (value >> 1) - 1 : (long) (value >> 1);
+	}
+
+	if (!ok) {
+	    fprintf(stderr, "%s: bad record at byte %lu\n", argv[1], position);
+	    return 1;
+	}
+
+	time += delta;
+	record->time = time;
+
+	if (MUX_CAPTURE_MARK != record->kind) {
+	    find_signal(record->kind, record->pin);
+	    ++num_records;
+	}
+	else if (record->level) {
+	    /* The trigger, time only marks aren't needed in the VCD */
+	    find_signal(MUX_CAPTURE_MARK, 0);
+	    ++num_records;
+	}
+    }
+
+    FILE *out = fopen(argv[2], "w");
+
+    if (NULL == out) {
+	perror(argv[2]);
+	return 1;
+    }
+
+    fprintf(out, "$comment MuxDuino capture, starting at %lu us $end\n", read_u32(header + 5));
+    fprintf(out, "$timescale 1us $end\n");
+    fprintf(out, "$scope module muxduino $end\n");
+
+    for (int i = 0; i < num_signals; ++i) {
+	Signal *signal = &signals[i];
+
+	switch (signal->kind) {
+	case MUX_CAPTURE_INPUT:
+	    fprintf(out, "$var wire 1 %s in_%lu $end\n", signal->id, signal->pin);
+	    break;
+
+	case MUX_CAPTURE_OUTPUT:
+	    fprintf(out, "$var wire 1 %s out_%lu $end\n", signal->id, signal->pin);
+	    break;
+
+	case MUX_CAPTURE_CHANNEL:
+	    fprintf(out, "$var integer 32 %s channel_%lu $end\n", signal->id, signal->pin);
+	    break;
+
+	case MUX_CAPTURE_MARK:
+	    fprintf(out, "$var event 1 %s trigger $end\n", signal->id);
+	    break;
+	}
+    }
+
+    fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+    fprintf(out, "#0\n$dumpvars\n");
+
+    for (int i = 0; i < num_signals; ++i) {
+	if (MUX_CAPTURE_CHANNEL == signals[i].kind) {
+	    fprintf(out, "bx %s\n", signals[i].id);
+	}
+	else if (MUX_CAPTURE_MARK != signals[i].kind) {
+	    fprintf(out, "x%s\n", signals[i].id);
+	}
+    }
+
+    fprintf(out, "$end\n");
+
+    unsigned long long last_time = 0;
+
+    for (int i = 0; i < num_records; ++i) {
+	Record *record = &records[i];
+	Signal *signal = find_signal(record->kind, record->pin);
+
+	if (record->time != last_time) {
+	    fprintf(out, "#%llu\n", record->time);
+	    last_time = record->time;
+	}
+
+	if (MUX_CAPTURE_CHANNEL == record->kind) {
+	    write_binary(out, record->channel);
+	    fprintf(out, " %s\n", signal->id);
+	}
+	else {
+	    fprintf(out, "%d%s\n", (MUX_CAPTURE_MARK == record->kind) ? 1 : record->level,
+		    signal->id);
+	}
+    }
+
+    fclose(out);
+    free(records);
+    free(data);
+    free(signals);
+
+    return 0;
+}
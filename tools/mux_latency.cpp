@@ -0,0 +1,379 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+/*
+  Measures how long after an input edge the routed output follows, for
+  each way of running the updates. Edges are put on the inputs through
+  the host backend at random times, and every output write is
+  timestamped with mux_host_set_write_hook(). The latency depends on
+  where the edge lands relative to the update and on where the output
+  is in the walk, so it is reported separately for every output, in
+  the order the outputs are walked. This is a host program, built
+  along with every .cpp file in ../muxduino:
+
+      g++ -O2 -I ../muxduino -o mux_latency mux_latency.cpp \
+	  $(ls ../muxduino/[a-z]*.cpp) -lpthread
+
+  Usage:
+
+      mux_latency [outputs] [fanin] [rate] [seconds] [period]
+
+  outputs is the number of outputs (16 by default). Output n is on
+  pin 50 + n and follows input pin n. fanin is the number of inputs on
+  each output's channel (1). The extra inputs are shared by every
+  output and stay LOW, so they only make each channel more work to
+  evaluate. outputs + fanin - 1 can be at most 50. rate is the average
+  number of edges per second (2000), spread at random over the inputs.
+  seconds is how long to run each mode for (1). period is the update
+  period in microseconds for the fixed rate mode (1000).
+
+  The modes are:
+
+      loop: mux_update() as fast as it will go.
+
+      fixed: mux_schedule_poll() with the scheduler running at the
+	     given period (see mux_schedule.h).
+
+      idle: mux_idle_update() sleeping until an input changes (see
+	    mux_idle.h).
+
+  For loop and fixed the edges are put on the pins between updates,
+  but timed from when they were due, as if they had landed part way
+  through the update before. For idle they come from another thread,
+  which is the only way to wake the router up. An input only gets a
+  new edge once the last one has come out, so every edge is matched
+  to exactly one output change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "muxduino.h"
+#include "mux_schedule.h"
+#include "mux_idle.h"
+#include "mux_platform.h"
+
+
+/* Outputs are this far above their inputs */
+#define OUT_BASE 50
+
+
+/* Latencies measured for one output, in microseconds */
+typedef struct Samples {
+    double *values;
+    long count;
+    long max;
+} Samples;
+
+
+typedef enum Mode {
+    MODE_LOOP,
+    MODE_FIXED,
+    MODE_IDLE
+} Mode;
+
+
+static const char *mode_names[] = {"loop", "fixed", "idle"};
+
+static int num_outputs = 16;
+static int fanin = 1;
+static double rate = 2000;
+static double seconds = 1;
+static unsigned long period = 1000;
+
+static Samples samples[OUT_BASE];
+
+/* Time each input's unanswered edge was due, 0 if it has none */
+static long long pending[OUT_BASE];
+
+static long skipped = 0;
+static unsigned int seed = 1;
+static volatile bool stopping = false;
+
+
+static long long now_ns()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+static void add_sample(Samples *set, double value)
+{
+    if (set->count == set->max) {
+	set->max = set->max ? 2 * set->max : 1024;
+	set->values = (double *) realloc(set->values, set->max * sizeof(double));
+    }
+
+    set->values[set->count++] = value;
+}
+
+
+/* Called by the host backend on every output change */
+static void output_written(int pin, int)
+{
+    long long written = now_ns();
+    int output = pin - OUT_BASE;
+
+    if (output < 0 || output >= num_outputs) {
+	return;
+    }
+
+    long long due = __atomic_exchange_n(&pending[output], 0, __ATOMIC_ACQ_REL);
+
+    if (due) {
+	add_sample(&samples[output], (written - due) / 1000.0);
+    }
+}
+
+
+/* Nanoseconds until the next edge, for edges at random at the given rate */
+static long long next_gap()
+{
+    double uniform = (rand_r(&seed) + 1.0) / (RAND_MAX + 2.0);
+
+    return (long long) (-log(uniform) / rate * 1e9);
+}
+
+
+/* Puts an edge on a random input which has no edge in flight */
+static void inject(long long due)
+{
+    int input = rand_r(&seed) % num_outputs;
+
+    for (int tries = 0; tries < num_outputs; ++tries) {
+	int candidate = (input + tries) % num_outputs;
+
+	if (0 == __atomic_load_n(&pending[candidate], __ATOMIC_ACQUIRE)) {
+	    __atomic_store_n(&pending[candidate], due, __ATOMIC_RELEASE);
+	    mux_host_set_input(candidate, !mux_host_get_level(candidate));
+	    return;
+	}
+    }
+
+    ++skipped;
+}
+
+
+static void build_topology()
+{
+    mux_clear();
+
+    for (int output = 0; output < num_outputs; ++output) {
+	MuxPipe pipe = {output, OUT_BASE + output, 0};
+	register_pipe(pipe);
+
+	for (int extra = 1; extra < fanin; ++extra) {
+	    MuxPipe filler = {num_outputs + extra - 1, OUT_BASE + output, 0};
+	    register_pipe(filler);
+	}
+    }
+
+    for (int pin = 0; pin < OUT_BASE; ++pin) {
+	mux_host_set_input(pin, LOW);
+    }
+
+    /* Settle every output before anything is timed */
+    mux_update();
+
+    for (int output = 0; output < num_outputs; ++output) {
+	pending[output] = 0;
+	samples[output].count = 0;
+    }
+
+    skipped = 0;
+}
+
+
+static void run_busy(Mode mode)
+{
+    if (MODE_FIXED == mode) {
+	mux_schedule_start(period);
+    }
+
+    long long end = now_ns() + (long long) (seconds * 1e9);
+    long long next_edge = now_ns() + next_gap();
+    long long now;
+
+    while ((now = now_ns()) < end) {
+	while (next_edge <= now) {
+	    inject(next_edge);
+	    next_edge += next_gap();
+	}
+
+	if (MODE_LOOP == mode) {
+	    mux_update();
+	}
+	else {
+	    mux_schedule_poll();
+	}
+    }
+
+    if (MODE_FIXED == mode) {
+	mux_schedule_stop();
+    }
+}
+
+
+static void * injector(void *)
+{
+    long long next_edge = now_ns() + next_gap();
+
+    while (!stopping) {
+	struct timespec until;
+	until.tv_sec = next_edge / 1000000000LL;
+	until.tv_nsec = next_edge % 1000000000LL;
+
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL);
+
+	inject(now_ns());
+	next_edge += next_gap();
+    }
+
+    return NULL;
+}
+
+
+static void run_idle()
+{
+    pthread_t thread;
+    long long end = now_ns() + (long long) (seconds * 1e9);
+
+    stopping = false;
+    pthread_create(&thread, NULL, injector, NULL);
+
+    while (now_ns() < end) {
+	mux_idle_update(100);
+    }
+
+    stopping = true;
+    pthread_join(thread, NULL);
+
+    /* Let the last edges out, so they aren't left hanging */
+    mux_update();
+}
+
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void print_row(const char *name, Samples *set)
+{
+    if (0 == set->count) {
+	printf("  %-8s %8ld %10s %10s %10s\n", name, 0L, "-", "-", "-");
+	return;
+    }
+
+    qsort(set->values, set->count, sizeof(double), compare_doubles);
+
+    printf("  %-8s %8ld %10.2f %10.2f %10.2f\n", name, set->count,
+	   set->values[set->count / 2], set->values[set->count * 99 / 100],
+	   set->values[set->count - 1]);
+}
+
+
+static void report(Mode mode)
+{
+    Samples all = {NULL, 0, 0};
+    char name[16];
+
+    printf("%s: ", mode_names[mode]);
+
+    if (MODE_FIXED == mode) {
+	printf("period %lu us, ", period);
+    }
+
+    printf("%ld edges skipped (input still busy)\n", skipped);
+    printf("  %-8s %8s %10s %10s %10s\n", "output", "edges", "p50 us", "p99 us", "max us");
+
+    for (int output = 0; output < num_outputs; ++output) {
+	for (long i = 0; i < samples[output].count; ++i) {
+	    add_sample(&all, samples[output].values[i]);
+	}
+
+	snprintf(name, sizeof(name), "%d", OUT_BASE + output);
+	print_row(name, &samples[output]);
+    }
+
+    print_row("all", &all);
+    printf("\n");
+
+    free(all.values);
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) num_outputs = atoi(argv[1]);
+    if (argc > 2) fanin = atoi(argv[2]);
+    if (argc > 3) rate = atof(argv[3]);
+    if (argc > 4) seconds = atof(argv[4]);
+    if (argc > 5) period = strtoul(argv[5], NULL, 10);
+
+    if (argc > 6 || num_outputs < 1 || fanin < 1 || num_outputs + fanin - 1 > OUT_BASE
+	|| rate <= 0 || seconds <= 0 || period < 50) {
+	fprintf(stderr, "Usage: %s [outputs] [fanin] [rate] [seconds] [period]\n", argv[0]);
+	return 1;
+    }
+
+    printf("%d outputs, %d inputs per channel, %.0f edges per second\n\n",
+	   num_outputs, fanin, rate);
+
+    mux_host_set_write_hook(output_written);
+
+    for (int mode = MODE_LOOP; mode <= MODE_IDLE; ++mode) {
+	build_topology();
+
+	if (MODE_IDLE == mode) {
+	    run_idle();
+	}
+	else {
+	    run_busy((Mode) mode);
+	}
+
+	report((Mode) mode);
+    }
+
+    mux_host_set_write_hook(NULL);
+    mux_clear();
+
+    for (int output = 0; output < num_outputs; ++output) {
+	free(samples[output].values);
+    }
+
+    return 0;
+}
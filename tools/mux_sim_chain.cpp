@@ -0,0 +1,160 @@
+/* Copyright (C) 2013 Calvin Beck
+
+  Permission is hereby granted, free of charge, to any person
+  obtaining a copy of this software and associated documentation files
+  (the "Software"), to deal in the Software without restriction,
+  including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Software,
+  and to permit persons to whom the Software is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be
+  included in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+  NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+  BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+  ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+  CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+*/
+
+
+
+/*
+  Times a chain of simulated boards (see mux_sim.h), where each board
+  passes its input pin straight through to its output pin, which is
+  wired to the input of the next board. The input of the first board
+  is toggled a number of times, and after each toggle the simulation
+  runs until the change comes out of the last board. This is a host
+  program, built along with every .cpp file in ../muxduino:
+
+      g++ -O2 -I ../muxduino -o mux_sim_chain mux_sim_chain.cpp \
+	  $(ls ../muxduino/[a-z]*.cpp) -lpthread
+
+  Usage:
+
+      mux_sim_chain [boards] [period] [toggles] [delay]
+
+  boards is the length of the chain (1000 by default), period is the
+  update period of a real board in microseconds (1000), toggles is how
+  many times to change the first input (100), and delay is the delay
+  of each net in cycles (1).
+
+  Prints the propagation delay through the chain in cycles and in
+  real time, how many board updates were needed compared to updating
+  every board on every cycle, and how much faster than real time the
+  simulation ran.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "muxduino.h"
+#include "mux_sim.h"
+#include "mux_platform.h"
+
+
+/* Pins used on every board */
+#define IN_PIN 2
+#define OUT_PIN 3
+
+
+static double wall_seconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+static long argument(int argc, char **argv, int index, long fallback)
+{
+    return (index < argc) ? atol(argv[index]) : fallback;
+}
+
+
+int main(int argc, char **argv)
+{
+    long num_boards = argument(argc, argv, 1, 1000);
+    long period = argument(argc, argv, 2, 1000);
+    long toggles = argument(argc, argv, 3, 100);
+    long delay = argument(argc, argv, 4, 1);
+
+    if (argc > 5 || num_boards < 1 || period < 1 || toggles < 1 || delay < 1) {
+	fprintf(stderr, "Usage: %s [boards] [period] [toggles] [delay]\n", argv[0]);
+	return 1;
+    }
+
+    MuxPipe pipe = {IN_PIN, OUT_PIN, 0};
+
+    for (long i = 0; i < num_boards; ++i) {
+	int board = mux_sim_add_board();
+
+	if (board < 0 || 0 != mux_sim_select(board) || 0 != register_pipe(pipe)) {
+	    fprintf(stderr, "Out of memory at board %ld\n", i);
+	    return 1;
+	}
+
+	if (board > 0 && 0 != mux_sim_connect(board - 1, OUT_PIN, board, IN_PIN, delay)) {
+	    fprintf(stderr, "Out of memory at net %ld\n", i);
+	    return 1;
+	}
+    }
+
+    mux_sim_select(-1);
+
+    /* Let every board do its first update before timing anything */
+    mux_sim_run(~0UL);
+
+    MuxSimStats before;
+    mux_sim_stats(&before);
+
+    int last = num_boards - 1;
+    long shortest = -1;
+    long longest = -1;
+    double start = wall_seconds();
+
+    for (long i = 0; i < toggles; ++i) {
+	mux_sim_set_input(0, IN_PIN, (i % 2) ? LOW : HIGH);
+	mux_sim_run(~0UL);
+
+	long cycles = mux_sim_delay(0, IN_PIN, last, OUT_PIN);
+
+	if (shortest < 0 || cycles < shortest) {
+	    shortest = cycles;
+	}
+
+	if (cycles > longest) {
+	    longest = cycles;
+	}
+    }
+
+    double wall = wall_seconds() - start;
+
+    MuxSimStats after;
+    mux_sim_stats(&after);
+
+    unsigned long cycles = after.cycles - before.cycles;
+    unsigned long updates = after.updates - before.updates;
+    double simulated = (double) cycles * period / 1e6;
+
+    printf("boards:            %ld\n", num_boards);
+    printf("propagation delay: %ld to %ld cycles (%.3f ms at %ld us per update)\n",
+	   shortest, longest, longest * period / 1000.0, period);
+    printf("cycles simulated:  %lu\n", cycles);
+    printf("board updates:     %lu of %lu (%.2f%%)\n", updates,
+	   cycles * num_boards, 100.0 * updates / ((double) cycles * num_boards));
+    printf("events:            %lu\n", after.events - before.events);
+    printf("simulated time:    %.3f s\n", simulated);
+    printf("wall time:         %.3f s\n", wall);
+    printf("speed:             %.1fx real time\n", wall > 0 ? simulated / wall : 0.0);
+
+    mux_sim_clear();
+    return 0;
+}